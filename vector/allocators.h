@@ -0,0 +1,495 @@
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+
+
+
+namespace detail {
+
+// The size in bytes of n objects of type T; throws where it doesn't fit size_t instead of wrapping
+template <typename T>
+size_t AllocationBytes(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+        throw std::bad_array_new_length();
+    }
+    return n * sizeof(T);
+}
+
+}
+
+
+
+
+
+// Allocator on top of malloc/free. Provides reallocate(), which lets Vector of trivially relocatable
+// elements grow through realloc: glibc extends the block in place when it can, and remaps the pages
+// of large mmap-backed blocks instead of copying them. allocate_at_least() turns the slack malloc rounds
+// a new block up to into capacity; blocks grown through reallocate() keep the requested size
+template <typename T>
+class MallocAllocator {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "malloc doesn't guarantee the alignment of T");
+
+public:
+    using value_type = T;
+
+    struct allocation_result {
+        T* ptr;
+        size_t count;
+    };
+
+    MallocAllocator() = default;
+
+    template <typename U>
+    MallocAllocator(const MallocAllocator<U>& /*other*/) noexcept {
+    }
+
+    T* allocate(size_t n) {
+        void* buf = std::malloc(detail::AllocationBytes<T>(n));
+        if (buf == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(buf);
+    }
+
+    allocation_result allocate_at_least(size_t n) {
+        T* buf = allocate(n);
+#if defined(__GLIBC__)
+        // The compiler and _FORTIFY_SOURCE only count the size passed to malloc as the object, so the block
+        // is reallocated to its usable size, which glibc does in place
+        const size_t usable = malloc_usable_size(buf) / sizeof(T);
+        if (usable > n) {
+            if (void* grown = std::realloc(static_cast<void*>(buf), usable * sizeof(T))) {
+                return { static_cast<T*>(grown), usable };
+            }
+        }
+#endif
+        return { buf, n };
+    }
+
+    void deallocate(T* buf, size_t /*n*/) noexcept {
+        std::free(buf);
+    }
+
+    T* reallocate(T* buf, size_t /*old_n*/, size_t new_n) {
+        void* new_buf = std::realloc(static_cast<void*>(buf), detail::AllocationBytes<T>(new_n));
+        if (new_buf == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(new_buf);
+    }
+
+    template <typename U>
+    bool operator==(const MallocAllocator<U>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const MallocAllocator<U>& /*other*/) const noexcept {
+        return false;
+    }
+};
+
+
+
+
+
+// Allocator returning buffers aligned to Alignment bytes: 32 or 64 for AVX2/AVX-512 loads,
+// the cache line size to keep buffers used by different threads off shared lines
+template <typename T, size_t Alignment = 64>
+class AlignedAllocator {
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+    static_assert(Alignment >= alignof(T), "Alignment must not be weaker than the alignment of T");
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, std::max(Alignment, alignof(U))>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U, size_t OtherAlignment>
+    AlignedAllocator(const AlignedAllocator<U, OtherAlignment>& /*other*/) noexcept {
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(detail::AllocationBytes<T>(n), std::align_val_t{ Alignment }));
+    }
+
+    void deallocate(T* buf, size_t n) noexcept {
+        ::operator delete(buf, n * sizeof(T), std::align_val_t{ Alignment });
+    }
+
+    template <typename U, size_t OtherAlignment>
+    bool operator==(const AlignedAllocator<U, OtherAlignment>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <typename U, size_t OtherAlignment>
+    bool operator!=(const AlignedAllocator<U, OtherAlignment>& /*other*/) const noexcept {
+        return false;
+    }
+};
+
+
+
+#if defined(__linux__)
+
+// How HugePageAllocator asks the kernel for huge pages
+enum class HugePages {
+    // madvise(MADV_HUGEPAGE) on an ordinary mapping; works with transparent huge pages enabled in "madvise" mode
+    Advise,
+    // mmap(MAP_HUGETLB) from the pages reserved in /proc/sys/vm/nr_hugepages, falling back to Advise
+    // when none are left
+    Reserve,
+};
+
+// Allocator backing buffers of at least Threshold bytes with 2 MiB pages, which cuts TLB misses
+// on scans of large vectors. Smaller buffers come from malloc. Large buffers are whole huge pages,
+// reported back as capacity through allocate_at_least(), and grow through mremap() without copying.
+// A moved mapping may lose its huge page alignment, in which case only its aligned middle gets huge pages
+template <typename T, size_t Threshold = (size_t{ 2 } << 20), HugePages Mode = HugePages::Advise>
+class HugePageAllocator {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "malloc doesn't guarantee the alignment of T");
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = HugePageAllocator<U, Threshold, Mode>;
+    };
+
+    struct allocation_result {
+        T* ptr;
+        size_t count;
+    };
+
+    static constexpr size_t kHugePageSize = size_t{ 2 } << 20;
+
+    HugePageAllocator() = default;
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U, Threshold, Mode>& /*other*/) noexcept {
+    }
+
+    T* allocate(size_t n) {
+        const size_t bytes = detail::AllocationBytes<T>(n);
+        return static_cast<T*>(IsLarge(bytes) ? MapLarge(bytes) : Malloc(bytes));
+    }
+
+    allocation_result allocate_at_least(size_t n) {
+        T* buf = allocate(n);
+        const size_t bytes = n * sizeof(T);
+        return { buf, IsLarge(bytes) ? RoundUp(bytes) / sizeof(T) : n };
+    }
+
+    void deallocate(T* buf, size_t n) noexcept {
+        const size_t bytes = n * sizeof(T);
+        if (IsLarge(bytes)) {
+            munmap(buf, RoundUp(bytes));
+        }
+        else {
+            std::free(buf);
+        }
+    }
+
+    T* reallocate(T* buf, size_t old_n, size_t new_n) {
+        const size_t old_bytes = old_n * sizeof(T);
+        const size_t new_bytes = detail::AllocationBytes<T>(new_n);
+
+        if (!IsLarge(old_bytes) && !IsLarge(new_bytes)) {
+            void* new_buf = std::realloc(static_cast<void*>(buf), new_bytes);
+            if (new_buf == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(new_buf);
+        }
+
+        if (IsLarge(old_bytes) && IsLarge(new_bytes)) {
+            void* new_buf = mremap(buf, RoundUp(old_bytes), RoundUp(new_bytes), MREMAP_MAYMOVE);
+            if (new_buf != MAP_FAILED) {
+                Advise(new_buf, RoundUp(new_bytes));
+                return static_cast<T*>(new_buf);
+            }
+            // Older kernels can't move MAP_HUGETLB mappings, so copy like for a threshold crossing
+        }
+
+        T* new_buf = allocate(new_n);
+        std::memcpy(static_cast<void*>(new_buf), static_cast<const void*>(buf), std::min(old_bytes, new_bytes));
+        deallocate(buf, old_n);
+
+        return new_buf;
+    }
+
+    template <typename U>
+    bool operator==(const HugePageAllocator<U, Threshold, Mode>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U, Threshold, Mode>& /*other*/) const noexcept {
+        return false;
+    }
+
+private:
+    static bool IsLarge(size_t bytes) noexcept {
+        return bytes >= Threshold && bytes != 0;
+    }
+
+    static size_t RoundUp(size_t bytes) noexcept {
+        return (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    }
+
+    static void* Malloc(size_t bytes) {
+        void* buf = std::malloc(bytes);
+        if (buf == nullptr) {
+            throw std::bad_alloc();
+        }
+        return buf;
+    }
+
+    static void Advise(void* buf, size_t bytes) noexcept {
+        // Only a hint: without transparent huge pages the buffer just stays on 4 KiB pages
+        madvise(buf, bytes, MADV_HUGEPAGE);
+    }
+
+    static void* MapLarge(size_t bytes) {
+        const size_t size = RoundUp(bytes);
+
+        if constexpr (Mode == HugePages::Reserve) {
+            void* buf = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (buf != MAP_FAILED) {
+                return buf;
+            }
+        }
+
+        // The kernel backs only huge page aligned ranges with huge pages, so map an extra page and trim
+        // the mapping to an aligned start
+        void* raw = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(raw);
+        const uintptr_t aligned = (begin + kHugePageSize - 1) & ~(uintptr_t{ kHugePageSize } - 1);
+        if (aligned != begin) {
+            munmap(raw, aligned - begin);
+        }
+        munmap(reinterpret_cast<void*>(aligned + size), kHugePageSize - (aligned - begin));
+
+        void* buf = reinterpret_cast<void*>(aligned);
+        Advise(buf, size);
+
+        return buf;
+    }
+};
+
+
+
+// Where NumaAllocator puts the pages of a large buffer
+enum class NumaPolicy {
+    // On the node of the thread which first writes to each page, even under a process-wide policy like
+    // numactl --interleave. Fill the vector with ParallelResize or ParallelVector and scan it with
+    // ParallelOptions::static_schedule, so each page lands on the node of the worker which reads it later
+    Local,
+    // Round-robin over the nodes page by page, spreading the bandwidth of a buffer all the threads scan
+    Interleave,
+    // Only on the given nodes
+    Bind,
+};
+
+// Bit mask of the NUMA nodes the process may allocate on, among the first 64. Node 0 if the kernel doesn't say
+inline uint64_t NumaAllowedNodes() noexcept {
+    static const uint64_t nodes = [] {
+        // get_mempolicy fails unless the mask covers every possible node of the kernel
+        unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+        int mode = 0;
+        if (syscall(SYS_get_mempolicy, &mode, mask, 1024ul, nullptr, static_cast<unsigned long>(MPOL_F_MEMS_ALLOWED)) != 0
+            || mask[0] == 0) {
+            return uint64_t{ 1 };
+        }
+        return static_cast<uint64_t>(mask[0]);
+    }();
+    return nodes;
+}
+
+// Allocator placing buffers of at least Threshold bytes on NUMA nodes by a NumaPolicy. Large buffers are
+// page-aligned mappings whose policy is set with mbind() before any page is touched, and they grow through
+// mremap(), which keeps their pages where they are. Smaller buffers come from malloc.
+// mbind() is called directly, so libnuma isn't needed to link. The policy is a request: on a kernel without
+// NUMA support, or for nodes the process may not use, the buffer is placed by first touch.
+// Any NumaAllocator frees the buffers of another, so a vector moved into one with a different policy
+// keeps its buffer and applies its own policy from its next allocation on
+template <typename T, size_t Threshold = (size_t{ 1 } << 20)>
+class NumaAllocator {
+    static_assert(alignof(T) <= alignof(std::max_align_t), "malloc doesn't guarantee the alignment of T");
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = NumaAllocator<U, Threshold>;
+    };
+
+    struct allocation_result {
+        T* ptr;
+        size_t count;
+    };
+
+    NumaAllocator() = default;
+
+    // nodes is a bit mask of the nodes for Interleave and Bind; 0 stands for NumaAllowedNodes()
+    explicit NumaAllocator(NumaPolicy policy, uint64_t nodes = 0) noexcept
+        : policy_(policy)
+        , nodes_(nodes != 0 ? nodes : NumaAllowedNodes()) {
+    }
+
+    template <typename U>
+    NumaAllocator(const NumaAllocator<U, Threshold>& other) noexcept
+        : policy_(other.Policy())
+        , nodes_(other.Nodes()) {
+    }
+
+    NumaPolicy Policy() const noexcept {
+        return policy_;
+    }
+
+    uint64_t Nodes() const noexcept {
+        return nodes_;
+    }
+
+    T* allocate(size_t n) {
+        const size_t bytes = detail::AllocationBytes<T>(n);
+        return static_cast<T*>(IsLarge(bytes) ? MapLarge(bytes) : Malloc(bytes));
+    }
+
+    allocation_result allocate_at_least(size_t n) {
+        T* buf = allocate(n);
+        const size_t bytes = n * sizeof(T);
+        return { buf, IsLarge(bytes) ? RoundUp(bytes) / sizeof(T) : n };
+    }
+
+    void deallocate(T* buf, size_t n) noexcept {
+        const size_t bytes = n * sizeof(T);
+        if (IsLarge(bytes)) {
+            munmap(buf, RoundUp(bytes));
+        }
+        else {
+            std::free(buf);
+        }
+    }
+
+    T* reallocate(T* buf, size_t old_n, size_t new_n) {
+        const size_t old_bytes = old_n * sizeof(T);
+        const size_t new_bytes = detail::AllocationBytes<T>(new_n);
+
+        if (!IsLarge(old_bytes) && !IsLarge(new_bytes)) {
+            void* new_buf = std::realloc(static_cast<void*>(buf), new_bytes);
+            if (new_buf == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(new_buf);
+        }
+
+        if (IsLarge(old_bytes) && IsLarge(new_bytes)) {
+            // The policy of a mapping moves with it and covers the pages it grows by
+            void* new_buf = mremap(buf, RoundUp(old_bytes), RoundUp(new_bytes), MREMAP_MAYMOVE);
+            if (new_buf == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(new_buf);
+        }
+
+        T* new_buf = allocate(new_n);
+        std::memcpy(static_cast<void*>(new_buf), static_cast<const void*>(buf), std::min(old_bytes, new_bytes));
+        deallocate(buf, old_n);
+
+        return new_buf;
+    }
+
+    template <typename U>
+    bool operator==(const NumaAllocator<U, Threshold>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const NumaAllocator<U, Threshold>& /*other*/) const noexcept {
+        return false;
+    }
+
+private:
+    NumaPolicy policy_ = NumaPolicy::Local;
+    uint64_t nodes_ = 0;
+
+
+    static size_t PageSize() noexcept {
+        static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    static bool IsLarge(size_t bytes) noexcept {
+        return bytes >= Threshold && bytes != 0;
+    }
+
+    static size_t RoundUp(size_t bytes) noexcept {
+        return (bytes + PageSize() - 1) & ~(PageSize() - 1);
+    }
+
+    static void* Malloc(size_t bytes) {
+        void* buf = std::malloc(bytes);
+        if (buf == nullptr) {
+            throw std::bad_alloc();
+        }
+        return buf;
+    }
+
+    void* MapLarge(size_t bytes) const {
+        const size_t size = RoundUp(bytes);
+        void* buf = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        // The kernel reads one bit less than maxnode says
+        const unsigned long mask = static_cast<unsigned long>(nodes_);
+        switch (policy_) {
+        case NumaPolicy::Local:
+            syscall(SYS_mbind, buf, size, static_cast<unsigned long>(MPOL_LOCAL), nullptr, 0ul, 0ul);
+            break;
+        case NumaPolicy::Interleave:
+            syscall(SYS_mbind, buf, size, static_cast<unsigned long>(MPOL_INTERLEAVE), &mask, 65ul, 0ul);
+            break;
+        case NumaPolicy::Bind:
+            syscall(SYS_mbind, buf, size, static_cast<unsigned long>(MPOL_BIND), &mask, 65ul, 0ul);
+            break;
+        }
+
+        return buf;
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+
+
+
+
+// Bounded channel moving Vector batches between pipeline stages, for any number of producers and consumers.
+// A batch changes hands by moving its buffer, and the channel keeps the buffers consumers give back with
+// Recycle, handing them to producers in exchange for the batches they send. In a steady state no batch is
+// allocated or copied:
+//
+//     Task Produce(BatchChannel<Row>& channel) {
+//         Vector<Row> batch;
+//         while (Fill(batch)) {
+//             co_await channel.Send(std::move(batch));   // batch now holds a recycled, empty buffer
+//         }
+//         channel.Close();
+//     }
+//
+//     Task Consume(BatchChannel<Row>& channel) {
+//         while (auto batch = co_await channel.Receive()) {
+//             Process(*batch);
+//             channel.Recycle(std::move(*batch));
+//         }
+//     }
+//
+// Send suspends while the channel holds capacity batches, Receive while it is empty. A suspended coroutine is
+// resumed by the operation which unblocks it, on that operation's thread and before it returns, so a stage
+// is handed a batch without a context switch when it runs on the same thread
+template <typename T, typename Allocator = std::allocator<T>>
+class BatchChannel {
+public:
+    using Batch = Vector<T, Allocator>;
+
+private:
+    // A suspended Send or Receive, in the FIFO list of its kind
+    struct Waiter {
+        Waiter* next = nullptr;
+        std::coroutine_handle<> handle;
+    };
+
+    struct WaitList {
+        void Push(Waiter* waiter) noexcept {
+            waiter->next = nullptr;
+            (tail != nullptr ? tail->next : head) = waiter;
+            tail = waiter;
+        }
+
+        Waiter* Pop() noexcept {
+            Waiter* waiter = head;
+            if (waiter != nullptr) {
+                head = waiter->next;
+                if (head == nullptr) tail = nullptr;
+            }
+            return waiter;
+        }
+
+        Waiter* head = nullptr;
+        Waiter* tail = nullptr;
+    };
+
+public:
+    class SendAwaiter : Waiter {
+    public:
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            this->handle = handle;
+            return channel_.SuspendSend(*this);
+        }
+
+        // False if the channel was closed, in which case the batch is left with the sender
+        bool await_resume() const noexcept {
+            return sent_;
+        }
+
+    private:
+        friend BatchChannel;
+
+        SendAwaiter(BatchChannel& channel, Batch& batch) noexcept
+            : channel_(channel)
+            , batch_(batch) {
+        }
+
+        BatchChannel& channel_;
+        Batch& batch_;
+        bool sent_ = false;
+    };
+
+    class ReceiveAwaiter : Waiter {
+    public:
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            this->handle = handle;
+            return channel_.SuspendReceive(*this);
+        }
+
+        // Empty once the channel is closed and drained
+        std::optional<Batch> await_resume() noexcept {
+            return std::move(batch_);
+        }
+
+    private:
+        friend BatchChannel;
+
+        explicit ReceiveAwaiter(BatchChannel& channel) noexcept
+            : channel_(channel) {
+        }
+
+        BatchChannel& channel_;
+        std::optional<Batch> batch_;
+    };
+
+
+    // Allocates the queue and the recycling list up front, so neither allocates later
+    explicit BatchChannel(size_t capacity, const Allocator& alloc = Allocator())
+        : alloc_(alloc)
+        , queue_(capacity) {
+        VECTOR_CHECK(capacity != 0);
+        free_.Reserve(capacity);
+    }
+
+    BatchChannel(const BatchChannel&) = delete;
+    BatchChannel& operator=(const BatchChannel&) = delete;
+
+
+    // co_await Send(std::move(batch)) moves the batch into the channel and gives batch a recycled buffer,
+    // or an empty Vector if there is none. The result is false if the channel is closed
+    [[nodiscard]] SendAwaiter Send(Batch&& batch) noexcept {
+        return SendAwaiter(*this, batch);
+    }
+
+    // co_await Receive() gives the next batch, or std::nullopt once the channel is closed and drained
+    [[nodiscard]] ReceiveAwaiter Receive() noexcept {
+        return ReceiveAwaiter(*this);
+    }
+
+    // Doesn't suspend: fails if the channel is full or closed
+    bool TrySend(Batch&& batch) {
+        SendAwaiter sender(*this, batch);
+        std::unique_lock lock(mutex_);
+        if (closed_ || (size_ == queue_.Size() && receivers_.head == nullptr)) return false;
+
+        Complete(sender, lock);
+        return true;
+    }
+
+    std::optional<Batch> TryReceive() {
+        ReceiveAwaiter receiver(*this);
+        std::unique_lock lock(mutex_);
+        if (size_ == 0) return std::nullopt;
+
+        Complete(receiver, lock);
+        return receiver.await_resume();
+    }
+
+    // Takes back a drained buffer for a later Send. Buffers above capacity are freed
+    void Recycle(Batch&& buffer) noexcept {
+        buffer.Clear();
+        if (buffer.Capacity() == 0) return;
+
+        std::lock_guard guard(mutex_);
+        if (free_.Size() < free_.Capacity()) {
+            free_.PushBack(std::move(buffer));
+        }
+    }
+
+    // Fails the suspended and later Sends, and ends Receives once the batches in the channel are taken
+    void Close() {
+        WaitList senders;
+        WaitList receivers;
+        {
+            std::lock_guard guard(mutex_);
+            closed_ = true;
+            std::swap(senders, senders_);
+            std::swap(receivers, receivers_);
+        }
+        // Receivers only wait while the channel is empty, so they all get nothing
+        while (Waiter* waiter = senders.Pop()) {
+            waiter->handle.resume();
+        }
+        while (Waiter* waiter = receivers.Pop()) {
+            waiter->handle.resume();
+        }
+    }
+
+    size_t Size() const {
+        std::lock_guard guard(mutex_);
+        return size_;
+    }
+
+private:
+    [[no_unique_address]] Allocator alloc_;
+    mutable std::mutex mutex_;
+    // A ring of capacity batches, size_ of them from head_ on
+    Vector<Batch> queue_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    Vector<Batch> free_;
+    WaitList senders_;
+    WaitList receivers_;
+    bool closed_ = false;
+
+
+    // Returns whether the coroutine stays suspended
+    bool SuspendSend(SendAwaiter& sender) {
+        std::unique_lock lock(mutex_);
+        if (closed_) return false;
+        if (size_ == queue_.Size() && receivers_.head == nullptr) {
+            senders_.Push(&sender);
+            return true;
+        }
+
+        Complete(sender, lock);
+        return false;
+    }
+
+    bool SuspendReceive(ReceiveAwaiter& receiver) {
+        std::unique_lock lock(mutex_);
+        if (size_ == 0) {
+            if (closed_) return false;
+            receivers_.Push(&receiver);
+            return true;
+        }
+
+        Complete(receiver, lock);
+        return false;
+    }
+
+    // Sends the batch straight to a waiting receiver or into the queue, which has room, then resumes the receiver.
+    // Only moves buffers, so nothing here throws
+    void Complete(SendAwaiter& sender, std::unique_lock<std::mutex>& lock) noexcept {
+        ReceiveAwaiter* receiver = static_cast<ReceiveAwaiter*>(receivers_.Pop());
+        if (receiver != nullptr) {
+            receiver->batch_.emplace(std::move(sender.batch_));
+        }
+        else {
+            queue_[(head_ + size_) % queue_.Size()] = std::move(sender.batch_);
+            ++size_;
+        }
+        sender.batch_ = TakeFree();
+        sender.sent_ = true;
+
+        lock.unlock();
+        if (receiver != nullptr) {
+            receiver->handle.resume();
+        }
+    }
+
+    // Takes the front batch, which lets the first waiting sender put its batch in the queue
+    void Complete(ReceiveAwaiter& receiver, std::unique_lock<std::mutex>& lock) noexcept {
+        receiver.batch_.emplace(std::move(queue_[head_]));
+        head_ = (head_ + 1) % queue_.Size();
+        --size_;
+
+        SendAwaiter* sender = static_cast<SendAwaiter*>(senders_.Pop());
+        if (sender != nullptr) {
+            queue_[(head_ + size_) % queue_.Size()] = std::move(sender->batch_);
+            ++size_;
+            sender->batch_ = TakeFree();
+            sender->sent_ = true;
+        }
+
+        lock.unlock();
+        if (sender != nullptr) {
+            sender->handle.resume();
+        }
+    }
+
+    Batch TakeFree() noexcept {
+        if (free_.Size() == 0) return Batch(alloc_);
+
+        Batch buffer = std::move(free_.Back());
+        free_.PopBack();
+        return buffer;
+    }
+};
@@ -0,0 +1,1102 @@
+#include "vector.h"
+#include "allocators.h"
+#include "parallel.h"
+#include "traversal.h"
+#include "bit_vector.h"
+#include "simd.h"
+#include "concurrent_vector.h"
+#include "soa_vector.h"
+#include "cow_vector.h"
+#include "persistent_vector.h"
+#include "segmented_vector.h"
+#include "expr.h"
+#include "flat_map.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+    // Element with a 64-byte payload and counted copies and moves, so the number of constructor calls
+    // of Vector can be compared with std::vector
+    struct Heavy {
+        Heavy() = default;
+
+        explicit Heavy(int64_t id) {
+            payload[0] = id;
+        }
+
+        Heavy(const Heavy& other)
+            : payload() {
+            std::copy(std::begin(other.payload), std::end(other.payload), payload);
+            ++num_copied;
+        }
+
+        Heavy(Heavy&& other) noexcept
+            : payload() {
+            std::copy(std::begin(other.payload), std::end(other.payload), payload);
+            ++num_moved;
+        }
+
+        Heavy& operator=(const Heavy& other) {
+            std::copy(std::begin(other.payload), std::end(other.payload), payload);
+            ++num_copied;
+            return *this;
+        }
+
+        Heavy& operator=(Heavy&& other) noexcept {
+            std::copy(std::begin(other.payload), std::end(other.payload), payload);
+            ++num_moved;
+            return *this;
+        }
+
+        ~Heavy() {
+        }
+
+        static void ResetCounters() {
+            num_copied = 0;
+            num_moved = 0;
+        }
+
+        int64_t payload[8] = {};
+
+        static inline int64_t num_copied = 0;
+        static inline int64_t num_moved = 0;
+    };
+
+    template <typename T>
+    T MakeValue(size_t i) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            // Longer than the small string buffer, so every string owns a heap block
+            return std::string(32, static_cast<char>('a' + i % 26));
+        }
+        else {
+            return T(static_cast<int64_t>(i));
+        }
+    }
+
+    // Strings and heavy elements stop at 10M to keep the largest runs within a few GB of memory
+    template <typename T>
+    inline constexpr int64_t MAX_SIZE = std::is_trivially_copyable_v<T> ? 100'000'000 : 10'000'000;
+
+    template <typename Container>
+    using ElementOf = std::remove_reference_t<decltype(*std::declval<Container&>().begin())>;
+
+    template <typename Container>
+    void Sizes(benchmark::internal::Benchmark* b) {
+        b->RangeMultiplier(10)->Range(1, MAX_SIZE<ElementOf<Container>>);
+    }
+
+    // 0 for the front, 1 for the middle and 2 for the back of the container
+    template <typename Container>
+    void SizesAndPositions(benchmark::internal::Benchmark* b) {
+        std::vector<int64_t> sizes;
+        for (int64_t size = 1; size <= MAX_SIZE<ElementOf<Container>>; size *= 10) {
+            sizes.push_back(size);
+        }
+        b->ArgsProduct({ sizes, { 0, 1, 2 } })->ArgNames({ "size", "pos" });
+    }
+
+    size_t PositionIndex(const benchmark::State& state, size_t size) {
+        switch (state.range(1)) {
+        case 0:
+            return 0;
+        case 1:
+            return size / 2;
+        default:
+            return size;
+        }
+    }
+
+
+    // The benchmarks are written once against these wrappers over std::vector and Vector
+
+    template <typename T>
+    void PushBack(std::vector<T>& v, const T& value) {
+        v.push_back(value);
+    }
+    template <typename T, typename... Params>
+    void PushBack(Vector<T, Params...>& v, const T& value) {
+        v.PushBack(value);
+    }
+
+    template <typename T>
+    void EmplaceBack(std::vector<T>& v, size_t i) {
+        v.emplace_back(MakeValue<T>(i));
+    }
+    template <typename T, typename... Params>
+    void EmplaceBack(Vector<T, Params...>& v, size_t i) {
+        v.EmplaceBack(MakeValue<T>(i));
+    }
+
+    template <typename T>
+    void EmplaceAt(std::vector<T>& v, size_t index, const T& value) {
+        v.emplace(v.begin() + index, value);
+    }
+    template <typename T, typename... Params>
+    void EmplaceAt(Vector<T, Params...>& v, size_t index, const T& value) {
+        v.Emplace(v.cbegin() + index, value);
+    }
+
+    template <typename T>
+    void EraseAt(std::vector<T>& v, size_t index) {
+        v.erase(v.begin() + index);
+    }
+    template <typename T, typename... Params>
+    void EraseAt(Vector<T, Params...>& v, size_t index) {
+        v.Erase(v.cbegin() + index);
+    }
+
+    template <typename T>
+    void PopBack(std::vector<T>& v) {
+        v.pop_back();
+    }
+    template <typename T, typename... Params>
+    void PopBack(Vector<T, Params...>& v) {
+        v.PopBack();
+    }
+
+    template <typename T>
+    void Reserve(std::vector<T>& v, size_t capacity) {
+        v.reserve(capacity);
+    }
+    template <typename T, typename... Params>
+    void Reserve(Vector<T, Params...>& v, size_t capacity) {
+        v.Reserve(capacity);
+    }
+
+    template <typename T>
+    void Resize(std::vector<T>& v, size_t size) {
+        v.resize(size);
+    }
+    template <typename T, typename... Params>
+    void Resize(Vector<T, Params...>& v, size_t size) {
+        v.Resize(size);
+    }
+
+    template <typename Container>
+    Container MakeFilled(size_t size) {
+        using T = ElementOf<Container>;
+
+        Container v;
+        Reserve(v, size);
+        for (size_t i = 0; i < size; ++i) {
+            PushBack(v, MakeValue<T>(i));
+        }
+        return v;
+    }
+
+    template <typename Container>
+    void ReportItems(benchmark::State& state, int64_t items_per_iteration) {
+        using T = ElementOf<Container>;
+
+        state.SetItemsProcessed(state.iterations() * items_per_iteration);
+        state.SetBytesProcessed(state.iterations() * items_per_iteration * static_cast<int64_t>(sizeof(T)));
+    }
+
+    // Reports copies and moves of Heavy per processed item
+    template <typename Container>
+    void ReportConstructions(benchmark::State& state, int64_t items_per_iteration) {
+        if constexpr (std::is_same_v<ElementOf<Container>, Heavy>) {
+            const double items = static_cast<double>(state.iterations() * items_per_iteration);
+            state.counters["copies_per_item"] = static_cast<double>(Heavy::num_copied) / items;
+            state.counters["moves_per_item"] = static_cast<double>(Heavy::num_moved) / items;
+        }
+    }
+}
+
+
+template <typename Container>
+void BM_PushBack(benchmark::State& state) {
+    using T = ElementOf<Container>;
+    const size_t size = state.range(0);
+    const T value = MakeValue<T>(0);
+
+    Heavy::ResetCounters();
+    for (auto _ : state) {
+        Container v;
+        for (size_t i = 0; i < size; ++i) {
+            PushBack(v, value);
+        }
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+    ReportConstructions<Container>(state, size);
+}
+
+template <typename Container>
+void BM_EmplaceBack(benchmark::State& state) {
+    const size_t size = state.range(0);
+
+    Heavy::ResetCounters();
+    for (auto _ : state) {
+        Container v;
+        for (size_t i = 0; i < size; ++i) {
+            EmplaceBack(v, i);
+        }
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+    ReportConstructions<Container>(state, size);
+}
+
+template <typename Container>
+void BM_ReserveAndPushBack(benchmark::State& state) {
+    using T = ElementOf<Container>;
+    const size_t size = state.range(0);
+    const T value = MakeValue<T>(0);
+
+    Heavy::ResetCounters();
+    for (auto _ : state) {
+        Container v;
+        Reserve(v, size);
+        for (size_t i = 0; i < size; ++i) {
+            PushBack(v, value);
+        }
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+    ReportConstructions<Container>(state, size);
+}
+
+template <typename Container>
+void BM_Resize(benchmark::State& state) {
+    const size_t size = state.range(0);
+
+    for (auto _ : state) {
+        Container v;
+        Resize(v, size);
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+}
+
+// Each iteration emplaces an element at the position and pops the back to keep the size
+template <typename Container>
+void BM_EmplaceAt(benchmark::State& state) {
+    using T = ElementOf<Container>;
+    const size_t size = state.range(0);
+    const T value = MakeValue<T>(size);
+
+    Container v = MakeFilled<Container>(size);
+    Reserve(v, size + 1);
+    const size_t index = PositionIndex(state, size);
+
+    for (auto _ : state) {
+        EmplaceAt(v, index, value);
+        PopBack(v);
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, 1);
+}
+
+// Each iteration erases the element at the position and pushes one back to keep the size
+template <typename Container>
+void BM_EraseAt(benchmark::State& state) {
+    using T = ElementOf<Container>;
+    const size_t size = state.range(0);
+    const T value = MakeValue<T>(size);
+
+    Container v = MakeFilled<Container>(size);
+    const size_t index = std::min(PositionIndex(state, size), size - 1);
+
+    for (auto _ : state) {
+        EraseAt(v, index);
+        PushBack(v, value);
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, 1);
+}
+
+template <typename Container>
+void BM_CopyConstruct(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const Container source = MakeFilled<Container>(size);
+
+    for (auto _ : state) {
+        Container v(source);
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+}
+
+template <typename Container>
+void BM_CopyAssign(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const Container source = MakeFilled<Container>(size);
+
+    Container v;
+    for (auto _ : state) {
+        v = source;
+        benchmark::DoNotOptimize(v.begin());
+        benchmark::ClobberMemory();
+    }
+
+    ReportItems<Container>(state, size);
+}
+
+template <typename Container>
+void BM_MoveAssign(benchmark::State& state) {
+    const size_t size = state.range(0);
+
+    Container v = MakeFilled<Container>(size);
+    Container other;
+    for (auto _ : state) {
+        other = std::move(v);
+        v = std::move(other);
+        benchmark::DoNotOptimize(v.begin());
+    }
+
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+
+template <typename Container>
+void BM_Iterate(benchmark::State& state) {
+    using T = ElementOf<Container>;
+    const size_t size = state.range(0);
+    const Container v = MakeFilled<Container>(size);
+
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (const T& value : v) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                sum += static_cast<int64_t>(value.size());
+            }
+            else if constexpr (std::is_same_v<T, Heavy>) {
+                sum += value.payload[0];
+            }
+            else {
+                sum += value;
+            }
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    ReportItems<Container>(state, size);
+}
+
+
+#define VECTOR_BENCHMARK(Bench, Container, Args) BENCHMARK_TEMPLATE(Bench, Container)->Apply(Args<Container>)
+
+#define VECTOR_BENCHMARK_TYPE(Bench, T, Args)    \
+    VECTOR_BENCHMARK(Bench, std::vector<T>, Args); \
+    VECTOR_BENCHMARK(Bench, Vector<T>, Args)
+
+#define VECTOR_BENCHMARK_ALL(Bench, Args)           \
+    VECTOR_BENCHMARK_TYPE(Bench, int, Args);         \
+    VECTOR_BENCHMARK_TYPE(Bench, std::string, Args); \
+    VECTOR_BENCHMARK_TYPE(Bench, Heavy, Args)
+
+VECTOR_BENCHMARK_ALL(BM_PushBack, Sizes);
+VECTOR_BENCHMARK_ALL(BM_EmplaceBack, Sizes);
+VECTOR_BENCHMARK_ALL(BM_ReserveAndPushBack, Sizes);
+VECTOR_BENCHMARK_ALL(BM_Resize, Sizes);
+VECTOR_BENCHMARK_ALL(BM_EmplaceAt, SizesAndPositions);
+VECTOR_BENCHMARK_ALL(BM_EraseAt, SizesAndPositions);
+VECTOR_BENCHMARK_ALL(BM_CopyConstruct, Sizes);
+VECTOR_BENCHMARK_ALL(BM_CopyAssign, Sizes);
+VECTOR_BENCHMARK_ALL(BM_MoveAssign, Sizes);
+VECTOR_BENCHMARK_ALL(BM_Iterate, Sizes);
+
+
+// Growth policies, in-place reallocation and huge pages against the default Vector<int>
+using VectorOneAndHalf = Vector<int, std::allocator<int>, OneAndHalfGrowth>;
+using VectorGoldenRatio = Vector<int, std::allocator<int>, GoldenRatioGrowth>;
+using VectorMinBytes = Vector<int, std::allocator<int>, MinBytesGrowth<>>;
+using VectorMalloc = Vector<int, MallocAllocator<int>>;
+using VectorHugePages = Vector<int, HugePageAllocator<int>>;
+
+VECTOR_BENCHMARK(BM_PushBack, VectorOneAndHalf, Sizes);
+VECTOR_BENCHMARK(BM_PushBack, VectorGoldenRatio, Sizes);
+VECTOR_BENCHMARK(BM_PushBack, VectorMinBytes, Sizes);
+VECTOR_BENCHMARK(BM_PushBack, VectorMalloc, Sizes);
+VECTOR_BENCHMARK(BM_PushBack, VectorHugePages, Sizes);
+VECTOR_BENCHMARK(BM_Iterate, VectorHugePages, Sizes);
+
+
+
+// Serial loops against parallel.h on the default thread pool
+void BM_Reduce(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::accumulate(v.begin(), v.end(), int64_t{ 0 }));
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+void BM_ParallelReduce(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParallelReduce(v, int64_t{ 0 }));
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+void BM_Sort(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto source = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Vector<int> v(source);
+        std::reverse(v.begin(), v.end());
+        state.ResumeTiming();
+
+        std::sort(v.begin(), v.end());
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+void BM_ParallelSort(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto source = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Vector<int> v(source);
+        std::reverse(v.begin(), v.end());
+        state.ResumeTiming();
+
+        ParallelSort(v);
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+// Plain loops against the simd.h kernels; the argument is the simd::Isa
+void BM_SumFloat(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<float>>(size);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::accumulate(v.begin(), v.end(), 0.0f));
+    }
+    ReportItems<Vector<float>>(state, size);
+}
+
+void BM_SimdSumFloat(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<float>>(size);
+
+    const auto isa = static_cast<simd::Isa>(state.range(1));
+    if (!simd::IsSupported(isa)) {
+        state.SkipWithError("The CPU doesn't support the instruction set");
+        return;
+    }
+    simd::SetIsa(isa);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simd::Sum(v));
+    }
+    ReportItems<Vector<float>>(state, size);
+    simd::SetIsa(simd::DetectIsa());
+}
+
+void BM_CountInt(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(std::count(v.begin(), v.end(), 42));
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+void BM_SimdCountInt(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(simd::Count(v, 42));
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+BENCHMARK(BM_SumFloat)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_SimdSumFloat)
+    ->ArgsProduct({ { 100, 10'000, 1'000'000, 10'000'000 },
+                    { static_cast<int64_t>(simd::Isa::Scalar), static_cast<int64_t>(simd::Isa::Sse42),
+                      static_cast<int64_t>(simd::Isa::Avx2), static_cast<int64_t>(simd::Isa::Avx512) } })
+    ->ArgNames({ "size", "isa" });
+BENCHMARK(BM_CountInt)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_SimdCountInt)->RangeMultiplier(100)->Range(100, 10'000'000);
+
+BENCHMARK(BM_Reduce)->Apply(Sizes<Vector<int>>);
+BENCHMARK(BM_ParallelReduce)->Apply(Sizes<Vector<int>>);
+BENCHMARK(BM_Sort)->RangeMultiplier(10)->Range(1000, 10'000'000);
+BENCHMARK(BM_ParallelSort)->RangeMultiplier(10)->Range(1000, 10'000'000);
+
+
+
+// Appends from several threads: a Vector behind a mutex against ConcurrentVector.
+// Thread 0 creates the container before the threads start their loops and frees it after they end
+void BM_MutexPushBack(benchmark::State& state) {
+    static std::unique_ptr<Vector<int>> v;
+    static std::mutex mutex;
+    if (state.thread_index() == 0) {
+        v = std::make_unique<Vector<int>>();
+    }
+
+    for (auto _ : state) {
+        std::lock_guard guard(mutex);
+        v->PushBack(static_cast<int>(state.iterations()));
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        v.reset();
+    }
+}
+
+void BM_ConcurrentPushBack(benchmark::State& state) {
+    static std::unique_ptr<ConcurrentVector<int>> v;
+    if (state.thread_index() == 0) {
+        v = std::make_unique<ConcurrentVector<int>>();
+    }
+
+    for (auto _ : state) {
+        v->PushBack(static_cast<int>(state.iterations()));
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        v.reset();
+    }
+}
+
+BENCHMARK(BM_MutexPushBack)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_ConcurrentPushBack)->ThreadRange(1, 8)->UseRealTime();
+
+
+// Position update touching 2 of the 9 fields of a particle: an array of structures against SoAVector
+struct Particle {
+    float x, y, z;
+    float vx, vy, vz;
+    float mass;
+    int32_t id;
+    int32_t flags;
+};
+
+void BM_AosStep(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Vector<Particle> particles(size);
+    for (size_t i = 0; i < size; ++i) {
+        particles[i].vx = static_cast<float>(i % 7);
+    }
+
+    for (auto _ : state) {
+        for (Particle& p : particles) {
+            p.x += p.vx;
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+void BM_SoaStep(benchmark::State& state) {
+    const size_t size = state.range(0);
+    SoAVector<float, float, float, float, float, float, float, int32_t, int32_t> particles(size);
+    std::span<float> vx = particles.Column<3>();
+    for (size_t i = 0; i < size; ++i) {
+        vx[i] = static_cast<float>(i % 7);
+    }
+
+    for (auto _ : state) {
+        std::span<float> x = particles.Column<0>();
+        for (size_t i = 0; i < size; ++i) {
+            x[i] += vx[i];
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_AosStep)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_SoaStep)->RangeMultiplier(100)->Range(100, 10'000'000);
+
+
+// Element access through the checked paths. Build with -DVECTOR_HARDENING_MODE=1 and compare with the default build
+// to see what the checks cost; the label tells the mode a run was built with
+void BM_IndexedSum(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < v.Size(); ++i) {
+            sum += v[i];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportItems<Vector<int>>(state, size);
+    state.SetLabel("hardening=" + std::to_string(VECTOR_HARDENING_MODE));
+}
+
+// Indices unknown to the compiler, so the checks can't be hoisted out of the loop
+void BM_GatherSum(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    Vector<uint32_t> indices(size);
+    for (size_t i = 0; i < size; ++i) {
+        indices[i] = static_cast<uint32_t>(i * 2654435761u % size);
+    }
+
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (uint32_t index : indices) {
+            sum += v[index];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportItems<Vector<int>>(state, size);
+    state.SetLabel("hardening=" + std::to_string(VECTOR_HARDENING_MODE));
+}
+
+void BM_AtSum(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto v = MakeFilled<Vector<int>>(size);
+
+    for (auto _ : state) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < v.Size(); ++i) {
+            sum += v.At(i);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+BENCHMARK(BM_IndexedSum)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_GatherSum)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_AtSum)->RangeMultiplier(100)->Range(100, 10'000'000);
+
+
+// Handing the same elements to 16 readers, which copy a Vector each time and share a CowVector
+template <typename V>
+void BM_FanOut(benchmark::State& state) {
+    const size_t size = state.range(0);
+    V v;
+    for (size_t i = 0; i < size; ++i) {
+        v.PushBack(static_cast<int>(i));
+    }
+
+    for (auto _ : state) {
+        for (int reader = 0; reader < 16; ++reader) {
+            const V copy = v;
+            benchmark::DoNotOptimize(copy[size / 2]);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 16);
+}
+
+BENCHMARK(BM_FanOut<Vector<int>>)->RangeMultiplier(100)->Range(100, 1'000'000);
+BENCHMARK(BM_FanOut<CowVector<int>>)->RangeMultiplier(100)->Range(100, 1'000'000);
+
+
+// Keeping a revision per change: a full copy of a Vector against a copy of a PersistentVector and a Set
+void BM_VectorRevision(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Vector<int> v = MakeFilled<Vector<int>>(size);
+    size_t index = 0;
+
+    for (auto _ : state) {
+        Vector<int> revision = v;
+        revision[index] = 0;
+        benchmark::DoNotOptimize(revision.Data());
+        index = (index + 4099) % size;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_PersistentRevision(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const PersistentVector<int> v(MakeFilled<Vector<int>>(size));
+    size_t index = 0;
+
+    for (auto _ : state) {
+        PersistentVector<int> revision = v;
+        revision.Set(index, 0);
+        benchmark::DoNotOptimize(revision[index]);
+        index = (index + 4099) % size;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_VectorRevision)->RangeMultiplier(100)->Range(100, 1'000'000);
+BENCHMARK(BM_PersistentRevision)->RangeMultiplier(100)->Range(100, 1'000'000);
+
+
+// Growth pauses: the longest single PushBack while filling the container, which for Vector includes relocating
+// all the elements and for SegmentedVector at most allocating a block and doubling the index table
+template <typename Container>
+void BM_PushBackPause(benchmark::State& state) {
+    const size_t size = state.range(0);
+    double longest = 0;
+
+    for (auto _ : state) {
+        Container v;
+        for (size_t i = 0; i < size; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            v.PushBack(static_cast<int>(i));
+            longest = std::max(longest, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        benchmark::DoNotOptimize(v[size / 2]);
+    }
+    state.counters["longest_push_us"] = longest;
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <typename Container>
+void BM_SegmentSum(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Container v;
+    for (size_t i = 0; i < size; ++i) {
+        v.PushBack(static_cast<int>(i));
+    }
+
+    for (auto _ : state) {
+        int sum = 0;
+        if constexpr (std::is_same_v<Container, Vector<int>>) {
+            for (int value : v) {
+                sum += value;
+            }
+        }
+        else {
+            v.ForEachSegment([&sum](std::span<const int> segment) {
+                for (int value : segment) {
+                    sum += value;
+                }
+            });
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportItems<Vector<int>>(state, size);
+}
+
+BENCHMARK(BM_PushBackPause<Vector<int>>)->RangeMultiplier(100)->Range(10'000, 10'000'000)->Iterations(3);
+BENCHMARK(BM_PushBackPause<SegmentedVector<int>>)->RangeMultiplier(100)->Range(10'000, 10'000'000)->Iterations(3);
+BENCHMARK(BM_SegmentSum<Vector<int>>)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_SegmentSum<SegmentedVector<int>>)->RangeMultiplier(100)->Range(100, 10'000'000);
+
+
+// r = a + b * c - 1 over doubles: a fused expression against the loops of temporary vectors it replaces
+void BM_ExprFused(benchmark::State& state) {
+    using namespace expr;
+    const size_t size = state.range(0);
+    const auto a = MakeFilled<Vector<double>>(size);
+    const auto b = MakeFilled<Vector<double>>(size);
+    const auto c = MakeFilled<Vector<double>>(size);
+    Vector<double> r;
+
+    for (auto _ : state) {
+        Assign(r, a + b * c - 1.0);
+        benchmark::DoNotOptimize(r.Data());
+    }
+    ReportItems<Vector<double>>(state, size);
+}
+
+void BM_ExprTemporaries(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto a = MakeFilled<Vector<double>>(size);
+    const auto b = MakeFilled<Vector<double>>(size);
+    const auto c = MakeFilled<Vector<double>>(size);
+
+    for (auto _ : state) {
+        Vector<double> product(size);
+        for (size_t i = 0; i < size; ++i) {
+            product[i] = b[i] * c[i];
+        }
+        Vector<double> sum(size);
+        for (size_t i = 0; i < size; ++i) {
+            sum[i] = a[i] + product[i];
+        }
+        Vector<double> r(size);
+        for (size_t i = 0; i < size; ++i) {
+            r[i] = sum[i] - 1.0;
+        }
+        benchmark::DoNotOptimize(r.Data());
+    }
+    ReportItems<Vector<double>>(state, size);
+}
+
+BENCHMARK(BM_ExprFused)->RangeMultiplier(100)->Range(100, 10'000'000);
+BENCHMARK(BM_ExprTemporaries)->RangeMultiplier(100)->Range(100, 10'000'000);
+
+
+// Lookups of random keys in a table of int keys and values, built once
+template <typename Map>
+void BM_MapFind(benchmark::State& state) {
+    const size_t size = state.range(0);
+    std::mt19937 random(1);
+    Vector<int> keys;
+    for (size_t i = 0; i < size; ++i) {
+        keys.PushBack(static_cast<int>(random()));
+    }
+
+    Map map;
+    if constexpr (std::is_same_v<Map, std::map<int, int>>) {
+        for (int key : keys) {
+            map.emplace(key, key);
+        }
+    }
+    else {
+        Vector<std::pair<int, int>> items;
+        for (int key : keys) {
+            items.PushBack({ key, key });
+        }
+        map = Map(std::move(items));
+    }
+
+    size_t next = 0;
+    for (auto _ : state) {
+        const int key = keys[next];
+        next = next + 1 == size ? 0 : next + 1;
+        benchmark::DoNotOptimize(map.find(key));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <typename Search>
+struct FlatIntMap : FlatMap<int, int, std::less<int>, Search> {
+    using FlatMap<int, int, std::less<int>, Search>::FlatMap;
+
+    auto find(int key) const {
+        return this->Find(key);
+    }
+};
+
+BENCHMARK(BM_MapFind<std::map<int, int>>)->RangeMultiplier(32)->Range(1024, 1 << 20);
+BENCHMARK(BM_MapFind<FlatIntMap<BinarySearch>>)->RangeMultiplier(32)->Range(1024, 1 << 20);
+BENCHMARK(BM_MapFind<FlatIntMap<BranchlessSearch>>)->RangeMultiplier(32)->Range(1024, 1 << 20);
+BENCHMARK(BM_MapFind<FlatIntMap<EytzingerSearch>>)->RangeMultiplier(32)->Range(1024, 1 << 20);
+
+
+// Parallel scans of a vector of 2^27 ints whose pages were placed in different ways; the argument is the way.
+// 0: value-initialized by one thread, so all the pages are on its node. 1: first touch by the workers which
+// scan them, with a static schedule. 2: interleaved over the nodes. On a single-node machine all three match
+void BM_NumaScan(benchmark::State& state) {
+    using Allocator = NumaAllocator<int>;
+    const size_t size = size_t{ 1 } << 27;
+    ParallelOptions options;
+    options.grain_size = size_t{ 1 } << 18;
+    options.static_schedule = true;
+
+    Vector<int, Allocator> v;
+    switch (state.range(0)) {
+    case 0:
+        v.Resize(size);
+        break;
+    case 1:
+        v = ParallelVector<int, Allocator>(size, options, Allocator(NumaPolicy::Local));
+        break;
+    case 2:
+        v = ParallelVector<int, Allocator>(size, options, Allocator(NumaPolicy::Interleave));
+        break;
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ParallelReduce(v, int64_t{ 0 }, std::plus<>(), options));
+    }
+    state.SetBytesProcessed(state.iterations() * size * sizeof(int));
+}
+
+BENCHMARK(BM_NumaScan)->DenseRange(0, 2)->UseRealTime();
+
+
+// traversal.h against plain loops, over vectors larger than the last level cache of the machines tried
+
+struct Record {
+    int64_t key;
+    int64_t fields[7];
+};
+
+// Hashes 2^20 records picked at random out of 2^21 (128 MiB); the argument is the prefetch distance
+template <bool Prefetch>
+void BM_RecordGather(benchmark::State& state) {
+    const size_t size = size_t{ 1 } << 21;
+    Vector<Record> records(size);
+    for (size_t i = 0; i < size; ++i) {
+        records[i].key = static_cast<int64_t>(i);
+    }
+
+    std::mt19937 random(1);
+    Vector<uint32_t> indices;
+    for (size_t i = 0; i < size / 2; ++i) {
+        indices.PushBack(static_cast<uint32_t>(random() % size));
+    }
+
+    auto hash = [](uint64_t& h, const Record& record) {
+        h = (h ^ static_cast<uint64_t>(record.key)) * 0x9E3779B97F4A7C15u;
+        for (int64_t field : record.fields) {
+            h = (h ^ static_cast<uint64_t>(field)) * 0x9E3779B97F4A7C15u;
+        }
+    };
+
+    for (auto _ : state) {
+        uint64_t h = 0;
+        if constexpr (Prefetch) {
+            ForEachPrefetched(records, indices, [&](const Record& record) {
+                hash(h, record);
+            }, state.range(0));
+        }
+        else {
+            for (uint32_t index : indices) {
+                hash(h, records[index]);
+            }
+        }
+        benchmark::DoNotOptimize(h);
+    }
+    state.SetItemsProcessed(state.iterations() * indices.Size());
+}
+
+// Two vectorized passes over 2^26 floats (256 MiB), over the whole vector or block by block; the argument
+// is the block size in bytes
+template <bool Blocked>
+void BM_TwoPasses(benchmark::State& state) {
+    Vector<float> v(size_t{ 1 } << 26);
+
+    auto passes = [](std::span<float> range) {
+        simd::Add(range, range, range);
+        simd::Mul(range, range, range);
+    };
+
+    for (auto _ : state) {
+        if constexpr (Blocked) {
+            ForEachBlock(v, passes, state.range(0));
+        }
+        else {
+            passes(v);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * v.Size() * sizeof(float));
+}
+
+// Fills and copies of 2^26 ints (256 MiB) with ordinary and non-temporal stores
+template <bool Stream>
+void BM_LargeFill(benchmark::State& state) {
+    Vector<int> v;
+    v.ResizeUninitialized(size_t{ 1 } << 26);
+
+    for (auto _ : state) {
+        if constexpr (Stream) {
+            StreamFill(v, 1);
+        }
+        else {
+            std::fill(v.Data(), v.Data() + v.Size(), 1);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * v.Size() * sizeof(int));
+}
+
+template <bool Stream>
+void BM_LargeCopy(benchmark::State& state) {
+    const auto source = MakeFilled<Vector<int>>(size_t{ 1 } << 26);
+    Vector<int> v;
+    v.ResizeUninitialized(source.Size());
+
+    for (auto _ : state) {
+        if constexpr (Stream) {
+            StreamCopy(source, v);
+        }
+        else {
+            std::memcpy(v.Data(), source.Data(), source.Size() * sizeof(int));
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * v.Size() * sizeof(int));
+}
+
+BENCHMARK(BM_RecordGather<false>);
+BENCHMARK(BM_RecordGather<true>)->Arg(4)->Arg(16)->Arg(64);
+BENCHMARK(BM_TwoPasses<false>);
+BENCHMARK(BM_TwoPasses<true>)->Arg(16 << 10)->Arg(256 << 10);
+BENCHMARK(BM_LargeFill<false>);
+BENCHMARK(BM_LargeFill<true>);
+BENCHMARK(BM_LargeCopy<false>);
+BENCHMARK(BM_LargeCopy<true>);
+
+
+// Filter bitmaps as a Vector<bool> of bytes and as a BitVector: counting the set flags, and combining two filters
+template <typename Flags>
+Flags MakeFlags(size_t size, unsigned seed) {
+    std::mt19937 random(seed);
+    Flags flags;
+    flags.Reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        flags.PushBack(random() % 4 == 0);
+    }
+    return flags;
+}
+
+template <typename Flags>
+void BM_FlagCount(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const Flags flags = MakeFlags<Flags>(size, 1);
+
+    for (auto _ : state) {
+        if constexpr (std::is_same_v<Flags, BitVector>) {
+            benchmark::DoNotOptimize(flags.Count());
+        }
+        else {
+            benchmark::DoNotOptimize(std::count(flags.Data(), flags.Data() + size, true));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <typename Flags>
+void BM_FlagAnd(benchmark::State& state) {
+    const size_t size = state.range(0);
+    Flags flags = MakeFlags<Flags>(size, 1);
+    const Flags other = MakeFlags<Flags>(size, 2);
+
+    for (auto _ : state) {
+        if constexpr (std::is_same_v<Flags, BitVector>) {
+            flags &= other;
+        }
+        else {
+            for (size_t i = 0; i < size; ++i) {
+                flags[i] = flags[i] && other[i];
+            }
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_FlagCount<Vector<bool>>)->RangeMultiplier(64)->Range(1 << 12, 1 << 24);
+BENCHMARK(BM_FlagCount<BitVector>)->RangeMultiplier(64)->Range(1 << 12, 1 << 24);
+BENCHMARK(BM_FlagAnd<Vector<bool>>)->RangeMultiplier(64)->Range(1 << 12, 1 << 24);
+BENCHMARK(BM_FlagAnd<BitVector>)->RangeMultiplier(64)->Range(1 << 12, 1 << 24);
+
+
+BENCHMARK_MAIN();
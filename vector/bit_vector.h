@@ -0,0 +1,441 @@
+#pragma once
+
+
+#include "vector.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+
+
+
+
+namespace detail {
+    // The position of the set bit of word with rank set bits below it, which must exist
+    inline size_t SelectInWord(uint64_t word, size_t rank) noexcept {
+#if defined(__BMI2__)
+        return static_cast<size_t>(std::countr_zero(_pdep_u64(uint64_t{ 1 } << rank, word)));
+#else
+        for (; rank != 0; --rank) {
+            word &= word - 1;
+        }
+        return static_cast<size_t>(std::countr_zero(word));
+#endif
+    }
+}
+
+
+// Vector of bits packed into 64-bit words of a RawMemory, an eighth of the memory of a Vector<bool> or of a
+// Vector<uint8_t> used as flags. Element access goes through a Reference proxy, as for std::vector<bool>.
+// The bulk operations work on whole words with the simd.h kernels: &=, |=, ^= and Flip() combine or invert
+// every bit, Count() counts the set ones. Rank and Select, which map between positions and counts of set
+// bits, scan the words; BitRankIndex answers them without the scan for bits that don't change.
+// This is a class of its own rather than a Vector<bool> specialization, which would stop Vector<bool>
+// from being a contiguous range of bool as simd::Compact takes it.
+// The bits past the size in the last word are always zero, so the bulk operations needn't mask them
+template <typename Allocator = std::allocator<uint64_t>>
+class BasicBitVector {
+    using Storage = RawMemory<uint64_t, Allocator>;
+
+public:
+    static constexpr size_t kWordBits = 64;
+
+    using allocator_type = Allocator;
+
+    class Reference {
+    public:
+        Reference(const Reference&) = default;
+
+        operator bool() const noexcept {
+            return (*word_ & mask_) != 0;
+        }
+
+        Reference& operator=(bool value) noexcept {
+            *word_ = value ? *word_ | mask_ : *word_ & ~mask_;
+            return *this;
+        }
+
+        Reference& operator=(const Reference& rhs) noexcept {
+            return *this = static_cast<bool>(rhs);
+        }
+
+        void Flip() noexcept {
+            *word_ ^= mask_;
+        }
+
+    private:
+        friend BasicBitVector;
+
+        Reference(uint64_t* word, uint64_t mask) noexcept
+            : word_(word)
+            , mask_(mask) {
+        }
+
+        uint64_t* word_;
+        uint64_t mask_;
+    };
+
+
+    BasicBitVector() = default;
+
+    explicit BasicBitVector(const Allocator& alloc) noexcept
+        : words_(alloc) {
+    }
+
+    // size cleared bits
+    explicit BasicBitVector(size_t size, const Allocator& alloc = Allocator())
+        : words_(WordCount(size), alloc)
+        , size_(size) {
+        std::fill_n(words_.GetAddress(), WordCount(size), uint64_t{ 0 });
+    }
+
+    BasicBitVector(const BasicBitVector& other)
+        : words_(WordCount(other.size_),
+                 std::allocator_traits<Allocator>::select_on_container_copy_construction(other.words_.GetAllocator()))
+        , size_(other.size_) {
+        CopyWords(other.words_.GetAddress(), WordCount(size_), words_.GetAddress());
+    }
+
+    BasicBitVector(BasicBitVector&& other) noexcept
+        : words_(std::move(other.words_))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    BasicBitVector& operator=(const BasicBitVector& rhs) {
+        if (this != &rhs) {
+            BasicBitVector copy(rhs);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    BasicBitVector& operator=(BasicBitVector&& rhs) noexcept {
+        if (this != &rhs) {
+            words_ = std::move(rhs.words_);
+            size_ = std::exchange(rhs.size_, 0);
+        }
+        return *this;
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    // In bits
+    size_t Capacity() const noexcept {
+        return words_.Capacity() * kWordBits;
+    }
+
+    Allocator GetAllocator() const noexcept {
+        return words_.GetAllocator();
+    }
+
+    // Bit i is bit i % 64 of word i / 64
+    std::span<const uint64_t> Words() const noexcept {
+        return { words_.GetAddress(), WordCount(size_) };
+    }
+
+    bool operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return (words_[index / kWordBits] >> (index % kWordBits) & 1) != 0;
+    }
+
+    Reference operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
+        return Reference(words_ + index / kWordBits, uint64_t{ 1 } << (index % kWordBits));
+    }
+
+    // Checks the index in every build and hardening mode
+    bool At(size_t index) const {
+        if (index >= size_) {
+            throw std::out_of_range("BitVector index out of range");
+        }
+        return (*this)[index];
+    }
+
+    Reference At(size_t index) {
+        static_cast<void>(std::as_const(*this).At(index));
+        return (*this)[index];
+    }
+
+
+    void Reserve(size_t new_capacity) {
+        if (new_capacity <= Capacity()) return;
+
+        ReallocateTo(WordCount(new_capacity));
+    }
+
+    // New bits are value
+    void Resize(size_t new_size, bool value = false) {
+        if (new_size <= size_) {
+            size_ = new_size;
+            ClearTail();
+            return;
+        }
+
+        const size_t old_words = WordCount(size_);
+        const size_t new_words = WordCount(new_size);
+        if (new_size > Capacity()) {
+            ReallocateTo(DoublingGrowth::NextCapacity(words_.Capacity(), new_words, sizeof(uint64_t)));
+        }
+
+        const uint64_t fill = value ? ~uint64_t{ 0 } : 0;
+        if (value && size_ % kWordBits != 0) {
+            words_[old_words - 1] |= fill << (size_ % kWordBits);
+        }
+        std::fill(words_ + old_words, words_ + new_words, fill);
+
+        size_ = new_size;
+        ClearTail();
+    }
+
+    void PushBack(bool value) {
+        if (size_ % kWordBits == 0) {
+            if (size_ == Capacity()) {
+                ReallocateTo(DoublingGrowth::NextCapacity(words_.Capacity(), words_.Capacity() + 1, sizeof(uint64_t)));
+            }
+            words_[size_ / kWordBits] = 0;
+        }
+        words_[size_ / kWordBits] |= uint64_t{ value } << (size_ % kWordBits);
+        ++size_;
+    }
+
+    void PopBack() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        --size_;
+        words_[size_ / kWordBits] &= ~(uint64_t{ 1 } << (size_ % kWordBits));
+    }
+
+    // Keeps the capacity
+    void Clear() noexcept {
+        size_ = 0;
+    }
+
+    void Swap(BasicBitVector& other) noexcept {
+        words_.Swap(other.words_);
+        std::swap(size_, other.size_);
+    }
+
+
+    // The bulk operations take vectors of the same size
+    BasicBitVector& operator&=(const BasicBitVector& rhs) noexcept {
+        VECTOR_CHECK(size_ == rhs.size_);
+        simd::And(Words(), rhs.Words(), MutableWords());
+        return *this;
+    }
+
+    BasicBitVector& operator|=(const BasicBitVector& rhs) noexcept {
+        VECTOR_CHECK(size_ == rhs.size_);
+        simd::Or(Words(), rhs.Words(), MutableWords());
+        return *this;
+    }
+
+    BasicBitVector& operator^=(const BasicBitVector& rhs) noexcept {
+        VECTOR_CHECK(size_ == rhs.size_);
+        simd::Xor(Words(), rhs.Words(), MutableWords());
+        return *this;
+    }
+
+    // Inverts every bit
+    void Flip() noexcept {
+        simd::Not(Words(), MutableWords());
+        ClearTail();
+    }
+
+    // The number of set bits
+    size_t Count() const noexcept {
+        return simd::PopCount(Words());
+    }
+
+    // The position of the first set bit at or after from, or Size() if there is none
+    size_t FindFirst(size_t from = 0) const noexcept {
+        if (from >= size_) return size_;
+
+        const size_t words = WordCount(size_);
+        size_t index = from / kWordBits;
+        uint64_t word = words_[index] & (~uint64_t{ 0 } << (from % kWordBits));
+        while (word == 0) {
+            if (++index == words) return size_;
+            word = words_[index];
+        }
+        return index * kWordBits + static_cast<size_t>(std::countr_zero(word));
+    }
+
+    // Calls f(position) for every set bit in order
+    template <typename Function>
+    void ForEachSet(Function f) const {
+        const size_t words = WordCount(size_);
+        for (size_t index = 0; index < words; ++index) {
+            for (uint64_t word = words_[index]; word != 0; word &= word - 1) {
+                f(index * kWordBits + static_cast<size_t>(std::countr_zero(word)));
+            }
+        }
+    }
+
+    // The number of set bits before position, which may be Size()
+    size_t Rank(size_t position) const noexcept {
+        VECTOR_CHECK(position <= size_);
+        size_t rank = simd::PopCount(std::span<const uint64_t>(words_.GetAddress(), position / kWordBits));
+        if (position % kWordBits != 0) {
+            rank += static_cast<size_t>(std::popcount(words_[position / kWordBits] & ~(~uint64_t{ 0 } << (position % kWordBits))));
+        }
+        return rank;
+    }
+
+    // The position of the set bit with rank set bits before it, or Size() if there are no more than rank set bits
+    size_t Select(size_t rank) const noexcept {
+        const size_t words = WordCount(size_);
+        for (size_t index = 0; index < words; ++index) {
+            const size_t count = static_cast<size_t>(std::popcount(words_[index]));
+            if (rank < count) {
+                return index * kWordBits + detail::SelectInWord(words_[index], rank);
+            }
+            rank -= count;
+        }
+        return size_;
+    }
+
+
+    friend bool operator==(const BasicBitVector& lhs, const BasicBitVector& rhs) noexcept {
+        return lhs.size_ == rhs.size_ && std::ranges::equal(lhs.Words(), rhs.Words());
+    }
+
+private:
+    Storage words_;
+    size_t size_ = 0;
+
+
+    static size_t WordCount(size_t bits) noexcept {
+        return (bits + kWordBits - 1) / kWordBits;
+    }
+
+    std::span<uint64_t> MutableWords() noexcept {
+        return { words_.GetAddress(), WordCount(size_) };
+    }
+
+    // Zeroes the bits past the size in the last word
+    void ClearTail() noexcept {
+        if (size_ % kWordBits != 0) {
+            words_[size_ / kWordBits] &= ~(~uint64_t{ 0 } << (size_ % kWordBits));
+        }
+    }
+
+    static void CopyWords(const uint64_t* first, size_t count, uint64_t* destination) noexcept {
+        if (count != 0) {
+            std::memcpy(destination, first, count * sizeof(uint64_t));
+        }
+    }
+
+    void ReallocateTo(size_t new_words) {
+        if constexpr (HasReallocate<Allocator>::value) {
+            if (words_.Capacity() != 0) {
+                words_.Reallocate(new_words);
+                return;
+            }
+        }
+
+        Storage words(new_words, words_.GetAllocator());
+        CopyWords(words_.GetAddress(), WordCount(size_), words.GetAddress());
+        words_.Swap(words);
+    }
+};
+
+using BitVector = BasicBitVector<>;
+
+template <typename Allocator>
+BasicBitVector<Allocator> operator&(BasicBitVector<Allocator> lhs, const BasicBitVector<Allocator>& rhs) noexcept {
+    lhs &= rhs;
+    return lhs;
+}
+
+template <typename Allocator>
+BasicBitVector<Allocator> operator|(BasicBitVector<Allocator> lhs, const BasicBitVector<Allocator>& rhs) noexcept {
+    lhs |= rhs;
+    return lhs;
+}
+
+template <typename Allocator>
+BasicBitVector<Allocator> operator^(BasicBitVector<Allocator> lhs, const BasicBitVector<Allocator>& rhs) noexcept {
+    lhs ^= rhs;
+    return lhs;
+}
+
+template <typename Allocator>
+BasicBitVector<Allocator> operator~(BasicBitVector<Allocator> bits) noexcept {
+    bits.Flip();
+    return bits;
+}
+
+
+// Rank in constant time and Select in logarithmic time for a bit vector which doesn't change while the index is
+// used; Rebuild() brings it up to date after a change. It keeps the number of set bits before every block of
+// 512 bits, which costs an eighth of the memory of the bits
+template <typename Allocator = std::allocator<uint64_t>>
+class BitRankIndex {
+public:
+    static constexpr size_t kBlockWords = 8;
+
+    explicit BitRankIndex(const BasicBitVector<Allocator>& bits)
+        : bits_(&bits) {
+        Rebuild();
+    }
+
+    void Rebuild() {
+        const std::span<const uint64_t> words = bits_->Words();
+        const size_t blocks = (words.size() + kBlockWords - 1) / kBlockWords;
+
+        counts_.Clear();
+        counts_.Reserve(blocks + 1);
+        counts_.PushBack(0);
+        for (size_t block = 0; block < blocks; ++block) {
+            const size_t first = block * kBlockWords;
+            counts_.PushBack(counts_.Back() + simd::PopCount(words.subspan(first, std::min(kBlockWords, words.size() - first))));
+        }
+    }
+
+    size_t Rank(size_t position) const noexcept {
+        VECTOR_CHECK(position <= bits_->Size());
+        const uint64_t* words = bits_->Words().data();
+        const size_t word = position / BasicBitVector<Allocator>::kWordBits;
+
+        size_t rank = counts_[word / kBlockWords];
+        for (size_t i = word / kBlockWords * kBlockWords; i < word; ++i) {
+            rank += static_cast<size_t>(std::popcount(words[i]));
+        }
+        if (position % BasicBitVector<Allocator>::kWordBits != 0) {
+            rank += static_cast<size_t>(std::popcount(words[word] & ~(~uint64_t{ 0 } << (position % BasicBitVector<Allocator>::kWordBits))));
+        }
+        return rank;
+    }
+
+    size_t Select(size_t rank) const noexcept {
+        if (rank >= counts_.Back()) return bits_->Size();
+
+        // The last block with fewer than rank + 1 set bits before it
+        const size_t block = static_cast<size_t>(std::upper_bound(counts_.Data(), counts_.Data() + counts_.Size(), rank) - counts_.Data()) - 1;
+        rank -= counts_[block];
+
+        const uint64_t* words = bits_->Words().data();
+        for (size_t i = block * kBlockWords;; ++i) {
+            const size_t count = static_cast<size_t>(std::popcount(words[i]));
+            if (rank < count) {
+                return i * BasicBitVector<Allocator>::kWordBits + detail::SelectInWord(words[i], rank);
+            }
+            rank -= count;
+        }
+    }
+
+private:
+    const BasicBitVector<Allocator>* bits_;
+    // counts_[b] is the number of set bits before block b, and the last entry the total
+    Vector<uint64_t> counts_;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+
+
+
+
+// Append-only vector for many threads appending and reading at once. The elements live in RawMemory
+// segments of geometrically growing size which are never moved, so references to elements stay valid.
+// EmplaceBack claims an index with one atomic increment and doesn't wait for other threads; only the thread
+// which first needs a segment allocates it. Every slot has a state which tells readers whether its element
+// has been constructed
+template <typename T, typename Allocator = std::allocator<T>>
+class ConcurrentVector {
+    static constexpr size_t kFirstSegmentShift = 5;
+    static constexpr size_t kFirstSegmentSize = size_t{ 1 } << kFirstSegmentShift;
+    static constexpr size_t kMaxSegments = 64 - kFirstSegmentShift;
+
+    enum SlotState : uint8_t {
+        kEmpty,
+        kReady,
+        // The constructor of the element threw. Readers skip the slot
+        kFailed,
+    };
+
+    struct Segment {
+        Segment(size_t capacity, const Allocator& alloc)
+            : elements(capacity, alloc)
+            , states(std::make_unique<std::atomic<uint8_t>[]>(capacity)) {
+        }
+
+        RawMemory<T, Allocator> elements;
+        std::unique_ptr<std::atomic<uint8_t>[]> states;
+    };
+
+public:
+    ConcurrentVector() = default;
+
+    explicit ConcurrentVector(const Allocator& alloc) noexcept
+        : alloc_(alloc) {
+    }
+
+    ConcurrentVector(const ConcurrentVector&) = delete;
+    ConcurrentVector& operator=(const ConcurrentVector&) = delete;
+
+    // Must not run concurrently with anything else
+    ~ConcurrentVector() {
+        for (size_t k = 0; k < kMaxSegments; ++k) {
+            Segment* segment = segments_[k].load(std::memory_order_acquire);
+            if (segment == nullptr) continue;
+
+            for (size_t offset = 0; offset < SegmentCapacity(k); ++offset) {
+                if (segment->states[offset].load(std::memory_order_relaxed) == kReady) {
+                    std::destroy_at(segment->elements.GetAddress() + offset);
+                }
+            }
+            delete segment;
+        }
+    }
+
+
+    // The number of claimed slots, including the ones still being constructed
+    size_t Size() const noexcept {
+        return size_.load(std::memory_order_acquire);
+    }
+
+    // The number of slots in the allocated segments, which may have gaps while other threads allocate
+    size_t Capacity() const noexcept {
+        size_t capacity = 0;
+        for (size_t k = 0; k < kMaxSegments && segments_[k].load(std::memory_order_acquire) != nullptr; ++k) {
+            capacity += SegmentCapacity(k);
+        }
+        return capacity;
+    }
+
+    // Allocates the segments for new_capacity elements up front, taking the allocations off EmplaceBack
+    void Reserve(size_t new_capacity) {
+        if (new_capacity == 0) return;
+
+        const size_t last = Locate(new_capacity - 1).first;
+        for (size_t k = 0; k <= last; ++k) {
+            GetSegment(k);
+        }
+    }
+
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+    void PushBack(T&& value) {
+        EmplaceBack(std::move(value));
+    }
+
+    // The element is visible to readers of IsReady once its constructor has returned. If the constructor throws,
+    // the slot is left failed and readers skip it. If allocating its segment throws, the slot stays empty for good
+    // and ForEachReady doesn't get past it
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        const size_t index = size_.fetch_add(1, std::memory_order_relaxed);
+        auto [segment, offset] = Locate(index);
+
+        Segment* s = GetSegment(segment);
+        std::atomic<uint8_t>& state = s->states[offset];
+        try {
+            T* element = new (s->elements.GetAddress() + offset) T(std::forward<Args>(args)...);
+            state.store(kReady, std::memory_order_release);
+            return *element;
+        }
+        catch (...) {
+            state.store(kFailed, std::memory_order_release);
+            throw;
+        }
+    }
+
+
+    // Tells whether the element at index has been constructed. A true result makes the element safe to read
+    bool IsReady(size_t index) const noexcept {
+        return State(index) == kReady;
+    }
+
+    // The element must be ready
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(IsReady(index));
+        auto [segment, offset] = Locate(index);
+        return *Slot(segment, offset);
+    }
+
+    T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(IsReady(index));
+        auto [segment, offset] = Locate(index);
+        return *Slot(segment, offset);
+    }
+
+    // Calls f(element) for the elements from index first on, in order, until a slot still under construction
+    // or the end. Failed slots are skipped. Returns the index to continue from on the next scan
+    template <typename Function>
+    size_t ForEachReady(size_t first, Function f) const {
+        const size_t size = Size();
+
+        for (; first < size; ++first) {
+            const uint8_t state = State(first);
+            if (state == kEmpty) break;
+            if (state == kReady) {
+                f((*this)[first]);
+            }
+        }
+        return first;
+    }
+
+private:
+    // Splits an index into its segment and the offset in it: segment k holds kFirstSegmentSize << k elements
+    static std::pair<size_t, size_t> Locate(size_t index) noexcept {
+        const size_t biased = index + kFirstSegmentSize;
+        const size_t segment = std::bit_width(biased) - 1 - kFirstSegmentShift;
+
+        return { segment, biased - (kFirstSegmentSize << segment) };
+    }
+
+    static size_t SegmentCapacity(size_t segment) noexcept {
+        return kFirstSegmentSize << segment;
+    }
+
+    // Allocates the segment unless it exists. When threads race, the first compare-exchange wins
+    // and the others free their segments
+    Segment* GetSegment(size_t k) {
+        Segment* segment = segments_[k].load(std::memory_order_acquire);
+        if (segment != nullptr) return segment;
+
+        auto fresh = std::make_unique<Segment>(SegmentCapacity(k), alloc_);
+        if (segments_[k].compare_exchange_strong(segment, fresh.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return fresh.release();
+        }
+        return segment;
+    }
+
+    uint8_t State(size_t index) const noexcept {
+        auto [segment, offset] = Locate(index);
+
+        const Segment* s = segments_[segment].load(std::memory_order_acquire);
+        return s != nullptr ? s->states[offset].load(std::memory_order_acquire) : uint8_t{ kEmpty };
+    }
+
+    T* Slot(size_t segment, size_t offset) const noexcept {
+        return segments_[segment].load(std::memory_order_acquire)->elements.GetAddress() + offset;
+    }
+
+    [[no_unique_address]] Allocator alloc_{};
+    // Kept on its own cache line, so appends don't invalidate the segment table for readers
+    alignas(64) std::atomic<size_t> size_{ 0 };
+    alignas(64) std::atomic<Segment*> segments_[kMaxSegments] = {};
+};
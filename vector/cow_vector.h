@@ -0,0 +1,292 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+
+
+
+
+// Vector whose copies share one reference-counted block of elements until one of them is modified, which then
+// copies the elements for itself. Copying is O(1), so a vector can be handed to many readers cheaply:
+//
+//     CowVector<Item> items = LoadItems();
+//     for (Stage& stage : stages) stage.Run(items.Snapshot());
+//
+// Handing out a mutable reference or iterator, e.g. by the non-const operator[], makes the block private:
+// later copies copy the elements, as the reference could still be used to write through. Freeze() declares
+// that such references won't be written to anymore and makes the block shareable again. Read through a const
+// CowVector, or std::as_const, to avoid copying a shared block.
+// The reference count is atomic, so copies of one vector may be read, copied and destroyed in different threads
+template <typename T, typename Allocator = std::allocator<T>, typename GrowthPolicy = DoublingGrowth>
+class CowVector {
+    using Elements = Vector<T, Allocator, GrowthPolicy>;
+
+    struct Block {
+        explicit Block(Elements&& elements) noexcept
+            : elements(std::move(elements)) {
+        }
+
+        std::atomic<size_t> refs{ 1 };
+        bool shareable = true;
+        Elements elements;
+    };
+
+    using BlockAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Block>;
+    using BlockAllocTraits = std::allocator_traits<BlockAllocator>;
+
+public:
+
+    using iterator = T*;
+    using const_iterator = const T*;
+    using allocator_type = Allocator;
+
+
+    CowVector() = default;
+
+    explicit CowVector(const Allocator& alloc) noexcept
+        : alloc_(alloc) {
+    }
+
+    // Takes over the elements of a vector without copying them
+    explicit CowVector(Elements elements)
+        : alloc_(elements.GetAllocator())
+        , block_(MakeBlock(std::move(elements))) {
+    }
+
+    CowVector(const CowVector& other)
+        : alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.alloc_))
+        , block_(Share(other.block_)) {
+    }
+
+    CowVector(CowVector&& other) noexcept
+        : alloc_(other.alloc_)
+        , block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    CowVector& operator=(const CowVector& rhs) {
+        if (this != &rhs) {
+            CowVector copy(rhs);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    CowVector& operator=(CowVector&& rhs) noexcept {
+        if (this != &rhs) {
+            Release(std::exchange(block_, std::exchange(rhs.block_, nullptr)));
+        }
+        return *this;
+    }
+
+    ~CowVector() {
+        Release(block_);
+    }
+
+
+
+
+
+    const_iterator begin() const noexcept {
+        return Data();
+    }
+    const_iterator end() const noexcept {
+        return Data() + Size();
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    // Copy a shared block and make it private
+    iterator begin() {
+        return Leak().Data();
+    }
+    iterator end() {
+        return begin() + Size();
+    }
+
+
+    const T& Back() const noexcept {
+        VECTOR_CHECK(Size() != 0);
+        return block_->elements.Back();
+    }
+    const T& Front() const noexcept {
+        VECTOR_CHECK(Size() != 0);
+        return block_->elements.Front();
+    }
+
+    const T* Data() const noexcept {
+        return block_ != nullptr ? block_->elements.Data() : nullptr;
+    }
+
+
+    size_t Size() const noexcept {
+        return block_ != nullptr ? block_->elements.Size() : 0;
+    }
+
+    size_t Capacity() const noexcept {
+        return block_ != nullptr ? block_->elements.Capacity() : 0;
+    }
+
+    Allocator GetAllocator() const noexcept {
+        return alloc_;
+    }
+
+    // The number of vectors sharing the elements, 0 for a vector which never had any
+    size_t UseCount() const noexcept {
+        return block_ != nullptr ? block_->refs.load(std::memory_order_acquire) : 0;
+    }
+
+    bool IsShared() const noexcept {
+        return UseCount() > 1;
+    }
+
+    // Checked before block_ is touched, as an empty vector has none
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < Size());
+        return block_->elements[index];
+    }
+
+    // Copies a shared block and makes it private
+    T& operator[](size_t index) {
+        return Leak()[index];
+    }
+
+
+    // Makes the elements shareable again after mutable references were handed out. The caller must not
+    // write through those references anymore
+    void Freeze() noexcept {
+        // Only a private block is written, as other threads may be reading the flag of a shared one
+        if (block_ != nullptr && !block_->shareable) {
+            block_->shareable = true;
+        }
+    }
+
+    // Freezes the vector and returns a copy sharing its elements, which takes O(1)
+    CowVector Snapshot() {
+        Freeze();
+        return *this;
+    }
+
+    void Swap(CowVector& other) noexcept {
+        using std::swap;
+        swap(alloc_, other.alloc_);
+        std::swap(block_, other.block_);
+    }
+
+
+
+    // The modifiers copy the elements first if they are shared, and otherwise work as the ones of Vector
+
+    void Reserve(size_t new_capacity) {
+        Detach().Reserve(new_capacity);
+    }
+
+    void Resize(size_t new_size) {
+        if (new_size == Size()) return;
+        Detach().Resize(new_size);
+    }
+
+    void PushBack(const T& value) {
+        Detach().PushBack(value);
+    }
+
+    void PushBack(T&& value) {
+        Detach().PushBack(std::move(value));
+    }
+
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        return Leak().EmplaceBack(std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    iterator Emplace(const_iterator pos, Args&&... args) {
+        const size_t index = pos - cbegin();
+
+        Elements& elements = Leak();
+        return elements.Data() + (elements.Emplace(elements.cbegin() + index, std::forward<Args>(args)...) - elements.begin());
+    }
+
+    iterator Erase(const_iterator pos) {
+        const size_t index = pos - cbegin();
+
+        Elements& elements = Leak();
+        elements.Erase(elements.cbegin() + index);
+        return elements.Data() + index;
+    }
+
+    void PopBack() {
+        Detach().PopBack();
+    }
+
+    // A shared block is just let go
+    void Clear(ClearMode mode = ClearMode::KeepCapacity) noexcept {
+        if (block_ != nullptr && block_->refs.load(std::memory_order_acquire) == 1) {
+            block_->elements.Clear(mode);
+        }
+        else {
+            Release(std::exchange(block_, nullptr));
+        }
+    }
+
+
+private:
+    [[no_unique_address]] Allocator alloc_{};
+    Block* block_ = nullptr;
+
+
+    Block* MakeBlock(Elements&& elements) const {
+        BlockAllocator alloc(alloc_);
+        Block* block = BlockAllocTraits::allocate(alloc, 1);
+        BlockAllocTraits::construct(alloc, block, std::move(elements));
+        return block;
+    }
+
+    // The block of a copy of the vector owning block: block itself unless it is private
+    Block* Share(Block* block) const {
+        if (block == nullptr) return nullptr;
+
+        if (block->shareable) {
+            block->refs.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+        return MakeBlock(Elements(block->elements, alloc_));
+    }
+
+    // The last owner frees the block with the allocator of its elements, which may differ from alloc_
+    static void Release(Block* block) noexcept {
+        if (block == nullptr || block->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        BlockAllocator alloc(block->elements.GetAllocator());
+        BlockAllocTraits::destroy(alloc, block);
+        BlockAllocTraits::deallocate(alloc, block, 1);
+    }
+
+    // Gives the vector a block of its own, copying the elements if other vectors share them
+    Elements& Detach() {
+        if (block_ == nullptr) {
+            block_ = MakeBlock(Elements(alloc_));
+        }
+        else if (block_->refs.load(std::memory_order_acquire) != 1) {
+            Block* copy = MakeBlock(Elements(block_->elements, alloc_));
+            Release(std::exchange(block_, copy));
+        }
+        return block_->elements;
+    }
+
+    // Detaches the block and keeps it from being shared while mutable references into it may be in use
+    Elements& Leak() {
+        Elements& elements = Detach();
+        block_->shareable = false;
+        return elements;
+    }
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+
+
+
+
+// Lazy element-wise arithmetic on Vector. With the operators of this namespace in scope, an expression like
+// a + b * c over Vectors builds a tree of nodes instead of temporary vectors, and assigning it to a Vector
+// computes every element in one loop, with no allocation but the result's and one pass over memory:
+//
+//     using namespace expr;
+//     Vector<double> r = a + b * c - 2.0;
+//     expr::Assign(r, r * 0.5);   // reuses the buffer of r
+//
+// Operands are Vectors of one size, arithmetic scalars and nodes. A node keeps pointers to the elements of
+// its Vectors, so it must be evaluated before they are changed; keeping a tree in an auto variable is fine
+// as long as the operands outlive it. The destination may be one of the operands, as element i is only
+// computed from elements i
+namespace expr {
+
+namespace detail {
+
+    // Base of the nodes, which is what the operators and the conversion to Vector look for
+    template <typename Derived>
+    struct Node {
+        const Derived& Self() const noexcept {
+            return static_cast<const Derived&>(*this);
+        }
+
+        template <typename T, typename Allocator, typename GrowthPolicy>
+        operator Vector<T, Allocator, GrowthPolicy>() const;
+    };
+
+    template <typename T>
+    inline constexpr bool kIsNode = std::is_base_of_v<Node<T>, T>;
+
+    template <typename T>
+    struct IsVector : std::false_type {};
+
+    template <typename T, typename Allocator, typename GrowthPolicy>
+    struct IsVector<Vector<T, Allocator, GrowthPolicy>> : std::true_type {
+        using Element = T;
+    };
+
+    template <typename T>
+    concept Operand = kIsNode<std::remove_cvref_t<T>> || IsVector<std::remove_cvref_t<T>>::value
+                      || std::is_arithmetic_v<std::remove_cvref_t<T>>;
+
+    // The operators apply when one side is a node or a Vector, so arithmetic on scalars is left alone
+    template <typename L, typename R>
+    concept Operands = Operand<L> && Operand<R>
+                       && !(std::is_arithmetic_v<std::remove_cvref_t<L>> && std::is_arithmetic_v<std::remove_cvref_t<R>>);
+
+
+    // The elements of a Vector
+    template <typename T>
+    class Terminal : public Node<Terminal<T>> {
+    public:
+        using value_type = T;
+
+        Terminal(const T* data, size_t size) noexcept
+            : data_(data)
+            , size_(size) {
+        }
+
+        T operator[](size_t index) const noexcept {
+            return data_[index];
+        }
+
+        size_t Size() const noexcept {
+            return size_;
+        }
+
+        static constexpr bool kIsScalar = false;
+
+    private:
+        const T* data_;
+        size_t size_;
+    };
+
+    // A scalar operand, the same for every element
+    template <typename T>
+    class Scalar : public Node<Scalar<T>> {
+    public:
+        using value_type = T;
+
+        explicit Scalar(T value) noexcept
+            : value_(value) {
+        }
+
+        T operator[](size_t /*index*/) const noexcept {
+            return value_;
+        }
+
+        size_t Size() const noexcept {
+            return 0;
+        }
+
+        static constexpr bool kIsScalar = true;
+
+    private:
+        T value_;
+    };
+
+    template <typename Op, typename L, typename R>
+    class Binary : public Node<Binary<Op, L, R>> {
+    public:
+        using value_type = std::invoke_result_t<Op, typename L::value_type, typename R::value_type>;
+
+        Binary(L lhs, R rhs) noexcept
+            : lhs_(std::move(lhs))
+            , rhs_(std::move(rhs)) {
+            VECTOR_CHECK(L::kIsScalar || R::kIsScalar || lhs_.Size() == rhs_.Size());
+        }
+
+        value_type operator[](size_t index) const noexcept {
+            return Op{}(lhs_[index], rhs_[index]);
+        }
+
+        size_t Size() const noexcept {
+            return L::kIsScalar ? rhs_.Size() : lhs_.Size();
+        }
+
+        static constexpr bool kIsScalar = false;
+
+    private:
+        L lhs_;
+        R rhs_;
+    };
+
+    template <typename Op, typename E>
+    class Unary : public Node<Unary<Op, E>> {
+    public:
+        using value_type = std::invoke_result_t<Op, typename E::value_type>;
+
+        explicit Unary(E operand) noexcept
+            : operand_(std::move(operand)) {
+        }
+
+        value_type operator[](size_t index) const noexcept {
+            return Op{}(operand_[index]);
+        }
+
+        size_t Size() const noexcept {
+            return operand_.Size();
+        }
+
+        static constexpr bool kIsScalar = false;
+
+    private:
+        E operand_;
+    };
+
+
+    // The node for an operand. A scalar takes the element type of the other side, so a Vector<float> times 2.0
+    // is computed in float
+    template <typename Other, typename T>
+    auto MakeNode(const T& operand) noexcept {
+        if constexpr (kIsNode<T>) {
+            return operand;
+        }
+        else if constexpr (IsVector<T>::value) {
+            return Terminal<typename IsVector<T>::Element>(operand.Data(), operand.Size());
+        }
+        else {
+            return Scalar<typename decltype(MakeNode<void>(std::declval<const Other&>()))::value_type>(operand);
+        }
+    }
+
+    template <typename Op, typename L, typename R>
+    auto MakeBinary(const L& lhs, const R& rhs) noexcept {
+        using Lhs = decltype(MakeNode<R>(lhs));
+        using Rhs = decltype(MakeNode<L>(rhs));
+        return Binary<Op, Lhs, Rhs>(MakeNode<R>(lhs), MakeNode<L>(rhs));
+    }
+
+}
+
+
+template <typename L, typename R>
+    requires detail::Operands<L, R>
+auto operator+(const L& lhs, const R& rhs) noexcept {
+    return detail::MakeBinary<std::plus<>>(lhs, rhs);
+}
+
+template <typename L, typename R>
+    requires detail::Operands<L, R>
+auto operator-(const L& lhs, const R& rhs) noexcept {
+    return detail::MakeBinary<std::minus<>>(lhs, rhs);
+}
+
+template <typename L, typename R>
+    requires detail::Operands<L, R>
+auto operator*(const L& lhs, const R& rhs) noexcept {
+    return detail::MakeBinary<std::multiplies<>>(lhs, rhs);
+}
+
+template <typename L, typename R>
+    requires detail::Operands<L, R>
+auto operator/(const L& lhs, const R& rhs) noexcept {
+    return detail::MakeBinary<std::divides<>>(lhs, rhs);
+}
+
+template <typename E>
+    requires(detail::Operand<E> && !std::is_arithmetic_v<E>)
+auto operator-(const E& operand) noexcept {
+    using Operand = decltype(detail::MakeNode<void>(operand));
+    return detail::Unary<std::negate<>, Operand>(detail::MakeNode<void>(operand));
+}
+
+
+// Computes the expression into destination, resized to its size without initializing new elements first.
+// The loop reads nothing but the operands, so the compiler can vectorize it
+template <typename T, typename Allocator, typename GrowthPolicy, typename E>
+    requires(detail::Operand<E> && !std::is_arithmetic_v<E>)
+void Assign(Vector<T, Allocator, GrowthPolicy>& destination, const E& expression) {
+    const auto node = detail::MakeNode<void>(expression);
+    const size_t size = node.Size();
+
+    // Operands have the size of the expression, so only a destination which isn't one is resized
+    if (destination.Size() != size) {
+        destination.ResizeUninitialized(size);
+    }
+
+    T* out = destination.Data();
+    for (size_t i = 0; i < size; ++i) {
+        out[i] = static_cast<T>(node[i]);
+    }
+}
+
+// The expression computed into a new Vector of its element type
+template <typename E>
+    requires detail::kIsNode<E>
+Vector<typename E::value_type> Evaluate(const E& expression) {
+    Vector<typename E::value_type> result;
+    Assign(result, expression);
+    return result;
+}
+
+
+template <typename Derived>
+template <typename T, typename Allocator, typename GrowthPolicy>
+detail::Node<Derived>::operator Vector<T, Allocator, GrowthPolicy>() const {
+    Vector<T, Allocator, GrowthPolicy> result;
+    Assign(result, Self());
+    return result;
+}
+
+}
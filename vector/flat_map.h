@@ -0,0 +1,625 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+
+
+
+
+// Policies for finding the first key not less than a key in the sorted keys of a FlatSet or FlatMap. A policy
+// provides Index<K, Allocator>, which the container constructs from the allocator of its keys, keeps and rebuilds
+// after every change of its keys
+
+// std::lower_bound. Nothing to rebuild
+struct BinarySearch {
+    template <typename K, typename Allocator>
+    struct Index {
+        Index() = default;
+
+        explicit Index(const Allocator& /*alloc*/) noexcept {
+        }
+
+        void Rebuild(std::span<const K> /*keys*/) noexcept {
+        }
+
+        template <typename Compare>
+        size_t LowerBound(std::span<const K> keys, const K& key, const Compare& comp) const {
+            return std::lower_bound(keys.begin(), keys.end(), key, comp) - keys.begin();
+        }
+    };
+};
+
+// Halves the range with a conditional move instead of a branch, so lookups of random keys don't pay
+// for mispredictions. Nothing to rebuild
+struct BranchlessSearch {
+    template <typename K, typename Allocator>
+    struct Index {
+        Index() = default;
+
+        explicit Index(const Allocator& /*alloc*/) noexcept {
+        }
+
+        void Rebuild(std::span<const K> /*keys*/) noexcept {
+        }
+
+        template <typename Compare>
+        size_t LowerBound(std::span<const K> keys, const K& key, const Compare& comp) const {
+            if (keys.empty()) return 0;
+
+            const K* base = keys.data();
+            for (size_t size = keys.size(); size > 1;) {
+                const size_t half = size / 2;
+                base = comp(base[half], key) ? base + half : base;
+                size -= half;
+            }
+            return (base - keys.data()) + comp(*base, key);
+        }
+    };
+};
+
+// Keeps a copy of the keys in the Eytzinger order, a binary tree stored breadth-first, with the sorted
+// position of each. A lookup reads the levels of the tree front to back and prefetches the ones it reaches in
+// four steps, but then reads the position, one more cache miss in a large table, so measure it against
+// BranchlessSearch with BM_MapFind. The copy costs memory and a rebuild in O(n) per change, so it suits
+// tables built once or changed in batches
+struct EytzingerSearch {
+    template <typename K, typename Allocator>
+    class Index {
+        using SizeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<size_t>;
+
+    public:
+        explicit Index(const Allocator& alloc = Allocator())
+            : keys_(alloc)
+            , positions_(SizeAllocator(alloc)) {
+        }
+
+        // If copying the keys throws, lookups fall back to binary search until the next rebuild
+        void Rebuild(std::span<const K> keys) {
+            keys_.Clear();
+            positions_.Clear();
+
+            Vector<K, Allocator> tree(keys_.GetAllocator());
+            Vector<size_t, SizeAllocator> positions(positions_.GetAllocator());
+            positions.ResizeUninitialized(keys.size());
+            size_t next = 0;
+            Place(positions, 1, next);
+
+            tree.Reserve(keys.size());
+            for (size_t position : positions) {
+                tree.PushBack(keys[position]);
+            }
+            keys_.Swap(tree);
+            positions_.Swap(positions);
+        }
+
+        template <typename Compare>
+        size_t LowerBound(std::span<const K> keys, const K& key, const Compare& comp) const {
+            const size_t size = keys_.Size();
+            if (size != keys.size()) {
+                return BinarySearch::Index<K, Allocator>().LowerBound(keys, key, comp);
+            }
+
+            // Node k has children 2k and 2k + 1; node k is at k - 1
+            const K* tree = keys_.Data();
+            size_t k = 1;
+            while (k <= size) {
+                if (kPrefetchDistance * k <= size) {
+                    __builtin_prefetch(tree + kPrefetchDistance * k - 1);
+                }
+                k = 2 * k + comp(tree[k - 1], key);
+            }
+            // Going left once more than right from the node found; the trailing ones are the right turns after it
+            k >>= std::countr_one(k) + 1;
+            return k == 0 ? size : positions_[k - 1];
+        }
+
+    private:
+        // Nodes four levels down, 16 of them usually on one or two cache lines
+        static constexpr size_t kPrefetchDistance = 16;
+
+        // Numbers the nodes of the subtree at k in order, which is the sorted position of their keys
+        static void Place(Vector<size_t, SizeAllocator>& positions, size_t k, size_t& next) noexcept {
+            if (k > positions.Size()) return;
+
+            Place(positions, 2 * k, next);
+            positions[k - 1] = next++;
+            Place(positions, 2 * k + 1, next);
+        }
+
+        Vector<K, Allocator> keys_;
+        Vector<size_t, SizeAllocator> positions_;
+    };
+};
+
+
+
+
+
+namespace detail {
+
+    // Sorts items and keeps the first of each run of equivalent ones
+    template <typename T, typename Allocator, typename GrowthPolicy, typename Less>
+    void SortUnique(Vector<T, Allocator, GrowthPolicy>& items, Less less) {
+        std::stable_sort(items.Data(), items.Data() + items.Size(), less);
+        T* last = std::unique(items.Data(), items.Data() + items.Size(), [&less](const T& lhs, const T& rhs) {
+            return !less(lhs, rhs);
+        });
+        items.Erase(items.cbegin() + (last - items.Data()), items.cend());
+    }
+
+}
+
+
+
+
+
+// Set of unique keys kept sorted in one Vector. Lookups search the contiguous keys, which is several times
+// faster than following the nodes of std::set and takes no memory beyond the keys; inserting and erasing a single key
+// shift the keys after it, so a batch is better inserted at once with Insert(first, last), which merges.
+// Search picks BinarySearch, BranchlessSearch or EytzingerSearch. Iterators and references are invalidated
+// by every change
+template <typename K, typename Compare = std::less<K>, typename Search = BinarySearch, typename Allocator = std::allocator<K>>
+class FlatSet {
+public:
+    using value_type = K;
+    using iterator = const K*;
+    using const_iterator = const K*;
+
+
+    FlatSet() = default;
+
+    explicit FlatSet(const Compare& comp, const Allocator& alloc = Allocator())
+        : keys_(alloc)
+        , comp_(comp)
+        , index_(keys_.GetAllocator()) {
+    }
+
+    // Sorts the keys and drops duplicates once, which takes O(n log n) instead of n insertions
+    explicit FlatSet(Vector<K, Allocator> keys, const Compare& comp = Compare())
+        : keys_(std::move(keys))
+        , comp_(comp)
+        , index_(keys_.GetAllocator()) {
+        detail::SortUnique(keys_, comp_);
+        index_.Rebuild(Keys());
+    }
+
+    template <typename InputIt>
+    FlatSet(InputIt first, InputIt last, const Compare& comp = Compare())
+        : comp_(comp)
+        , index_(keys_.GetAllocator()) {
+        keys_.Insert(keys_.cend(), first, last);
+        detail::SortUnique(keys_, comp_);
+        index_.Rebuild(Keys());
+    }
+
+
+    const_iterator begin() const noexcept {
+        return keys_.Data();
+    }
+    const_iterator end() const noexcept {
+        return keys_.Data() + keys_.Size();
+    }
+
+    std::span<const K> Keys() const noexcept {
+        return { keys_.Data(), keys_.Size() };
+    }
+
+    size_t Size() const noexcept {
+        return keys_.Size();
+    }
+
+    void Reserve(size_t capacity) {
+        keys_.Reserve(capacity);
+    }
+
+    void Clear() noexcept {
+        keys_.Clear();
+        index_.Rebuild(Keys());
+    }
+
+
+    const_iterator LowerBound(const K& key) const {
+        return begin() + index_.LowerBound(Keys(), key, comp_);
+    }
+
+    const_iterator Find(const K& key) const {
+        const_iterator it = LowerBound(key);
+        return it != end() && !comp_(key, *it) ? it : end();
+    }
+
+    bool Contains(const K& key) const {
+        return Find(key) != end();
+    }
+
+
+    // Returns the key and whether it was inserted
+    std::pair<const_iterator, bool> Insert(const K& key) {
+        const size_t index = index_.LowerBound(Keys(), key, comp_);
+        if (index != Size() && !comp_(key, keys_[index])) {
+            return { begin() + index, false };
+        }
+
+        keys_.Insert(keys_.cbegin() + index, key);
+        index_.Rebuild(Keys());
+        return { begin() + index, true };
+    }
+
+    // Sorts the new keys and merges them with the set in one pass, O(n + m log m). Keys already in the set
+    // are kept, and of equivalent new keys the first is
+    template <typename InputIt>
+    void Insert(InputIt first, InputIt last) {
+        Vector<K, Allocator> fresh(keys_.GetAllocator());
+        fresh.Insert(fresh.cend(), first, last);
+        detail::SortUnique(fresh, comp_);
+
+        Vector<K, Allocator> merged(keys_.GetAllocator());
+        merged.Reserve(keys_.Size() + fresh.Size());
+        size_t i = 0;
+        size_t j = 0;
+        while (i < keys_.Size() && j < fresh.Size()) {
+            if (comp_(fresh[j], keys_[i])) {
+                merged.PushBack(std::move(fresh[j++]));
+            }
+            else {
+                j += !comp_(keys_[i], fresh[j]);
+                merged.PushBack(std::move(keys_[i++]));
+            }
+        }
+        merged.Insert(merged.cend(), std::make_move_iterator(keys_.Data() + i), std::make_move_iterator(keys_.Data() + keys_.Size()));
+        merged.Insert(merged.cend(), std::make_move_iterator(fresh.Data() + j), std::make_move_iterator(fresh.Data() + fresh.Size()));
+
+        keys_.Swap(merged);
+        index_.Rebuild(Keys());
+    }
+
+    // Returns the number of keys erased
+    size_t Erase(const K& key) {
+        const_iterator it = Find(key);
+        if (it == end()) return 0;
+
+        keys_.Erase(keys_.cbegin() + (it - begin()));
+        index_.Rebuild(Keys());
+        return 1;
+    }
+
+    template <typename Predicate>
+    size_t EraseIf(Predicate predicate) {
+        const size_t erased = keys_.EraseIf(predicate);
+        index_.Rebuild(Keys());
+        return erased;
+    }
+
+private:
+    Vector<K, Allocator> keys_;
+    [[no_unique_address]] Compare comp_{};
+    [[no_unique_address]] typename Search::template Index<K, Allocator> index_;
+};
+
+
+
+
+
+// Map with unique keys, kept sorted in one Vector and their values in the same order in another, so lookups
+// search nothing but keys. Otherwise works as FlatSet, and iterators give pairs of references
+template <typename K, typename V, typename Compare = std::less<K>, typename Search = BinarySearch,
+          typename KeyAllocator = std::allocator<K>, typename ValueAllocator = std::allocator<V>>
+class FlatMap {
+    template <bool IsConst>
+    class Iterator;
+
+    using ItemAllocator = typename std::allocator_traits<KeyAllocator>::template rebind_alloc<std::pair<K, V>>;
+
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+
+    FlatMap() = default;
+
+    explicit FlatMap(const Compare& comp, const KeyAllocator& key_alloc = KeyAllocator(),
+                     const ValueAllocator& value_alloc = ValueAllocator())
+        : keys_(key_alloc)
+        , values_(value_alloc)
+        , comp_(comp)
+        , index_(keys_.GetAllocator()) {
+    }
+
+    // Sorts the items and drops the later ones with duplicate keys once
+    explicit FlatMap(Vector<std::pair<K, V>> items, const Compare& comp = Compare())
+        : comp_(comp) {
+        detail::SortUnique(items, ItemLess());
+        keys_.Reserve(items.Size());
+        values_.Reserve(items.Size());
+        for (auto& [key, value] : items) {
+            keys_.PushBack(std::move(key));
+            values_.PushBack(std::move(value));
+        }
+        index_.Rebuild(Keys());
+    }
+
+
+    iterator begin() noexcept {
+        return iterator(keys_.Data(), values_.Data());
+    }
+    iterator end() noexcept {
+        return begin() + Size();
+    }
+    const_iterator begin() const noexcept {
+        return const_iterator(keys_.Data(), values_.Data());
+    }
+    const_iterator end() const noexcept {
+        return begin() + Size();
+    }
+
+    std::span<const K> Keys() const noexcept {
+        return { keys_.Data(), keys_.Size() };
+    }
+    std::span<V> Values() noexcept {
+        return { values_.Data(), values_.Size() };
+    }
+    std::span<const V> Values() const noexcept {
+        return { values_.Data(), values_.Size() };
+    }
+
+    size_t Size() const noexcept {
+        return keys_.Size();
+    }
+
+    void Reserve(size_t capacity) {
+        keys_.Reserve(capacity);
+        values_.Reserve(capacity);
+    }
+
+    void Clear() noexcept {
+        keys_.Clear();
+        values_.Clear();
+        index_.Rebuild(Keys());
+    }
+
+
+    iterator Find(const K& key) {
+        return begin() + FindIndex(key);
+    }
+    const_iterator Find(const K& key) const {
+        return begin() + FindIndex(key);
+    }
+
+    bool Contains(const K& key) const {
+        return FindIndex(key) != Size();
+    }
+
+    // Throws std::out_of_range if the key is missing
+    const V& At(const K& key) const {
+        const size_t index = FindIndex(key);
+        if (index == Size()) {
+            throw std::out_of_range("FlatMap key not found");
+        }
+        return values_[index];
+    }
+
+    V& At(const K& key) {
+        return const_cast<V&>(std::as_const(*this).At(key));
+    }
+
+    // Inserts a value-initialized value if the key is missing
+    V& operator[](const K& key) {
+        return TryEmplace(key).first->second;
+    }
+
+
+    // Constructs the value from args unless the key is there. Returns the item and whether it was inserted
+    template <typename... Args>
+    std::pair<iterator, bool> TryEmplace(const K& key, Args&&... args) {
+        const size_t index = index_.LowerBound(Keys(), key, comp_);
+        if (index != Size() && !comp_(key, keys_[index])) {
+            return { begin() + index, false };
+        }
+
+        keys_.Insert(keys_.cbegin() + index, key);
+        try {
+            values_.Emplace(values_.cbegin() + index, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            keys_.Erase(keys_.cbegin() + index);
+            throw;
+        }
+        index_.Rebuild(Keys());
+        return { begin() + index, true };
+    }
+
+    std::pair<iterator, bool> Insert(const K& key, const V& value) {
+        return TryEmplace(key, value);
+    }
+
+    template <typename M>
+    std::pair<iterator, bool> InsertOrAssign(const K& key, M&& value) {
+        auto result = TryEmplace(key, std::forward<M>(value));
+        if (!result.second) {
+            result.first->second = std::forward<M>(value);
+        }
+        return result;
+    }
+
+    // Sorts the new items and merges them with the map in one pass, O(n + m log m). Items whose key is already
+    // in the map are dropped, and of new items with equivalent keys the first is kept
+    template <typename InputIt>
+    void Insert(InputIt first, InputIt last) {
+        Vector<std::pair<K, V>, ItemAllocator> fresh(ItemAllocator(keys_.GetAllocator()));
+        fresh.Insert(fresh.cend(), first, last);
+        detail::SortUnique(fresh, ItemLess());
+
+        Vector<K, KeyAllocator> keys(keys_.GetAllocator());
+        Vector<V, ValueAllocator> values(values_.GetAllocator());
+        keys.Reserve(keys_.Size() + fresh.Size());
+        values.Reserve(keys_.Size() + fresh.Size());
+
+        size_t i = 0;
+        size_t j = 0;
+        while (i < keys_.Size() || j < fresh.Size()) {
+            const bool take_fresh = i == keys_.Size() || (j < fresh.Size() && comp_(fresh[j].first, keys_[i]));
+            if (take_fresh) {
+                keys.PushBack(std::move(fresh[j].first));
+                values.PushBack(std::move(fresh[j].second));
+                ++j;
+            }
+            else {
+                j += j < fresh.Size() && !comp_(keys_[i], fresh[j].first);
+                keys.PushBack(std::move(keys_[i]));
+                values.PushBack(std::move(values_[i]));
+                ++i;
+            }
+        }
+
+        keys_.Swap(keys);
+        values_.Swap(values);
+        index_.Rebuild(Keys());
+    }
+
+    // Returns the number of items erased
+    size_t Erase(const K& key) {
+        const size_t index = FindIndex(key);
+        if (index == Size()) return 0;
+
+        keys_.Erase(keys_.cbegin() + index);
+        values_.Erase(values_.cbegin() + index);
+        index_.Rebuild(Keys());
+        return 1;
+    }
+
+private:
+    Vector<K, KeyAllocator> keys_;
+    Vector<V, ValueAllocator> values_;
+    [[no_unique_address]] Compare comp_{};
+    [[no_unique_address]] typename Search::template Index<K, KeyAllocator> index_;
+
+
+    auto ItemLess() const {
+        return [this](const std::pair<K, V>& lhs, const std::pair<K, V>& rhs) {
+            return comp_(lhs.first, rhs.first);
+        };
+    }
+
+    // The index of the key, or Size()
+    size_t FindIndex(const K& key) const {
+        const size_t index = index_.LowerBound(Keys(), key, comp_);
+        return index != Size() && !comp_(key, keys_[index]) ? index : Size();
+    }
+};
+
+
+// Random access iterator over the items as pairs of a key and a value reference, walking both Vectors at once
+template <typename K, typename V, typename Compare, typename Search, typename KeyAllocator, typename ValueAllocator>
+template <bool IsConst>
+class FlatMap<K, V, Compare, Search, KeyAllocator, ValueAllocator>::Iterator {
+    using Value = std::conditional_t<IsConst, const V, V>;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = std::pair<K, V>;
+    using difference_type = std::ptrdiff_t;
+    using reference = std::pair<const K&, Value&>;
+
+    // A reference can't be pointed to, so -> returns it wrapped
+    struct pointer {
+        reference item;
+
+        const reference* operator->() const noexcept {
+            return &item;
+        }
+    };
+
+    Iterator() = default;
+
+    Iterator(const K* key, Value* value) noexcept
+        : key_(key)
+        , value_(value) {
+    }
+
+    template <bool OtherConst>
+        requires (IsConst && !OtherConst)
+    Iterator(const Iterator<OtherConst>& other) noexcept
+        : key_(other.key_)
+        , value_(other.value_) {
+    }
+
+    reference operator*() const noexcept {
+        return { *key_, *value_ };
+    }
+    pointer operator->() const noexcept {
+        return { **this };
+    }
+    reference operator[](difference_type n) const noexcept {
+        return *(*this + n);
+    }
+
+    Iterator& operator++() noexcept {
+        ++key_;
+        ++value_;
+        return *this;
+    }
+    Iterator operator++(int) noexcept {
+        Iterator copy = *this;
+        ++*this;
+        return copy;
+    }
+    Iterator& operator--() noexcept {
+        --key_;
+        --value_;
+        return *this;
+    }
+    Iterator operator--(int) noexcept {
+        Iterator copy = *this;
+        --*this;
+        return copy;
+    }
+
+    Iterator& operator+=(difference_type n) noexcept {
+        key_ += n;
+        value_ += n;
+        return *this;
+    }
+    Iterator& operator-=(difference_type n) noexcept {
+        return *this += -n;
+    }
+
+    friend Iterator operator+(Iterator it, difference_type n) noexcept {
+        return it += n;
+    }
+    friend Iterator operator+(difference_type n, Iterator it) noexcept {
+        return it += n;
+    }
+    friend Iterator operator-(Iterator it, difference_type n) noexcept {
+        return it -= n;
+    }
+    friend difference_type operator-(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.key_ - rhs.key_;
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.key_ == rhs.key_;
+    }
+    friend std::strong_ordering operator<=>(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.key_ <=> rhs.key_;
+    }
+
+private:
+    template <bool>
+    friend class Iterator;
+
+    const K* key_ = nullptr;
+    Value* value_ = nullptr;
+};
@@ -1,9 +1,38 @@
 #include "vector.h"
+#include "allocators.h"
+#include "small_vector.h"
+#include "mapped_vector.h"
+#include "vector_io.h"
+#include "parallel.h"
+#include "simd.h"
+#include "concurrent_vector.h"
+#include "soa_vector.h"
+#include "cow_vector.h"
+#include "persistent_vector.h"
+#include "segmented_vector.h"
+#include "expr.h"
+#include "flat_map.h"
+#include "batch_channel.h"
+#include "vector_pool.h"
+#include "traversal.h"
+#include "bit_vector.h"
 
-#include <iostream>
+#include <coroutine>
+#include <cstdio>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <memory_resource>
+#include <numeric>
 #include <stdexcept>
 #include <string>
-#include <vector>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 namespace {
     inline const uint32_t DEFAULT_COOKIE = 0xdeadbeef;
@@ -114,8 +143,125 @@ namespace {
         static inline int num_move_assigned = 0;
     };
 
+    template <typename T>
+    struct CountingAllocator {
+        using value_type = T;
+
+        CountingAllocator() = default;
+
+        template <typename U>
+        CountingAllocator(const CountingAllocator<U>& /*other*/) noexcept {
+        }
+
+        T* allocate(size_t n) {
+            if (fail_next) {
+                fail_next = false;
+                throw std::bad_alloc();
+            }
+            ++num_allocations;
+            peak_live = std::max(peak_live, num_allocations - num_deallocations);
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, size_t n) noexcept {
+            ++num_deallocations;
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        friend bool operator==(const CountingAllocator&, const CountingAllocator&) noexcept {
+            return true;
+        }
+
+        static void ResetCounters() {
+            num_allocations = 0;
+            num_deallocations = 0;
+            peak_live = 0;
+        }
+
+        static inline int num_allocations = 0;
+        static inline int num_deallocations = 0;
+        // The highest number of allocations not yet matched by deallocations since ResetCounters()
+        static inline int peak_live = 0;
+        // Makes the next allocation throw std::bad_alloc
+        static inline bool fail_next = false;
+    };
+
+    // Owns a heap buffer like a small string: not trivially copyable, but safe to relocate bytewise
+    struct Handle {
+        explicit Handle(int value)
+            : ptr(new int(value)) {
+        }
+
+        Handle(const Handle& other)
+            : ptr(new int(*other.ptr)) {
+            ++num_copied;
+        }
+
+        Handle(Handle&& other) noexcept
+            : ptr(std::exchange(other.ptr, nullptr)) {
+            ++num_moved;
+        }
+
+        Handle& operator=(const Handle& other) {
+            *ptr = *other.ptr;
+            return *this;
+        }
+
+        Handle& operator=(Handle&& other) noexcept {
+            std::swap(ptr, other.ptr);
+            ++num_moved;
+            return *this;
+        }
+
+        ~Handle() {
+            delete ptr;
+        }
+
+        int* ptr = nullptr;
+
+        static inline int num_copied = 0;
+        static inline int num_moved = 0;
+    };
+
+    // Counts its constructions and destructions in a Tally, which constant evaluation can read back
+    struct Tally {
+        int constructed = 0;
+        int destroyed = 0;
+    };
+
+    struct Tallied {
+        constexpr Tallied(Tally& tally, int value)
+            : tally(&tally)
+            , value(value) {
+            ++tally.constructed;
+        }
+
+        constexpr Tallied(const Tallied& other)
+            : tally(other.tally)
+            , value(other.value) {
+            ++tally->constructed;
+        }
+
+        constexpr Tallied& operator=(const Tallied& other) = default;
+
+        constexpr ~Tallied() {
+            ++tally->destroyed;
+        }
+
+        Tally* tally;
+        int value;
+    };
+
 }
 
+template <>
+struct IsTriviallyRelocatable<Handle> : std::true_type {
+};
+
+template <>
+struct IsTriviallyRelocatable<Tallied> : std::true_type {
+};
+
 void Test1() {
     Obj::ResetCounters();
     const size_t SIZE = 100500;
@@ -429,7 +575,7 @@ void Test6() {
     {
         Obj::ResetCounters();
         Vector<Obj> v;
-        auto* pos = v.Emplace(v.end(), Obj{ 1 });
+        auto pos = v.Emplace(v.end(), Obj{ 1 });
         assert(v.Size() == 1);
         assert(v.Capacity() >= v.Size());
         assert(&*pos == &v[0]);
@@ -444,7 +590,7 @@ void Test6() {
         Obj::ResetCounters();
         Vector<Obj> v;
         v.Reserve(SIZE);
-        auto* pos = v.Emplace(v.end(), Obj{ 1 });
+        auto pos = v.Emplace(v.end(), Obj{ 1 });
         assert(v.Size() == 1);
         assert(v.Capacity() >= v.Size());
         assert(&*pos == &v[0]);
@@ -491,7 +637,7 @@ void Test6() {
     {
         Obj::ResetCounters();
         Vector<Obj> v{ SIZE };
-        auto* pos = v.Emplace(v.cbegin() + 1, ID, "Ivan"s);
+        auto pos = v.Emplace(v.cbegin() + 1, ID, "Ivan"s);
         assert(v.Size() == SIZE + 1);
         assert(v.Capacity() == SIZE * 2);
         assert(&*pos == &v[1]);
@@ -507,7 +653,7 @@ void Test6() {
     {
         Obj::ResetCounters();
         Vector<Obj> v{ SIZE };
-        auto* pos = v.Emplace(v.cbegin() + v.Size(), ID, "Ivan"s);
+        auto pos = v.Emplace(v.cbegin() + v.Size(), ID, "Ivan"s);
         assert(v.Size() == SIZE + 1);
         assert(v.Capacity() == SIZE * 2);
         assert(&*pos == &v[SIZE]);
@@ -526,7 +672,7 @@ void Test6() {
         v.Reserve(SIZE * 2);
         const int old_num_moved = Obj::num_moved;
         assert(v.Capacity() == SIZE * 2);
-        auto* pos = v.Emplace(v.cbegin() + 3, ID, "Ivan"s);
+        auto pos = v.Emplace(v.cbegin() + 3, ID, "Ivan"s);
         assert(v.Size() == SIZE + 1);
         assert(&*pos == &v[3]);
         assert(v[3].id == ID);
@@ -542,7 +688,7 @@ void Test6() {
         Obj::ResetCounters();
         Vector<Obj> v{ SIZE };
         v[2].id = ID;
-        auto* pos = v.Erase(v.cbegin() + 1);
+        auto pos = v.Erase(v.cbegin() + 1);
         assert((pos - v.begin()) == 1);
         assert(v.Size() == SIZE - 1);
         assert(v.Capacity() == SIZE);
@@ -555,89 +701,2463 @@ void Test6() {
     }
 }
 
-struct C {
-    C() noexcept {
-        ++def_ctor;
+void Test7() {
+    const size_t SIZE = 100;
+    {
+        CountingAllocator<Obj>::ResetCounters();
+        Obj::ResetCounters();
+        {
+            Vector<Obj, CountingAllocator<Obj>> v(SIZE);
+            v.PushBack(Obj{ 1 });
+            auto v_copy(v);
+            assert(v_copy.Size() == SIZE + 1);
+            assert(CountingAllocator<Obj>::num_allocations == 3);
+        }
+        assert(CountingAllocator<Obj>::num_deallocations == 3);
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+    {
+        alignas(std::max_align_t) std::byte buffer[SIZE * sizeof(int) * 4];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+        pmr::Vector<int> v(&arena);
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<int>(i));
+        }
+        assert(v.Size() == SIZE);
+        assert(v[SIZE - 1] == static_cast<int>(SIZE - 1));
+        assert(v.GetAllocator().resource() == &arena);
+    }
+    {
+        Obj::ResetCounters();
+        std::pmr::unsynchronized_pool_resource pool;
+        std::pmr::unsynchronized_pool_resource other_pool;
+        {
+            pmr::Vector<Obj> v(SIZE, &pool);
+            pmr::Vector<Obj> v_other(&other_pool);
+            v_other = std::move(v);
+            assert(v_other.Size() == SIZE);
+            assert(v_other.GetAllocator().resource() == &other_pool);
+            assert(Obj::num_moved == SIZE);
+
+            pmr::Vector<Obj> v_same(&other_pool);
+            v_same = std::move(v_other);
+            assert(v_same.Size() == SIZE);
+            assert(v_other.Size() == 0);
+            assert(Obj::num_moved == SIZE);
+        }
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+}
+
+void Test8() {
+    const size_t SIZE = 100;
+    static_assert(IsTriviallyRelocatable<int>::value);
+    static_assert(IsTriviallyRelocatable<std::unique_ptr<int>>::value);
+    static_assert(!IsTriviallyRelocatable<Obj>::value);
+    {
+        Vector<Handle> v;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.EmplaceBack(static_cast<int>(i));
+        }
+        v.Reserve(SIZE * 4);
+        v.Emplace(v.cbegin() + 1, -1);
+        v.Insert(v.cbegin(), Handle{ -2 });
+        v.Erase(v.cbegin() + 2);
+        assert(Handle::num_copied == 0);
+        assert(Handle::num_moved == 1);
+
+        assert(v.Size() == SIZE + 1);
+        assert(*v[0].ptr == -2);
+        assert(*v[1].ptr == 0);
+        assert(*v[2].ptr == 1);
+        assert(*v[SIZE].ptr == static_cast<int>(SIZE - 1));
     }
-    C(const C& /*other*/) noexcept {
-        ++copy_ctor;
+    {
+        Vector<std::unique_ptr<int>> v;
+        for (int i = 0; i < static_cast<int>(SIZE); ++i) {
+            v.PushBack(std::make_unique<int>(i));
+        }
+        v.Emplace(v.cbegin(), std::make_unique<int>(-1));
+        v.Erase(v.cbegin() + 1);
+        assert(v.Size() == SIZE);
+        assert(*v[0] == -1);
+        assert(*v[1] == 1);
+        assert(*v.Back() == static_cast<int>(SIZE - 1));
     }
-    C(C&& /*other*/) noexcept {
-        ++move_ctor;
+    {
+        Vector<int> v(SIZE);
+        for (size_t i = 0; i < SIZE; ++i) {
+            v[i] = static_cast<int>(i);
+        }
+        v.Emplace(v.cbegin() + SIZE / 2, -1);
+        assert(v[SIZE / 2] == -1);
+        assert(v[SIZE / 2 + 1] == static_cast<int>(SIZE / 2));
+        v.Erase(v.cbegin() + SIZE / 2);
+        for (size_t i = 0; i < SIZE; ++i) {
+            assert(v[i] == static_cast<int>(i));
+        }
     }
-    C& operator=(const C& other) noexcept {
-        if (this != &other) {
-            ++copy_assign;
+}
+
+void Test9() {
+    const size_t SIZE = 1'000'000;
+    static_assert(HasReallocate<MallocAllocator<int>>::value);
+    static_assert(!HasReallocate<std::allocator<int>>::value);
+    {
+        Vector<int, MallocAllocator<int>> v;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<int>(i));
         }
-        return *this;
+        v.Emplace(v.cbegin(), v[SIZE - 1]);
+        assert(v.Size() == SIZE + 1);
+        assert(v[0] == static_cast<int>(SIZE - 1));
+        assert(v[1] == 0);
+        assert(v[SIZE] == static_cast<int>(SIZE - 1));
+
+        v.Reserve(SIZE * 4);
+        assert(v.Capacity() == SIZE * 4);
+        assert(v[SIZE / 2] == static_cast<int>(SIZE / 2 - 1));
     }
-    C& operator=(C&& /*other*/) noexcept {
-        ++move_assign;
-        return *this;
+    {
+        Vector<Handle, MallocAllocator<Handle>> v;
+        Handle::num_copied = 0;
+        v.EmplaceBack(1);
+        v.PushBack(v[0]);
+        v.Insert(v.cbegin(), v[1]);
+        assert(v.Size() == 3);
+        assert(*v[0].ptr == 1 && *v[1].ptr == 1 && *v[2].ptr == 1);
+        assert(Handle::num_copied == 2);
     }
-    ~C() {
-        ++dtor;
+    {
+        Obj::ResetCounters();
+        {
+            Vector<Obj, MallocAllocator<Obj>> v(10);
+            v.EmplaceBack(1);
+            assert(Obj::num_moved == 10);
+        }
+        assert(Obj::GetAliveObjectCount() == 0);
     }
+}
 
-    static void Reset() {
-        def_ctor = 0;
-        copy_ctor = 0;
-        move_ctor = 0;
-        copy_assign = 0;
-        move_assign = 0;
-        dtor = 0;
+void Test10() {
+    {
+        Vector<int, std::allocator<int>, OneAndHalfGrowth> v;
+        const size_t expected[] = { 1, 2, 3, 4, 6, 9, 13, 19 };
+        for (size_t capacity : expected) {
+            v.PushBack(0);
+            v.Resize(v.Capacity());
+            assert(v.Capacity() == capacity);
+        }
+    }
+    {
+        Vector<int, std::allocator<int>, GoldenRatioGrowth> v(100);
+        v.EmplaceBack(1);
+        assert(v.Capacity() == 161);
+    }
+    {
+        Vector<int, std::allocator<int>, MinBytesGrowth<>> v;
+        v.PushBack(1);
+        assert(v.Capacity() == 64 / sizeof(int));
+        v.Resize(v.Capacity());
+        v.Emplace(v.cbegin(), 2);
+        assert(v.Capacity() == 2 * 64 / sizeof(int));
+    }
+    {
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+        // The smallest malloc block holds more than three ints. The mallocs of the sanitizers have no slack
+        const Vector<int, MallocAllocator<int>> rounded(3);
+        assert(rounded.Size() == 3 && rounded.Capacity() > 3);
+#endif
+        Vector<int, MallocAllocator<int>> v;
+        v.Reserve(3);
+        assert(v.Capacity() >= 3);
+        v.Resize(v.Capacity());
+        v.PushBack(1);
+        assert(v.Back() == 1);
+    }
+    {
+        // A byte count past size_t throws instead of wrapping to a small block
+        Vector<uint64_t, MallocAllocator<uint64_t>> v(2);
+        try {
+            v.Reserve(std::numeric_limits<size_t>::max() / sizeof(uint64_t) + 1);
+            assert(false);
+        }
+        catch (const std::bad_array_new_length&) {
+        }
+        assert(v.Size() == 2 && v.Capacity() >= 2);
     }
+}
 
-    inline static size_t def_ctor = 0;
-    inline static size_t copy_ctor = 0;
-    inline static size_t move_ctor = 0;
-    inline static size_t copy_assign = 0;
-    inline static size_t move_assign = 0;
-    inline static size_t dtor = 0;
-};
+void Test11() {
+    const size_t N = 8;
+    const int ID = 42;
+    using namespace std::literals;
+    {
+        CountingAllocator<Obj>::ResetCounters();
+        Obj::ResetCounters();
+        {
+            SmallVector<Obj, N, CountingAllocator<Obj>> v;
+            for (size_t i = 0; i + 1 < N; ++i) {
+                v.EmplaceBack(static_cast<int>(i));
+            }
+            v.Emplace(v.cbegin() + 1, ID, "Ivan"s);
+            v.Erase(v.cbegin());
+            v.PushBack(Obj{ ID });
+            assert(v.IsInline());
+            assert(v.Capacity() == N);
+            assert(CountingAllocator<Obj>::num_allocations == 0);
+
+            v.PushBack(Obj{ ID });
+            assert(!v.IsInline());
+            assert(CountingAllocator<Obj>::num_allocations == 1);
+            assert(v.Size() == N + 1);
+            assert(v[0].id == ID);
+            assert(v[1].id == 1);
+            assert(v[N].id == ID);
+        }
+        assert(CountingAllocator<Obj>::num_deallocations == 1);
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+    Obj::ResetCounters();
+    {
+        Obj::default_construction_throw_countdown = N / 2;
+        try {
+            SmallVector<Obj, N> v(N);
+            assert(false && "Exception is expected");
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+    Obj::ResetCounters();
+    {
+        SmallVector<Obj, N> v(N);
+        v[N / 2].throw_on_copy = true;
+        try {
+            SmallVector<Obj, N> v_copy(v);
+            assert(false && "Exception is expected");
+        }
+        catch (const std::runtime_error&) {
+            assert(Obj::num_copied == N / 2);
+        }
+        assert(Obj::GetAliveObjectCount() == N);
+
+        v.Reserve(N * 2);
+        assert(!v.IsInline());
+        assert(v.Size() == N);
+        assert(Obj::num_moved == N);
+        assert(Obj::GetAliveObjectCount() == N);
+    }
+    Obj::ResetCounters();
+    {
+        SmallVector<Obj, N> v(N / 2);
+        v[0].id = ID;
+        SmallVector<Obj, N> v_moved(std::move(v));
+        assert(v.Size() == 0);
+        assert(v_moved.Size() == N / 2);
+        assert(v_moved[0].id == ID);
+
+        SmallVector<Obj, N> v_heap(N * 2);
+        v_heap[0].id = ID + 1;
+        v_moved.Swap(v_heap);
+        assert(v_moved.Size() == N * 2 && !v_moved.IsInline());
+        assert(v_heap.Size() == N / 2 && v_heap.IsInline());
+        assert(v_moved[0].id == ID + 1);
+        assert(v_heap[0].id == ID);
 
-void Dump() {
-    using namespace std;
-    cerr << "Def ctors: "sv << C::def_ctor
-        << ", Copy ctors: "sv << C::copy_ctor
-        << ", Move ctors: "sv << C::move_ctor
-        << ", Copy assignments: "sv << C::copy_assign
-        << ", Move assignments: "sv << C::move_assign
-        << ", Dtors: "sv << C::dtor << endl;
+        v_heap = v_moved;
+        assert(v_heap.Size() == N * 2);
+        assert(v_heap[0].id == ID + 1);
+        v_moved.Resize(1);
+        v_heap = std::move(v_moved);
+        assert(v_heap.Size() == 1);
+        assert(v_heap[0].id == ID + 1);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+    {
+        SmallVector<TestObj, N> v(N);
+        v.PushBack(v[0]);
+        v.Insert(v.cbegin() + 2, v[0]);
+        v.Emplace(v.cbegin() + 2, std::move(v[0]));
+        assert(std::all_of(v.begin(), v.end(), [](const TestObj& obj) {
+            return obj.IsAlive();
+            }));
+    }
+    {
+        SmallVector<int, N> v;
+        for (int i = 0; i < static_cast<int>(N * 4); ++i) {
+            v.Insert(v.cbegin(), i);
+        }
+        assert(v.Size() == N * 4);
+        assert(v.Front() == static_cast<int>(N * 4 - 1));
+        assert(v.Back() == 0);
+    }
 }
 
-void Benchmark() {
-    using namespace std;
-    try {
-        const size_t NUM = 10;
-        C c;
+void Test12() {
+    const size_t SIZE = 10;
+    const int ID = 42;
+    {
+        Vector<int> v(SIZE);
+        const int values[] = { 1, 2, 3 };
+        auto pos = v.Insert(v.cbegin() + 1, std::begin(values), std::end(values));
+        assert(pos == v.begin() + 1);
+        assert(v.Size() == SIZE + 3);
+        assert(v[0] == 0 && v[1] == 1 && v[3] == 3 && v[4] == 0);
+
+        v.Insert(v.cbegin(), 2, v[1]);
+        assert(v.Size() == SIZE + 5);
+        assert(v[0] == 1 && v[1] == 1 && v[2] == 0 && v[3] == 1);
+
+        v.Append(std::span<const int>(v.begin(), v.end()));
+        assert(v.Size() == 2 * (SIZE + 5));
+        assert(v[SIZE + 5] == 1 && v.Back() == 0);
+
+        v.AppendN(3, ID);
+        assert(v.Back() == ID && v[v.Size() - 4] == 0);
+    }
+    {
+        Vector<int, MallocAllocator<int>> v;
+        v.AppendN(SIZE, ID);
+        v.Append(std::span<const int>(v.begin(), v.end()));
+        v.Append(std::span<const int>(v.begin(), v.end()));
+        assert(v.Size() == 4 * SIZE);
+        assert(std::all_of(v.begin(), v.end(), [ID](int x) {
+            return x == ID;
+            }));
+    }
+    {
+        // A count which would wrap the size throws and leaves the vector as it was
+        Vector<int> v;
+        v.PushBack(1);
+        try {
+            v.AppendN(std::numeric_limits<size_t>::max(), ID);
+            assert(false);
+        }
+        catch (const std::length_error&) {
+        }
+        assert(v.Size() == 1 && v[0] == 1);
+    }
+    {
+        Obj::ResetCounters();
+        Vector<Obj> v(SIZE);
+        const std::list<Obj> values(3, Obj{ ID });
+        v.Insert(v.cbegin() + 2, values.begin(), values.end());
+        assert(v.Size() == SIZE + 3);
+        assert(v[1].id == 0 && v[2].id == ID && v[4].id == ID && v[5].id == 0);
+        assert(Obj::num_copied == 3 + 3);
+
+        v.Reserve(v.Size() + 3);
+        Obj::ResetCounters();
+        v.Insert(v.cbegin(), values.begin(), values.end());
+        assert(Obj::num_copied == 3);
+        assert(v[0].id == ID && v[3].id == 0);
+
+        Vector<Obj> throwing(3);
+        throwing[1].throw_on_copy = true;
+        const size_t old_size = v.Size();
+        const size_t old_capacity = v.Capacity();
+        try {
+            v.Insert(v.cbegin() + 1, throwing.begin(), throwing.end());
+            assert(false && "Exception is expected");
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == old_size && v.Capacity() == old_capacity);
+        assert(v[0].id == ID && v[3].id == 0);
+    }
+    {
+        // A throwing move while the new elements are rotated into place destroys them
+        struct ThrowingMove {
+            explicit ThrowingMove(int id)
+                : obj(id) {
+            }
+            ThrowingMove(const ThrowingMove&) = default;
+            ThrowingMove(ThrowingMove&& other)
+                : obj(other.obj)
+                , throw_on_move(other.throw_on_move) {
+                if (throw_on_move) {
+                    throw std::runtime_error("Oops");
+                }
+            }
+            ThrowingMove& operator=(const ThrowingMove&) = default;
+            ThrowingMove& operator=(ThrowingMove&&) = default;
+            Obj obj;
+            bool throw_on_move = false;
+        };
+
+        Obj::ResetCounters();
         {
-            cerr << "std::vector:"sv << endl;
-            C::Reset();
-            vector<C> v(NUM);
-            Dump();
-            v.push_back(c);
+            Vector<ThrowingMove> v;
+            v.Reserve(SIZE);
+            for (int i = 0; i < 4; ++i) {
+                v.EmplaceBack(i);
+            }
+            ThrowingMove value(ID);
+            value.throw_on_move = true;
+            try {
+                v.Insert(v.cbegin() + 1, 2, value);
+                assert(false && "Exception is expected");
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 4);
         }
-        Dump();
+        assert(Obj::GetAliveObjectCount() == 0);
     }
-    catch (...) {
+    {
+        std::istringstream input("1 2 3");
+        Vector<int> v(2);
+        v.Insert(v.cbegin() + 1, std::istream_iterator<int>(input), std::istream_iterator<int>());
+        assert(v.Size() == 5);
+        assert(v[0] == 0 && v[1] == 1 && v[2] == 2 && v[3] == 3 && v[4] == 0);
     }
-    try {
-        const size_t NUM = 10;
-        C c;
+    {
+        Vector<int> v(SIZE);
+        v.ResizeUninitialized(SIZE * 2);
+        assert(v.Size() == SIZE * 2);
+        assert(v[SIZE - 1] == 0);
+        v.ResizeUninitialized(1);
+        assert(v.Size() == 1);
+    }
+}
+
+void Test13() {
+    const size_t SIZE = 10;
+    {
+        Obj::ResetCounters();
+        Vector<Obj> v(SIZE);
+        for (size_t i = 0; i < SIZE; ++i) {
+            v[i].id = static_cast<int>(i);
+        }
+        auto pos = v.Erase(v.cbegin() + 2, v.cbegin() + 5);
+        assert(pos == v.begin() + 2);
+        assert(v.Size() == SIZE - 3);
+        assert(v[1].id == 1 && v[2].id == 5 && v.Back().id == static_cast<int>(SIZE - 1));
+        assert(Obj::num_move_assigned == SIZE - 5);
+        assert(Obj::GetAliveObjectCount() == SIZE - 3);
+
+        pos = v.EraseUnordered(v.cbegin());
+        assert(pos->id == static_cast<int>(SIZE - 1));
+        assert(v.Size() == SIZE - 4);
+        v.EraseUnordered(v.cbegin() + v.Size() - 1);
+        assert(v.Size() == SIZE - 5);
+        assert(v.Back().id == static_cast<int>(SIZE - 3));
+
+        const size_t erased = v.EraseIf([](const Obj& obj) {
+            return obj.id < 6;
+            });
+        assert(erased == 2);
+        assert(v.Size() == 3);
+        assert(v[0].id == 9 && v[1].id == 6 && v[2].id == 7);
+        assert(Obj::GetAliveObjectCount() == 3);
+        v.Erase(v.cbegin(), v.cend());
+        assert(v.Size() == 0);
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+    {
+        Vector<std::unique_ptr<int>> v;
+        for (int i = 0; i < static_cast<int>(SIZE); ++i) {
+            v.PushBack(std::make_unique<int>(i));
+        }
+        v.Erase(v.cbegin() + 1, v.cbegin() + 3);
+        assert(v.Size() == SIZE - 2);
+        assert(*v[0] == 0 && *v[1] == 3);
+        v.EraseUnordered(v.cbegin());
+        assert(*v[0] == static_cast<int>(SIZE - 1));
+        v.EraseIf([](const std::unique_ptr<int>& p) {
+            return *p > 5;
+            });
+        assert(v.Size() == 3);
+        assert(*v[0] == 3 && *v[1] == 4 && *v[2] == 5);
+    }
+    {
+        // An empty range leaves the elements after it as they were
+        Vector<std::string> v;
+        v.PushBack("a");
+        v.PushBack("b");
+        v.PushBack("c");
+        auto pos = v.Erase(v.cbegin() + 1, v.cbegin() + 1);
+        assert(pos == v.begin() + 1);
+        assert(v.Size() == 3 && v[0] == "a" && v[1] == "b" && v[2] == "c");
+        v.Erase(v.cend(), v.cend());
+        assert(v.Size() == 3 && v[2] == "c");
+    }
+}
+
+void Test14() {
+    {
+        VectorStats stats;
+        stats.OnAllocate(64);
+        stats.OnAllocate(32);
+        stats.OnRelocate(4, 16);
+        assert(stats.allocations == 2);
+        assert(stats.allocated_bytes == 96);
+        assert(stats.peak_capacity_bytes == 64);
+        assert(stats.relocations == 1);
+        assert(stats.relocated_elements == 4);
+        assert(stats.relocated_bytes == 16);
+    }
+#if defined(VECTOR_ENABLE_STATS)
+    {
+        VectorStatsRegistry& registry = VectorStatsRegistry::Instance();
+        registry.Reset();
+        const std::string tag = CallSiteTag();
         {
-            cerr << "Vector:"sv << endl;
-            C::Reset();
-            Vector<C> v(NUM);
-            Dump();
-            v.PushBack(c);
+            Vector<int> v;
+            v.SetStatsTag(tag);
+            for (int i = 0; i < 5; ++i) {
+                v.PushBack(i);
+            }
+            const Vector<int> v_copy(v);
+        }
+
+        const VectorStats& stats = registry.Get(tag);
+        assert(stats.allocations == 5);
+        assert(stats.relocations == 4);
+        assert(stats.relocated_elements == 0 + 1 + 2 + 4);
+        assert(stats.peak_capacity_bytes == 8 * sizeof(int));
+
+        std::ostringstream out;
+        registry.Dump(out);
+        assert(out.str().find("vector_allocations_total{tag=\"" + tag + "\"} 5\n") != std::string::npos);
+    }
+#endif
+}
+
+void Test15() {
+    const size_t SIZE = 10;
+    {
+        CountingAllocator<int>::ResetCounters();
+        Vector<int, CountingAllocator<int>> v(SIZE);
+        for (size_t i = 0; i < SIZE; ++i) {
+            assert(v[i] == 0);
         }
-        Dump();
+        Vector<int, CountingAllocator<int>> rhs(SIZE * 2);
+        rhs[SIZE] = 42;
+        v[0] = 5;
+        CountingAllocator<int>::ResetCounters();
+
+        // A failed allocation leaves the vector as it was
+        CountingAllocator<int>::fail_next = true;
+        try {
+            v = rhs;
+            assert(false);
+        }
+        catch (const std::bad_alloc&) {
+        }
+        assert(v.Size() == SIZE && v.Capacity() == SIZE && v[0] == 5);
+
+        v = rhs;
+        assert(v.Size() == SIZE * 2);
+        assert(v[SIZE] == 42);
+        assert(CountingAllocator<int>::num_allocations == 1);
+        assert(CountingAllocator<int>::num_deallocations == 1);
+        // The new buffer is allocated before the old one is released
+        assert(CountingAllocator<int>::peak_live == 1);
+
+        rhs.Resize(SIZE);
+        rhs[0] = 7;
+        v = rhs;
+        assert(v.Size() == SIZE);
+        assert(v.Capacity() == SIZE * 2);
+        assert(v[0] == 7);
+        assert(CountingAllocator<int>::num_allocations == 1);
+
+        v.Resize(SIZE * 2);
+        assert(v[SIZE] == 0 && v.Back() == 0);
     }
-    catch (...) {
+    {
+        Vector<int*> v(SIZE);
+        assert(v[SIZE - 1] == nullptr);
+        const Vector<int*> v_copy(v);
+        assert(v_copy.Size() == SIZE && v_copy[0] == nullptr);
     }
 }
 
+void Test16() {
+    const size_t SIZE = 1'000'000;
+    {
+        Vector<float, AlignedAllocator<float, 64>> v;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<float>(i));
+            assert(reinterpret_cast<uintptr_t>(v.Data()) % 64 == 0);
+        }
+        assert(v[SIZE - 1] == static_cast<float>(SIZE - 1));
+        static_assert(std::is_same_v<std::allocator_traits<AlignedAllocator<float, 64>>::rebind_alloc<double>,
+                                     AlignedAllocator<double, 64>>);
+    }
+    {
+        using Allocator = HugePageAllocator<int, 4096>;
+        static_assert(HasReallocate<Allocator>::value && HasAllocateAtLeast<Allocator>::value);
+
+        Vector<int, Allocator> v;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<int>(i));
+        }
+        assert(reinterpret_cast<uintptr_t>(v.Data()) % 4096 == 0);
+        assert(v.Capacity() * sizeof(int) % Allocator::kHugePageSize == 0);
+        for (size_t i = 0; i < SIZE; i += 997) {
+            assert(v[i] == static_cast<int>(i));
+        }
+
+        v.Reserve(SIZE * 8);
+        assert(v[SIZE - 1] == static_cast<int>(SIZE - 1));
+
+        Vector<int, Allocator> v_copy(v);
+        v_copy.Resize(10);
+        assert(v_copy.Size() == 10 && v_copy[9] == 9);
+    }
+    {
+        // Works whether or not huge pages are reserved on the machine
+        Vector<int, HugePageAllocator<int>> v;
+        Vector<int, HugePageAllocator<int, 4096, HugePages::Reserve>> v_reserved;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<int>(i));
+            v_reserved.PushBack(static_cast<int>(i));
+        }
+        assert(v[SIZE - 1] == static_cast<int>(SIZE - 1));
+        assert(v_reserved[SIZE - 1] == static_cast<int>(SIZE - 1));
+    }
+    {
+        // Byte counts past size_t throw instead of wrapping to a small buffer
+        const size_t too_many = std::numeric_limits<size_t>::max() / sizeof(double) + 1;
+        Vector<double, AlignedAllocator<double, 64>> aligned;
+        Vector<double, HugePageAllocator<double>> huge;
+        try {
+            aligned.Reserve(too_many);
+            assert(false);
+        }
+        catch (const std::bad_array_new_length&) {
+        }
+        try {
+            huge.Reserve(too_many);
+            assert(false);
+        }
+        catch (const std::bad_array_new_length&) {
+        }
+        assert(aligned.Capacity() == 0 && huge.Capacity() == 0);
+    }
+}
+
+void Test17() {
+    const size_t SIZE = 100'000;
+    const std::string path = (std::filesystem::temp_directory_path() / "vector_test17.bin").string();
+    std::filesystem::remove(path);
+
+    struct Record {
+        int id;
+        double value;
+    };
+    {
+        MappedVector<Record> v(path);
+        assert(v.Size() == 0 && v.Capacity() == 0);
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack({ static_cast<int>(i), i * 0.5 });
+        }
+        v.EmplaceBack(v[0]);
+        assert(v.Size() == SIZE + 1);
+        assert(v.Back().id == 0);
+        assert(reinterpret_cast<uintptr_t>(v.begin()) % alignof(Record) == 0);
+        v.PopBack();
+        v.Sync();
+    }
+    {
+        MappedVector<Record> v(path);
+        assert(v.Size() == SIZE);
+        assert(v[SIZE - 1].id == static_cast<int>(SIZE - 1) && v[SIZE - 1].value == (SIZE - 1) * 0.5);
+        v.Resize(SIZE * 2);
+        assert(v[SIZE * 2 - 1].id == 0);
+        v.Resize(SIZE + 1);
+    }
+    {
+        const MappedVector<Record> v(path, MapMode::ReadOnly);
+        const MappedVector<Record> other(path, MapMode::ReadOnly);
+        assert(v.IsReadOnly());
+        assert(v.Size() == SIZE + 1 && other.Size() == SIZE + 1);
+        assert(v[SIZE / 2].id == static_cast<int>(SIZE / 2));
+        assert(v.Capacity() >= SIZE * 2);
+    }
+    {
+        try {
+            MappedVector<int> v(path);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+
+        try {
+            MappedVector<int> v(path + ".missing", MapMode::ReadOnly);
+            assert(false);
+        }
+        catch (const std::system_error& e) {
+            assert(e.code() == std::errc::no_such_file_or_directory);
+        }
+    }
+    {
+        // A capacity whose byte length wraps is rejected before the file is touched
+        const std::string small_path = path + ".small";
+        std::filesystem::remove(small_path);
+        MappedVector<int> v(small_path);
+        v.PushBack(42);
+        const size_t capacity = v.Capacity();
+        try {
+            v.Reserve(std::numeric_limits<size_t>::max() / sizeof(int) + 2);
+            assert(false);
+        }
+        catch (const std::length_error&) {
+        }
+        assert(v.Size() == 1 && v.Capacity() == capacity && v[0] == 42);
+        std::filesystem::remove(small_path);
+    }
+    std::filesystem::remove(path);
+}
+
+void Test18() {
+    const size_t SIZE = 100'000;
+    Vector<int> source;
+    for (size_t i = 0; i < SIZE; ++i) {
+        source.PushBack(static_cast<int>(i));
+    }
+    {
+        std::stringstream stream;
+        WriteTo(stream, source);
+        Vector<int> v(3);
+        ReadFrom(stream, v);
+        assert(v.Size() == SIZE);
+        assert(std::equal(v.begin(), v.end(), source.begin()));
+    }
+    {
+        FILE* file = std::tmpfile();
+        const int fd = fileno(file);
+        WriteTo(fd, source);
+        {
+            ChunkedWriter<int> writer(fd);
+            writer.Write(std::span<const int>(source.begin(), 10));
+            writer.Write(std::span<const int>(source.begin() + 10, SIZE - 10));
+            writer.Finish();
+        }
+        lseek(fd, 0, SEEK_SET);
+
+        Vector<int> v;
+        ReadFrom(fd, v);
+        assert(std::equal(v.begin(), v.end(), source.begin(), source.end()));
+        ReadFrom(fd, v);
+        assert(std::equal(v.begin(), v.end(), source.begin(), source.end()));
+        std::fclose(file);
+    }
+    {
+        // A stream written on a machine of the other byte order
+        StreamHeader header = detail::MakeStreamHeader<uint32_t>(0, 2);
+        header.byte_order = detail::ByteSwap(header.byte_order);
+        header.version = detail::ByteSwap(header.version);
+        header.element_size = detail::ByteSwap(header.element_size);
+        header.count = detail::ByteSwap(header.count);
+        const uint32_t elements[2] = { detail::ByteSwap(uint32_t{ 1 }), detail::ByteSwap(uint32_t{ 0xAABBCCDD }) };
+
+        std::stringstream stream;
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(elements), sizeof(elements));
+
+        Vector<uint32_t> v;
+        ReadFrom(stream, v);
+        assert(v.Size() == 2 && v[0] == 1 && v[1] == 0xAABBCCDD);
+    }
+    {
+        std::stringstream stream;
+        WriteTo(stream, source);
+        const std::string bytes = stream.str();
+
+        Vector<short> shorts;
+        try {
+            ReadFrom(stream, shorts);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+
+        std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+        Vector<int> v(3);
+        try {
+            ReadFrom(truncated, v);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 3);
+    }
+    {
+        // Headers claiming more elements than the stream holds or than a vector can hold
+        auto read_header = [](auto& source, uint64_t count, const void* body, size_t body_size) {
+            const StreamHeader header = detail::MakeStreamHeader<int>(0, count);
+            source.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            source.write(static_cast<const char*>(body), static_cast<std::streamsize>(body_size));
+            Vector<int> v(3);
+            try {
+                ReadFrom(source, v);
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 3);
+        };
+        const int elements[2] = { 1, 2 };
+        std::stringstream oversized;
+        read_header(oversized, uint64_t{ 1 } << 40, elements, sizeof(elements));
+        std::stringstream overflowing;
+        read_header(overflowing, std::numeric_limits<uint64_t>::max() / sizeof(int) + 2, elements, sizeof(elements));
+
+        // A pipe doesn't tell its size, so the elements are read until it ends
+        int fds[2];
+        const int piped = pipe(fds);
+        assert(piped == 0);
+        const StreamHeader header = detail::MakeStreamHeader<int>(0, uint64_t{ 1 } << 40);
+        const ssize_t header_written = write(fds[1], &header, sizeof(header));
+        assert(header_written == sizeof(header));
+        const ssize_t elements_written = write(fds[1], elements, sizeof(elements));
+        assert(elements_written == sizeof(elements));
+        close(fds[1]);
+        Vector<int> v(3);
+        try {
+            ReadFrom(fds[0], v);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 3);
+        close(fds[0]);
+    }
+    {
+        // Many small chunks grow the vector geometrically
+        std::stringstream stream;
+        ChunkedWriter<int> writer(stream);
+        for (size_t i = 0; i < SIZE; i += 10) {
+            writer.Write(std::span<const int>(source.begin() + i, 10));
+        }
+        writer.Finish();
+
+        Vector<int, CountingAllocator<int>> v;
+        CountingAllocator<int>::ResetCounters();
+        ReadFrom(stream, v);
+        assert(std::equal(v.begin(), v.end(), source.begin(), source.end()));
+        assert(CountingAllocator<int>::num_allocations < 40);
+    }
+}
+
+void Test19() {
+    const size_t SIZE = 1'000'000;
+    try {
+        ThreadPool empty(0);
+        assert(false);
+    }
+    catch (const std::invalid_argument&) {
+    }
+    ThreadPool pool(4);
+    const ParallelOptions options{ 1000, &pool };
+    {
+        Vector<int> v;
+        ParallelResize(v, SIZE, options);
+        assert(v.Size() == SIZE && v[SIZE - 1] == 0);
+
+        ParallelForEach(v, [](int& value) {
+            value = 1;
+        }, options);
+        assert(std::count(v.begin(), v.end(), 1) == static_cast<ptrdiff_t>(SIZE));
+
+        Vector<int64_t> squares(SIZE);
+        for (size_t i = 0; i < SIZE; ++i) {
+            v[i] = static_cast<int>(i);
+        }
+        ParallelTransform(v, squares, [](int value) {
+            return int64_t{ value } * value;
+        }, options);
+        assert(squares[SIZE - 1] == int64_t{ SIZE - 1 } * (SIZE - 1));
+
+        const int64_t sum = ParallelReduce(v, int64_t{ 0 }, std::plus<>(), options);
+        assert(sum == int64_t{ SIZE } * (SIZE - 1) / 2);
+
+        const Vector<int> v_copy = ParallelCopy(v, options);
+        assert(std::equal(v.begin(), v.end(), v_copy.begin(), v_copy.end()));
+    }
+    {
+        // Not commutative: the chunk results must be combined in order
+        Vector<std::string> words;
+        for (size_t i = 0; i < 5000; ++i) {
+            words.PushBack(std::string(1, static_cast<char>('a' + i % 26)));
+        }
+        const std::string joined = ParallelReduce(words, std::string(), std::plus<>(), { 100, &pool });
+        assert(joined.size() == 5000 && joined.substr(0, 3) == "abc" && joined.substr(26, 2) == "ab");
+    }
+    {
+        Vector<int> v;
+        for (size_t i = 0; i < SIZE; ++i) {
+            v.PushBack(static_cast<int>((i * 7919) % SIZE));
+        }
+        ParallelSort(v, std::greater<>(), options);
+        assert(std::is_sorted(v.begin(), v.end(), std::greater<>()));
+        assert(v[0] == static_cast<int>(SIZE - 1) && v[SIZE - 1] == 0);
+
+        ParallelSort(v);
+        assert(std::is_sorted(v.begin(), v.end()));
+    }
+    {
+        Vector<int> v(SIZE);
+        try {
+            ParallelForEach(v, [](int& value) {
+                if (value == 0) {
+                    throw std::runtime_error("Oops");
+                }
+            }, options);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+    }
+}
+
+template <typename T>
+void TestSimdKernels() {
+    const size_t SIZE = 1003;
+    Vector<T> a(SIZE);
+    Vector<T> b(SIZE);
+    Vector<bool> keep(SIZE);
+    for (size_t i = 0; i < SIZE; ++i) {
+        a[i] = static_cast<T>(10 + i % 100);
+        b[i] = static_cast<T>(i % 7);
+        keep[i] = i % 3 == 0;
+    }
+    a[SIZE / 2] = static_cast<T>(3);
+    a[SIZE - 1] = static_cast<T>(1000);
+
+    const simd::Isa detected = simd::DetectIsa();
+    for (simd::Isa isa : { simd::Isa::Scalar, simd::Isa::Neon, simd::Isa::Sse42, simd::Isa::Avx2, simd::Isa::Avx512 }) {
+        if (!simd::IsSupported(isa)) continue;
+        simd::SetIsa(isa);
+
+        assert(simd::Find(a, static_cast<T>(42)) == a.begin() + 32);
+        assert(simd::Find(a, static_cast<T>(1000)) == a.begin() + SIZE - 1);
+        assert(simd::Find(a, static_cast<T>(111)) == a.end());
+        assert(simd::Count(a, static_cast<T>(42)) == static_cast<size_t>(std::count(a.begin(), a.end(), static_cast<T>(42))));
+        assert(simd::Min(a) == static_cast<T>(3));
+        assert(simd::Max(a) == static_cast<T>(1000));
+        assert(simd::Sum(a) == std::accumulate(a.begin(), a.end(), T{}));
+        assert(simd::Dot(a, b) == std::inner_product(a.begin(), a.end(), b.begin(), T{}));
+
+        Vector<T> out(SIZE);
+        simd::Add(a, b, out);
+        assert(out[SIZE - 1] == a[SIZE - 1] + b[SIZE - 1]);
+        simd::Mul(a, b, out);
+        assert(out[10] == a[10] * b[10]);
+        simd::Fma(a, b, b, out);
+        assert(out[SIZE - 2] == a[SIZE - 2] * b[SIZE - 2] + b[SIZE - 2]);
+
+        simd::Fill(out, static_cast<T>(3));
+        assert(simd::Count(out, static_cast<T>(3)) == SIZE);
+
+        const size_t kept = simd::Compact(a, keep, out);
+        assert(kept == (SIZE + 2) / 3);
+        for (size_t i = 0; i < kept; ++i) {
+            assert(out[i] == a[i * 3]);
+        }
+        Vector<T> in_place(a);
+        const size_t kept_in_place = simd::Compact(in_place, keep, in_place);
+        assert(kept_in_place == kept);
+        assert(std::equal(in_place.begin(), in_place.begin() + kept, out.begin()));
+    }
+    simd::SetIsa(detected);
+}
+
+void Test20() {
+    TestSimdKernels<float>();
+    TestSimdKernels<double>();
+    TestSimdKernels<int32_t>();
+    TestSimdKernels<int64_t>();
+    TestSimdKernels<uint32_t>();
+}
+
+void Test21() {
+    const size_t NUM_THREADS = 4;
+    const size_t SIZE = 20'000;
+    {
+        ConcurrentVector<int> v;
+        assert(v.Size() == 0 && v.Capacity() == 0);
+
+        std::atomic<bool> done{ false };
+        std::thread reader([&] {
+            int64_t sum = 0;
+            size_t next = 0;
+            while (!done.load()) {
+                next = v.ForEachReady(next, [&](int value) {
+                    sum += value;
+                });
+            }
+            assert(next <= NUM_THREADS * SIZE + 1);
+        });
+
+        Vector<std::thread> writers;
+        for (size_t t = 0; t < NUM_THREADS; ++t) {
+            writers.EmplaceBack([&v, t] {
+                for (size_t i = 0; i < SIZE; ++i) {
+                    v.PushBack(static_cast<int>(t * SIZE + i));
+                }
+            });
+        }
+        // Stays valid while the writers append
+        const int& first = v.EmplaceBack(-1);
+        for (std::thread& writer : writers) {
+            writer.join();
+        }
+        done = true;
+        reader.join();
+
+        assert(first == -1);
+        assert(v.Size() == NUM_THREADS * SIZE + 1);
+        assert(v.Capacity() >= v.Size());
+
+        Vector<int> values;
+        const size_t scanned = v.ForEachReady(0, [&](int value) {
+            values.PushBack(value);
+        });
+        assert(scanned == v.Size());
+        std::sort(values.begin(), values.end());
+        assert(values[0] == -1);
+        for (size_t i = 0; i < NUM_THREADS * SIZE; ++i) {
+            assert(values[i + 1] == static_cast<int>(i));
+        }
+    }
+    {
+        Obj::ResetCounters();
+        {
+            ConcurrentVector<Obj> v;
+            v.Reserve(100);
+            assert(v.Capacity() >= 100);
+            v.EmplaceBack(1);
+            Obj::default_construction_throw_countdown = 1;
+            try {
+                v.EmplaceBack();
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            v.EmplaceBack(3);
+
+            assert(v.Size() == 3);
+            assert(v.IsReady(0) && !v.IsReady(1) && v.IsReady(2));
+            assert(v[2].id == 3);
+            int count = 0;
+            const size_t scanned = v.ForEachReady(0, [&](const Obj&) {
+                ++count;
+            });
+            assert(scanned == 3);
+            assert(count == 2);
+        }
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+}
+
+void Test22() {
+    {
+        // The growth policy gets the size of a row, 12 bytes here
+        BasicSoAVector<MinBytesGrowth<OneAndHalfGrowth>, float, float, int> v;
+        v.PushBack(1.0f, 2.0f, 3);
+        assert(v.Capacity() == 6);
+        for (int i = 0; i < 6; ++i) {
+            v.PushBack(0.0f, 0.0f, i);
+        }
+        assert(v.Capacity() == 9 && std::get<2>(v.Back()) == 5);
+    }
+    {
+        SoAVector<float, float, int> v;
+        assert(v.Size() == 0 && v.Capacity() == 0);
+        for (int i = 0; i < 100; ++i) {
+            v.PushBack(static_cast<float>(i), static_cast<float>(2 * i), i);
+        }
+        assert(v.Size() == 100 && v.Capacity() >= 100);
+
+        auto [x, y, id] = v[10];
+        assert(x == 10.0f && y == 20.0f && id == 10);
+        x = -1.0f;
+        assert(v.Column<0>()[10] == -1.0f);
+        assert(v.Column<2>().size() == 100);
+        assert(std::accumulate(v.Column<2>().begin(), v.Column<2>().end(), 0) == 4950);
+
+        // The argument refers to the vector which reallocates while the row is added
+        SoAVector<float, float, int> full(v);
+        assert(full.Size() == full.Capacity());
+        full.EmplaceBack(full.Column<0>()[0], std::get<1>(full[1]), std::get<2>(full.Back()));
+        assert(full.Capacity() > 100);
+        assert(std::get<0>(full.Back()) == 0.0f);
+        assert(std::get<1>(full.Back()) == 2.0f && std::get<2>(full.Back()) == 99);
+
+        auto it = v.Erase(v.begin() + 10);
+        assert(it == v.begin() + 10 && v.Size() == 99);
+        assert(std::get<2>(*it) == 11);
+
+        int sum = 0;
+        for (auto [row_x, row_y, row_id] : v) {
+            assert(row_y == 2.0f * static_cast<float>(row_id));
+            sum += row_id;
+        }
+        assert(sum == 4950 - 10);
+
+        const SoAVector<float, float, int> copy(v);
+        assert(copy.Size() == v.Size() && copy.cend() - copy.cbegin() == 99);
+        assert(std::equal(copy.Column<2>().begin(), copy.Column<2>().end(), v.Column<2>().begin()));
+
+        v.Resize(5);
+        assert(v.Size() == 5 && std::get<2>(v.Back()) == 4);
+        v.Resize(8);
+        assert(std::get<0>(v[7]) == 0.0f && std::get<2>(v[7]) == 0);
+        v.PopBack();
+        assert(v.Size() == 7);
+    }
+    {
+        struct ThrowingMove {
+            ThrowingMove() = default;
+            explicit ThrowingMove(int id)
+                : obj(id) {
+            }
+            ThrowingMove(const ThrowingMove&) = default;
+            ThrowingMove(ThrowingMove&& other)
+                : obj(other.obj) {
+            }
+            Obj obj;
+        };
+
+        Obj::ResetCounters();
+        {
+            SoAVector<std::string, Obj, ThrowingMove> v;
+            v.Reserve(4);
+            for (int i = 0; i < 4; ++i) {
+                v.EmplaceBack(std::string(40, 'a'), i, i);
+            }
+
+            // The copy of the last column throws, so neither column may have been moved
+            std::get<2>(v[2]).obj.throw_on_copy = true;
+            try {
+                v.EmplaceBack("b", 4, 4);
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 4 && v.Capacity() == 4);
+            for (int i = 0; i < 4; ++i) {
+                auto [name, obj, wrapped] = v[i];
+                assert(name == std::string(40, 'a') && obj.id == i && wrapped.obj.id == i);
+            }
+            assert(Obj::GetAliveObjectCount() == 8);
+
+            try {
+                v.Resize(10);
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 4 && Obj::GetAliveObjectCount() == 8);
+
+            // The default constructor throws for the third column, after the first two have been resized
+            std::get<2>(v[2]).obj.throw_on_copy = false;
+            Obj::default_construction_throw_countdown = 6 + 3;
+            try {
+                v.Resize(10);
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 4 && v.Capacity() == 10 && Obj::GetAliveObjectCount() == 8);
+
+            // A failure of a later column destroys the fields already constructed for the row
+            Obj thrower(7);
+            thrower.throw_on_copy = true;
+            try {
+                v.PushBack("c", thrower, ThrowingMove(5));
+                assert(false);
+            }
+            catch (const std::runtime_error&) {
+            }
+            assert(v.Size() == 4);
+
+            v.EmplaceBack("d", 5, 5);
+            assert(v.Size() == 5 && std::get<1>(v.Back()).id == 5);
+        }
+        assert(Obj::GetAliveObjectCount() == 0);
+    }
+}
+
+#if VECTOR_HARDENING_MODE > 0
+// Runs f in a child process and tells whether a failed check killed it
+template <typename Function>
+bool Traps(Function f) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        f();
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status);
+}
+#endif
+
+void Test23() {
+    {
+        Vector<int> v(3);
+        v.At(2) = 5;
+        assert(std::as_const(v).At(2) == 5);
+        try {
+            v.At(3);
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+        assert(v.Data() == &v[0]);
+    }
+#if VECTOR_HARDENING_MODE > 0
+    {
+        Vector<int> v(3);
+        assert(!Traps([&] {
+            v[2] = 1;
+        }));
+        assert(Traps([&] {
+            v[3] = 1;
+        }));
+        assert(Traps([&] {
+            Vector<int> empty;
+            empty.PopBack();
+        }));
+        assert(Traps([&] {
+            Vector<int> other(3);
+            v.Erase(other.begin());
+        }));
+        assert(Traps([&] {
+            SmallVector<int, 4> small;
+            small[0] = 1;
+        }));
+        assert(Traps([] {
+            const CowVector<int> empty;
+            return empty[0];
+        }));
+        assert(Traps([] {
+            const CowVector<int> empty;
+            return empty.Back();
+        }));
+        assert(Traps([&] {
+            ConcurrentVector<int> concurrent;
+            concurrent.PushBack(1);
+            concurrent[1] = 2;
+        }));
+
+        const std::string path = (std::filesystem::temp_directory_path() / "vector_test23.bin").string();
+        {
+            MappedVector<int> mapped(path);
+            mapped.PushBack(1);
+        }
+        assert(Traps([&] {
+            MappedVector<int> mapped(path, MapMode::ReadOnly);
+            mapped.PushBack(2);
+        }));
+        std::filesystem::remove(path);
+    }
+#endif
+#if VECTOR_HARDENING_MODE >= 2
+    {
+        Vector<int> v(3);
+        static_assert(std::contiguous_iterator<Vector<int>::iterator>);
+
+        auto it = v.begin();
+        *it = 1;
+        // The iterator still points to the old buffer after the reallocation
+        assert(Traps([&] {
+            v.Reserve(100);
+            *it = 2;
+        }));
+        assert(Traps([&] {
+            v.PushBack(4);
+            v.Erase(it);
+        }));
+        assert(Traps([&] {
+            *v.end() = 1;
+        }));
+        Vector<int>::const_iterator cit = v.begin();
+        assert(cit == v.cbegin() && v.end() - cit == 3);
+    }
+#endif
+}
+
+// Tables built with Vector during constant evaluation
+constexpr Vector<uint32_t> MakeCrcTable() {
+    Vector<uint32_t> table;
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) != 0 ? 0xEDB8'8320u : 0);
+        }
+        table.PushBack(crc);
+    }
+    return table;
+}
+
+constexpr Vector<int> MakePrimes(int limit) {
+    Vector<int> primes;
+    for (int n = 2; n < limit; ++n) {
+        bool prime = true;
+        for (int p : primes) {
+            prime = prime && n % p != 0;
+        }
+        if (prime) {
+            primes.EmplaceBack(n);
+        }
+    }
+    return primes;
+}
+
+constexpr bool EditAtCompileTime() {
+    Vector<std::string> v(3);
+    v[0] = "a";
+    v.PushBack("tail");
+    v.Emplace(v.cbegin() + 1, 4, 'b');
+    v.Insert(v.cbegin(), 2, "head");
+    v.Erase(v.cbegin() + 1, v.cbegin() + 3);
+
+    Vector<std::string> copy(v);
+    copy.EraseIf([](const std::string& s) {
+        return s.empty();
+    });
+    v = std::move(copy);
+    v.Resize(5);
+
+    return v.Size() == 5 && v[0] == "head" && v[1] == "bbbb" && v[2] == "tail" && v[4].empty();
+}
+
+// Elements relocated by their bytes are built and destroyed once each during constant evaluation too
+constexpr bool BalanceAtCompileTime() {
+    Tally tally;
+    {
+        Vector<Tallied> v;
+        v.Reserve(4);
+        v.EmplaceBack(tally, 1);
+        v.EmplaceBack(tally, 3);
+        v.Emplace(v.cbegin() + 1, tally, 2);
+        v.Emplace(v.cbegin(), tally, 0);
+        for (int i = 0; i < 4; ++i) {
+            if (v[i].value != i) return false;
+        }
+    }
+    return tally.constructed == tally.destroyed;
+}
+
+void Test24() {
+    static constexpr auto CRC_TABLE = ToStaticArray([] {
+        return MakeCrcTable();
+    });
+    static_assert(CRC_TABLE.size() == 256 && CRC_TABLE[1] == 0x7707'3096u && CRC_TABLE[255] == 0x2D02'EF8Du);
+
+    constexpr auto PRIMES = ToStaticArray([] {
+        return MakePrimes(100);
+    });
+    static_assert(PRIMES.size() == 25 && PRIMES[0] == 2 && PRIMES[24] == 97);
+    static_assert(EditAtCompileTime());
+    static_assert(BalanceAtCompileTime());
+
+    // The same functions still run at run time
+    assert(MakeCrcTable()[255] == CRC_TABLE[255]);
+    assert(MakePrimes(100).Size() == PRIMES.size());
+    assert(EditAtCompileTime());
+    assert(BalanceAtCompileTime());
+}
+
+void Test25() {
+    {
+        Obj::ResetCounters();
+        Vector<Obj> v(100);
+        v.Resize(10);
+        assert(v.Capacity() == 100);
+        v.ShrinkToFit();
+        assert(v.Size() == 10 && v.Capacity() == 10);
+        v.ShrinkToFit();
+        assert(v.Capacity() == 10);
+
+        v.Clear();
+        assert(v.Size() == 0 && v.Capacity() == 10 && Obj::GetAliveObjectCount() == 0);
+        v.EmplaceBack(1);
+        v.Clear(ClearMode::ReleaseCapacity);
+        assert(v.Size() == 0 && v.Capacity() == 0 && Obj::GetAliveObjectCount() == 0);
+        v.ShrinkToFit();
+        assert(v.Capacity() == 0);
+    }
+    {
+        // A copy that throws leaves the vector as it was
+        Obj::ResetCounters();
+        struct CopyOnly {
+            explicit CopyOnly(int id)
+                : obj(id) {
+            }
+            CopyOnly(const CopyOnly&) = default;
+            Obj obj;
+        };
+
+        Vector<CopyOnly> v;
+        v.Reserve(8);
+        for (int i = 0; i < 4; ++i) {
+            v.EmplaceBack(i);
+        }
+        v[2].obj.throw_on_copy = true;
+        try {
+            v.ShrinkToFit();
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 4 && v.Capacity() == 8 && v[3].obj.id == 3);
+    }
+    {
+        using Allocator = CountingAllocator<int>;
+        using Policy = ShrinkingGrowth<DoublingGrowth, 4, 64>;
+        static_assert(HasShrinkCapacity<Policy>::value && !HasShrinkCapacity<DoublingGrowth>::value);
+
+        Allocator::ResetCounters();
+        Vector<int, Allocator, Policy> v;
+        for (int i = 0; i < 1024; ++i) {
+            v.PushBack(i);
+        }
+        assert(v.Capacity() == 1024);
+
+        const int allocations = Allocator::num_allocations;
+        while (v.Size() > 256) {
+            v.PopBack();
+        }
+        assert(v.Capacity() == 1024 && Allocator::num_allocations == allocations);
+
+        // Below a quarter of the capacity the vector shrinks to twice its size
+        v.PopBack();
+        assert(v.Size() == 255 && v.Capacity() == 510 && Allocator::num_allocations == allocations + 1);
+        assert(v[254] == 254);
+
+        // and doesn't reallocate again while its size moves around the threshold
+        for (int i = 0; i < 10; ++i) {
+            v.PushBack(i);
+            v.PopBack();
+        }
+        assert(v.Capacity() == 510 && Allocator::num_allocations == allocations + 1);
+
+        auto it = v.Erase(v.begin() + 1, v.begin() + 200);
+        assert(v.Size() == 56 && v.Capacity() == 112 && *it == 200);
+        v.EraseIf([](int value) {
+            return value > 20;
+        });
+        assert(v.Size() == 1 && v.Capacity() == 16);
+        v.Resize(0);
+        assert(v.Capacity() == 16);
+    }
+    assert(CountingAllocator<int>::num_allocations == CountingAllocator<int>::num_deallocations);
+}
+
+void Test26() {
+    {
+        Obj::ResetCounters();
+        Vector<Obj> source;
+        for (int i = 0; i < 8; ++i) {
+            source.EmplaceBack(i);
+        }
+        CowVector<Obj> v(std::move(source));
+        assert(v.Size() == 8 && v.UseCount() == 1 && Obj::num_copied == 0);
+
+        // Copies share the elements, and reading them copies nothing
+        CowVector<Obj> a = v;
+        const CowVector<Obj> b = a;
+        assert(v.UseCount() == 3 && b.IsShared() && b.Data() == v.Data());
+        int sum = 0;
+        for (const Obj& obj : b) {
+            sum += obj.id;
+        }
+        assert(sum == 28 && std::as_const(a)[7].id == 7 && Obj::num_copied == 0);
+
+        // The first modification copies the elements once
+        a.PushBack(Obj(8));
+        assert(Obj::num_copied == 8 && a.Size() == 9 && a.UseCount() == 1 && v.UseCount() == 2);
+        a.PopBack();
+        a.Erase(a.cbegin());
+        assert(Obj::num_copied == 8 && a.Size() == 7 && a[0].id == 1 && std::as_const(v)[0].id == 0);
+
+        // A mutable reference makes the block private until Freeze()
+        CowVector<Obj> c = a;
+        assert(Obj::num_copied == 15 && c.UseCount() == 1);
+        a.Freeze();
+        CowVector<Obj> d = a;
+        CowVector<Obj> e = a.Snapshot();
+        assert(Obj::num_copied == 15 && a.UseCount() == 3);
+
+        e.Resize(2);
+        e.Emplace(e.cbegin() + 1, 100);
+        assert(e.Size() == 3 && e[1].id == 100 && d.Size() == 7 && d[1].id == 2);
+
+        e.Clear();
+        a = std::move(d);
+        assert(e.Size() == 0 && a.UseCount() == 1 && d.Size() == 0);
+        d.EmplaceBack(5);
+        assert(d.Size() == 1 && d.Back().id == 5);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+    {
+        using Allocator = CountingAllocator<int>;
+        Allocator::ResetCounters();
+        {
+            CowVector<int, Allocator> v;
+            for (int i = 0; i < 100; ++i) {
+                v.PushBack(i);
+            }
+            Vector<CowVector<int, Allocator>> copies;
+            for (int i = 0; i < 15; ++i) {
+                copies.PushBack(v);
+            }
+            const int allocations = Allocator::num_allocations;
+            for (const auto& copy : copies) {
+                assert(copy.Data() == v.Data());
+            }
+            copies[3].Clear();
+            assert(v.UseCount() == 15 && copies[3].Size() == 0 && Allocator::num_allocations == allocations);
+        }
+        assert(Allocator::num_allocations == Allocator::num_deallocations);
+    }
+    {
+        // Copies of one vector are read and dropped concurrently
+        CowVector<int> v;
+        for (int i = 0; i < 1000; ++i) {
+            v.PushBack(i);
+        }
+
+        Vector<std::thread> threads;
+        std::atomic<long> total = 0;
+        for (int t = 0; t < 4; ++t) {
+            threads.EmplaceBack([snapshot = v.Snapshot(), &total]() mutable {
+                for (int round = 0; round < 100; ++round) {
+                    const CowVector<int> copy = snapshot;
+                    total += std::accumulate(copy.begin(), copy.end(), 0L);
+                }
+                snapshot.PushBack(0);
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        assert(total == 4 * 100 * 499500L && v.UseCount() == 1);
+    }
+}
+
+void Test27() {
+    {
+        // Sizes around the chunk size and the capacity of one and two trie levels
+        for (int size : { 0, 1, 31, 32, 33, 1024, 1056, 1057, 40000 }) {
+            PersistentVector<int> v;
+            for (int i = 0; i < size; ++i) {
+                v.PushBack(i);
+            }
+            assert(static_cast<int>(v.Size()) == size);
+            for (int i = 0; i < size; ++i) {
+                assert(v[i] == i);
+            }
+            assert(std::equal(v.begin(), v.end(), v.ToVector().begin()));
+            assert(v.end() - v.begin() == size && (size == 0 || *(v.begin() + (size - 1)) == size - 1));
+
+            // Backwards, starting from end(), which has no chunk of its own
+            int expected = size;
+            for (auto it = std::make_reverse_iterator(v.end()); it != std::make_reverse_iterator(v.begin()); ++it) {
+                assert(*it == --expected);
+            }
+            assert(expected == 0);
+            if (size != 0) {
+                assert(*(v.end() - 1) == size - 1 && *std::prev(v.end()) == size - 1);
+                auto it = v.end();
+                it -= size;
+                assert(*it == 0);
+            }
+
+            while (v.Size() > 0) {
+                v.PopBack();
+                assert(v.Size() == 0 || v.Back() == static_cast<int>(v.Size()) - 1);
+            }
+        }
+    }
+    {
+        // Revisions share everything but the changed paths
+        Obj::ResetCounters();
+        Vector<Obj> source;
+        for (int i = 0; i < 2000; ++i) {
+            source.EmplaceBack(i);
+        }
+        PersistentVector<Obj> v(source);
+        assert(Obj::num_copied == 2000 && v.Size() == 2000 && v[1999].id == 1999);
+
+        Vector<PersistentVector<Obj>> revisions;
+        for (int revision = 0; revision < 10; ++revision) {
+            revisions.PushBack(v);
+            v.Set(revision * 100, Obj(-revision));
+            v.PushBack(Obj(2000 + revision));
+        }
+        // At most one chunk per revision is copied on each of Set and PushBack
+        assert(Obj::num_copied <= 2000 + 10 * 2 * static_cast<int>(PersistentVector<Obj>::kChunkSize));
+
+        for (int revision = 0; revision < 10; ++revision) {
+            const PersistentVector<Obj>& old = revisions[revision];
+            assert(old.Size() == 2000u + revision);
+            assert(old[revision * 100].id == revision * 100 && (revision == 0 || old[(revision - 1) * 100].id == 1 - revision));
+        }
+        assert(v.Size() == 2010 && v[900].id == -9 && v.Back().id == 2009);
+
+        Vector<Obj> flat = v.ToVector();
+        assert(flat.Size() == 2010 && flat[100].id == -1 && flat[2005].id == 2005);
+
+        revisions.Clear();
+        while (v.Size() > 1000) {
+            v.PopBack();
+        }
+        v = PersistentVector<Obj>(std::move(flat));
+        assert(v.Size() == 2010 && v[0].id == 0);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+    {
+        // A throwing append leaves both the vector and its copies unchanged
+        Obj::ResetCounters();
+        PersistentVector<Obj> v;
+        for (int i = 0; i < 40; ++i) {
+            v.EmplaceBack(i);
+        }
+        const PersistentVector<Obj> copy = v;
+
+        Obj thrower(100);
+        thrower.throw_on_copy = true;
+        try {
+            v.PushBack(thrower);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 40 && copy.Size() == 40 && v[39].id == 39);
+
+        while (v.Size() < 64) {
+            v.EmplaceBack(static_cast<int>(v.Size()));
+        }
+        try {
+            v.PushBack(thrower);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 64 && v.Back().id == 63 && copy.Size() == 40 && copy.Back().id == 39);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+}
+
+void Test28() {
+    {
+        Obj::ResetCounters();
+        SegmentedVector<Obj> v;
+        constexpr int kBlock = static_cast<int>(SegmentedVector<Obj>::kBlockSize);
+
+        // Pushes at both ends move no element, so addresses stay valid
+        Obj& middle = v.EmplaceBack(0);
+        for (int i = 1; i <= 5 * kBlock; ++i) {
+            v.EmplaceBack(i);
+            v.EmplaceFront(-i);
+        }
+        assert(v.Size() == 10u * kBlock + 1 && Obj::num_moved == 0 && Obj::num_copied == 0);
+        assert(&v[5 * kBlock] == &middle && middle.id == 0);
+        assert(v.Front().id == -5 * kBlock && v.Back().id == 5 * kBlock);
+        for (size_t i = 0; i < v.Size(); ++i) {
+            assert(v[i].id == static_cast<int>(i) - 5 * kBlock);
+        }
+
+        int expected = -5 * kBlock;
+        size_t segments = 0;
+        v.ForEachSegment([&](std::span<const Obj> segment) {
+            assert(segment.size() <= SegmentedVector<Obj>::kBlockSize);
+            for (const Obj& obj : segment) {
+                assert(obj.id == expected++);
+            }
+            ++segments;
+        });
+        assert(expected == 5 * kBlock + 1 && segments >= 11);
+        assert(std::is_sorted(v.begin(), v.end(), [](const Obj& lhs, const Obj& rhs) {
+            return lhs.id < rhs.id;
+        }));
+
+        SegmentedVector<Obj> copy = v;
+        assert(copy.Size() == v.Size() && copy[7].id == v[7].id && &copy[7] != &v[7]);
+
+        for (int i = 0; i < 5 * kBlock; ++i) {
+            v.PopBack();
+            v.PopFront();
+        }
+        assert(v.Size() == 1 && &v.Front() == &middle);
+        v.ShrinkToFit();
+        assert(v.Capacity() == SegmentedVector<Obj>::kBlockSize && &v.Back() == &middle);
+        v.Clear();
+        v.ShrinkToFit();
+        assert(v.Size() == 0 && v.Capacity() == 0);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+    {
+        // Used as a queue, the vector reuses its blocks once it reaches its working size
+        using Allocator = CountingAllocator<int>;
+        Allocator::ResetCounters();
+        {
+            SegmentedVector<int, Allocator> queue;
+            int next = 0;
+            int expected = 0;
+            for (int i = 0; i < 3000; ++i) {
+                queue.PushBack(next++);
+            }
+            const int allocations = Allocator::num_allocations;
+            for (int round = 0; round < 100'000; ++round) {
+                queue.PushBack(next++);
+                assert(queue.Front() == expected++);
+                queue.PopFront();
+            }
+            assert(queue.Size() == 3000 && Allocator::num_allocations <= allocations + 1);
+        }
+        assert(Allocator::num_allocations == Allocator::num_deallocations);
+    }
+    {
+        // A throwing constructor leaves the vector unchanged
+        Obj::ResetCounters();
+        SegmentedVector<Obj> v;
+        for (int i = 0; i < 10; ++i) {
+            v.EmplaceBack(i);
+        }
+        Obj thrower(100);
+        thrower.throw_on_copy = true;
+        try {
+            v.PushFront(thrower);
+            assert(false);
+        }
+        catch (const std::runtime_error&) {
+        }
+        assert(v.Size() == 10 && v.Front().id == 0 && v.Back().id == 9);
+    }
+    assert(Obj::GetAliveObjectCount() == 0);
+    {
+        // Blocks are freed through the allocator which allocated them, even one which doesn't propagate
+        class TrackingResource : public std::pmr::memory_resource {
+        public:
+            size_t live = 0;
+
+        private:
+            void* do_allocate(size_t bytes, size_t alignment) override {
+                live += bytes;
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+            void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+                live -= bytes;
+                std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+            }
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                return this == &other;
+            }
+        };
+
+        TrackingResource resource;
+        {
+            using Segmented = SegmentedVector<int, std::pmr::polymorphic_allocator<int>>;
+            Segmented v(&resource);
+            for (int i = 0; i < 5 * static_cast<int>(Segmented::kBlockSize); ++i) {
+                v.PushBack(i);
+                v.PushFront(-i);
+            }
+            assert(resource.live >= 10 * Segmented::kBlockSize * sizeof(int));
+
+            for (size_t i = 0; i < 4 * Segmented::kBlockSize; ++i) {
+                v.PopBack();
+            }
+            const size_t before_shrink = resource.live;
+            v.ShrinkToFit();
+            assert(resource.live < before_shrink);
+
+            Segmented moved(std::move(v));
+            assert(moved.GetAllocator().resource() == &resource && moved.Back() == static_cast<int>(Segmented::kBlockSize) - 1);
+        }
+        assert(resource.live == 0);
+    }
+}
+
+void Test29() {
+    using namespace expr;
+    {
+        Vector<double> a;
+        Vector<double> b;
+        Vector<double> c;
+        for (int i = 0; i < 100; ++i) {
+            a.PushBack(i);
+            b.PushBack(i * 0.5);
+            c.PushBack(100 - i);
+        }
+
+        Vector<double> r = a + b * c - 2.0;
+        assert(r.Size() == 100);
+        for (int i = 0; i < 100; ++i) {
+            assert(r[i] == a[i] + b[i] * c[i] - 2.0);
+        }
+
+        // The destination may be an operand
+        Assign(r, -(r / 2.0) + 1.0);
+        assert(r[10] == -(10 + 5.0 * 90 - 2.0) / 2.0 + 1.0);
+
+        auto tree = 3.0 * (a - c);
+        Vector<double> evaluated = Evaluate(tree);
+        assert(evaluated.Size() == 100 && evaluated[0] == -300.0 && evaluated[99] == 294.0);
+    }
+    {
+        // Evaluation allocates the result once and makes no temporaries
+        using Allocator = CountingAllocator<float>;
+        Vector<float, Allocator> a(1000);
+        Vector<float, Allocator> b(1000);
+        for (size_t i = 0; i < a.Size(); ++i) {
+            a[i] = static_cast<float>(i);
+            b[i] = 2.0f;
+        }
+        Allocator::ResetCounters();
+
+        Vector<float, Allocator> r = a * b + a * 0.5 - b;
+        assert(Allocator::num_allocations == 1 && r[10] == 10.0f * 2.0f + 5.0f - 2.0f);
+        Assign(r, a * a);
+        assert(Allocator::num_allocations == 1 && r[999] == 999.0f * 999.0f);
+
+        // A scalar takes the element type of the Vector, so the expression is computed in float
+        static_assert(std::is_same_v<decltype((a * 0.5)[0]), float>);
+    }
+    {
+        // Mixed element types are promoted as with scalars
+        Vector<int> counts;
+        Vector<double> weights;
+        for (int i = 0; i < 10; ++i) {
+            counts.PushBack(i);
+            weights.PushBack(0.25);
+        }
+        Vector<double> r = counts * weights;
+        assert(r[3] == 0.75);
+        Vector<int> truncated = counts * weights;
+        assert(truncated[3] == 0 && truncated[9] == 2);
+    }
+}
+
+template <typename Search>
+void TestFlatContainers() {
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> keys(0, 700);
+
+    FlatSet<int, std::less<int>, Search> set;
+    FlatMap<int, std::string, std::less<int>, Search> map;
+    std::set<int> expected_set;
+    std::map<int, std::string> expected_map;
+
+    for (int round = 0; round < 3000; ++round) {
+        const int key = keys(random);
+        switch (round % 5) {
+        case 0: {
+            const bool set_inserted = set.Insert(key).second;
+            assert(set_inserted == expected_set.insert(key).second);
+            const bool map_inserted = map.Insert(key, std::to_string(round)).second;
+            assert(map_inserted == expected_map.emplace(key, std::to_string(round)).second);
+            break;
+        }
+        case 1: {
+            const size_t set_erased = set.Erase(key);
+            assert(set_erased == expected_set.erase(key));
+            const size_t map_erased = map.Erase(key);
+            assert(map_erased == expected_map.erase(key));
+            break;
+        }
+        case 2:
+            map[key] += "x";
+            expected_map[key] += "x";
+            break;
+        case 3: {
+            Vector<int> batch;
+            Vector<std::pair<int, std::string>> items;
+            for (int i = 0; i < 20; ++i) {
+                const int batch_key = keys(random);
+                batch.PushBack(batch_key);
+                items.PushBack({ batch_key, std::to_string(-i) });
+                expected_set.insert(batch_key);
+                expected_map.emplace(batch_key, std::to_string(-i));
+            }
+            set.Insert(batch.begin(), batch.end());
+            map.Insert(items.begin(), items.end());
+            break;
+        }
+        default:
+            assert(set.Contains(key) == expected_set.contains(key));
+            assert((map.Find(key) == map.end()) == !expected_map.contains(key));
+            auto lower = set.LowerBound(key);
+            auto expected_lower = expected_set.lower_bound(key);
+            assert((lower == set.end()) == (expected_lower == expected_set.end()));
+            assert(lower == set.end() || *lower == *expected_lower);
+        }
+    }
+
+    assert(std::equal(set.begin(), set.end(), expected_set.begin(), expected_set.end()));
+    assert(map.Size() == expected_map.size());
+    auto expected = expected_map.begin();
+    for (auto [key, value] : map) {
+        assert(key == expected->first && value == expected->second);
+        ++expected;
+    }
+}
+
+void Test30() {
+    TestFlatContainers<BinarySearch>();
+    TestFlatContainers<BranchlessSearch>();
+    TestFlatContainers<EytzingerSearch>();
+    {
+        // Bulk construction sorts once and keeps the first of duplicate keys
+        Vector<int> keys;
+        for (int key : { 5, 3, 9, 3, 1, 9 }) {
+            keys.PushBack(key);
+        }
+        const FlatSet<int, std::less<int>, EytzingerSearch> set(std::move(keys));
+        assert(set.Size() == 4 && set.Keys()[0] == 1 && set.Keys()[3] == 9);
+        for (int key = 0; key <= 10; ++key) {
+            assert(set.Contains(key) == (key == 1 || key == 3 || key == 5 || key == 9));
+        }
+
+        Vector<std::pair<int, std::string>> items;
+        items.PushBack({ 2, "two" });
+        items.PushBack({ 1, "one" });
+        items.PushBack({ 2, "deux" });
+        FlatMap<int, std::string> map(std::move(items));
+        assert(map.Size() == 2 && map.At(2) == "two" && map.Find(1)->second == "one");
+        try {
+            map.At(3);
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+
+        map.InsertOrAssign(2, std::string("zwei"));
+        const bool emplaced = map.TryEmplace(1, "uno").second;
+        assert(map.At(2) == "zwei" && !emplaced && map[1] == "one");
+        const auto& const_map = map;
+        assert(const_map.Values()[1] == "zwei" && const_map.begin()->first == 1);
+    }
+    {
+        // The index and the buffers of a merge come from the resource of the container. Nothing may
+        // fall back to the default resource
+        std::pmr::unsynchronized_pool_resource pool;
+        std::pmr::memory_resource* default_resource = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+        {
+            using Allocator = std::pmr::polymorphic_allocator<int>;
+            FlatSet<int, std::less<int>, EytzingerSearch, Allocator> set(std::less<int>(), &pool);
+            FlatMap<int, int, std::less<int>, EytzingerSearch, Allocator, Allocator> map(std::less<int>(), &pool, &pool);
+            for (int key = 0; key < 100; ++key) {
+                set.Insert(key * 2);
+                map.Insert(key * 2, key);
+            }
+            const int keys[] = { 1, 3, 5 };
+            set.Insert(std::begin(keys), std::end(keys));
+            const std::pair<int, int> items[] = { { 1, -1 }, { 3, -3 } };
+            map.Insert(std::begin(items), std::end(items));
+            assert(set.Size() == 103 && set.Contains(3));
+            assert(map.Size() == 102 && map.At(3) == -3 && map.At(198) == 99);
+        }
+        std::pmr::set_default_resource(default_resource);
+    }
+}
+
+// Coroutine which starts at once and is destroyed with its Task
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept {
+            return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_always final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {
+        }
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle(handle) {
+    }
+    Task(Task&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)) {
+    }
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool Done() const noexcept {
+        return handle.done();
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+using IntChannel = BatchChannel<int, CountingAllocator<int>>;
+
+Task ProduceBatches(IntChannel& channel, int batches, int batch_size, int& sent) {
+    Vector<int, CountingAllocator<int>> batch;
+    for (int b = 0; b < batches; ++b) {
+        batch.Reserve(batch_size);
+        for (int i = 0; i < batch_size; ++i) {
+            batch.PushBack(b * batch_size + i);
+        }
+        const bool ok = co_await channel.Send(std::move(batch));
+        assert(ok && batch.Size() == 0);
+        ++sent;
+    }
+    channel.Close();
+}
+
+Task ConsumeBatches(IntChannel& channel, long& sum, int& received) {
+    while (auto batch = co_await channel.Receive()) {
+        for (int value : *batch) {
+            sum += value;
+        }
+        ++received;
+        channel.Recycle(std::move(*batch));
+    }
+}
+
+void Test31() {
+    using Allocator = CountingAllocator<int>;
+    {
+        // Batches go round between the stages, and once every buffer exists nothing is allocated
+        Allocator::ResetCounters();
+        IntChannel channel(2);
+        long sum = 0;
+        int sent = 0;
+        int received = 0;
+
+        Task consumer = ConsumeBatches(channel, sum, received);
+        assert(!consumer.Done() && received == 0);
+        Task producer = ProduceBatches(channel, 1000, 64, sent);
+
+        assert(producer.Done() && consumer.Done());
+        assert(sent == 1000 && received == 1000 && sum == 64000L * 63999 / 2);
+        assert(Allocator::num_allocations == 2);
+    }
+    assert(Allocator::num_allocations == Allocator::num_deallocations);
+    {
+        // A full channel suspends the sender until a batch is taken
+        IntChannel channel(1);
+        int sent = 0;
+        Task producer = ProduceBatches(channel, 3, 4, sent);
+        assert(!producer.Done() && sent == 1 && channel.Size() == 1);
+
+        auto batch = channel.TryReceive();
+        assert(batch && batch->Size() == 4 && (*batch)[3] == 3);
+        assert(sent == 2 && channel.Size() == 1);
+        channel.Recycle(std::move(*batch));
+
+        batch = channel.TryReceive();
+        assert(batch && (*batch)[0] == 4 && sent == 3 && producer.Done());
+        batch = channel.TryReceive();
+        assert(batch && (*batch)[0] == 8);
+        batch = channel.TryReceive();
+        assert(!batch);
+
+        // The producer closed the channel after its last batch
+        Vector<int, Allocator> rejected;
+        rejected.PushBack(1);
+        const bool accepted = channel.TrySend(std::move(rejected));
+        assert(!accepted && rejected.Size() == 1);
+
+        long sum = 0;
+        int received = 0;
+        Task consumer = ConsumeBatches(channel, sum, received);
+        assert(consumer.Done() && received == 0);
+    }
+    {
+        // Closing wakes a waiting consumer with nothing
+        IntChannel channel(4);
+        long sum = 0;
+        int received = 0;
+        Task consumer = ConsumeBatches(channel, sum, received);
+        Vector<int, Allocator> batch;
+        batch.PushBack(7);
+        const bool accepted = channel.TrySend(std::move(batch));
+        assert(accepted && received == 1 && sum == 7);
+        assert(!consumer.Done());
+        channel.Close();
+        assert(consumer.Done());
+    }
+}
+
+void Test32() {
+    using Allocator = CountingAllocator<int>;
+    using Pool = VectorPool<int, Allocator>;
+    {
+        // Requests building vectors of similar sizes stop allocating once the pool has seen the largest ones
+        Allocator::ResetCounters();
+        Pool pool(4);
+        int allocations_after_warmup = 0;
+        for (int request = 0; request < 200; ++request) {
+            auto ids = pool.Acquire();
+            auto scores = pool.Acquire();
+            for (int i = 0; i < 100 + request % 7; ++i) {
+                ids->PushBack(i);
+                scores->PushBack(i * 2);
+            }
+            assert((*ids)[99] == 99 && scores->Back() == 2 * (static_cast<int>(scores->Size()) - 1));
+            if (request == 20) {
+                allocations_after_warmup = Allocator::num_allocations;
+            }
+        }
+        assert(pool.RecommendedCapacity() == 106 && pool.IdleCount() == 2);
+        assert(Allocator::num_allocations == allocations_after_warmup);
+
+        // A vector comes back empty
+        auto again = pool.Acquire();
+        assert(again->Size() == 0 && again->Capacity() >= 106);
+
+        // Released vectors leave the pool
+        auto kept = pool.Acquire().Release();
+        assert(kept.Capacity() >= 106 && pool.IdleCount() == 0);
+    }
+    assert(Allocator::num_allocations == Allocator::num_deallocations);
+    {
+        // The recommendation follows a shrinking workload, and oversized buffers are freed
+        Pool pool;
+        for (int i = 0; i < 10; ++i) {
+            auto v = pool.Acquire();
+            v->Resize(1000);
+        }
+        assert(pool.RecommendedCapacity() == 1000 && pool.IdleCount() == 1);
+        for (size_t i = 0; i < 2 * Pool::kWindow; ++i) {
+            auto v = pool.Acquire();
+            v->Resize(10);
+        }
+        assert(pool.RecommendedCapacity() == 10 && pool.IdleCount() == 1);
+        {
+            auto v = pool.Acquire();
+            assert(v->Capacity() == 10);
+        }
+    }
+    {
+        // Every thread has a pool of its own
+        auto v = VectorPool<int>::Local().Acquire();
+        v->PushBack(1);
+        const VectorPool<int>* pool = &VectorPool<int>::Local();
+        std::thread([pool] {
+            assert(&VectorPool<int>::Local() != pool);
+        }).join();
+    }
+    assert(VectorPool<int>::Local().IdleCount() == 1);
+}
+
+void Test33() {
+    // The kernel's policy for the page at address, or -1 if it doesn't tell
+    auto policy_at = [](const void* address) {
+        int mode = -1;
+        unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+        if (syscall(SYS_get_mempolicy, &mode, mask, 1024ul, address, static_cast<unsigned long>(MPOL_F_ADDR)) != 0) {
+            return -1;
+        }
+        return mode;
+    };
+
+    const uint64_t nodes = NumaAllowedNodes();
+    assert(nodes != 0);
+    {
+        using Allocator = NumaAllocator<int, 4096>;
+        Vector<int, Allocator> interleaved(Allocator(NumaPolicy::Interleave));
+        Vector<int, Allocator> bound(Allocator(NumaPolicy::Bind, nodes & -nodes));
+        Vector<int, Allocator> local;
+        Vector<int, Allocator> small(Allocator(NumaPolicy::Interleave));
+        for (int i = 0; i < 100'000; ++i) {
+            interleaved.PushBack(i);
+            bound.PushBack(i);
+            local.PushBack(i);
+        }
+        small.PushBack(1);
+        assert(interleaved.GetAllocator().Nodes() == nodes && local.GetAllocator().Policy() == NumaPolicy::Local);
+        for (int i = 0; i < 100'000; i += 997) {
+            assert(interleaved[i] == i && bound[i] == i && local[i] == i);
+        }
+
+        // Large buffers are page-aligned mappings, and growing them through mremap keeps their policy
+        assert(reinterpret_cast<uintptr_t>(interleaved.Data()) % 4096 == 0);
+        assert(interleaved.Capacity() * sizeof(int) % 4096 == 0);
+        const int mode = policy_at(interleaved.Data() + interleaved.Size() - 1);
+        assert(mode == -1 || mode == MPOL_INTERLEAVE);
+        assert(mode == -1 || policy_at(bound.Data()) == MPOL_BIND);
+        assert(mode == -1 || policy_at(local.Data()) == MPOL_LOCAL);
+        assert(small.Capacity() * sizeof(int) < 4096 && small[0] == 1);
+
+        // The allocators free each other's buffers, so a moved vector keeps its buffer
+        const int* data = bound.Data();
+        local = std::move(bound);
+        assert(local.Data() == data && local[99'999] == 99'999);
+    }
+    {
+        // A static schedule gives each worker the same chunks in every call, so the worker which
+        // constructed a chunk is the one which scans it
+        ThreadPool pool(4);
+        ParallelOptions options{ 1000, &pool };
+        options.static_schedule = true;
+
+        const size_t SIZE = 100'000;
+        auto v = ParallelVector<int, NumaAllocator<int>>(SIZE, options, NumaAllocator<int>(NumaPolicy::Local));
+        assert(v.Size() == SIZE && std::count(v.begin(), v.end(), 0) == static_cast<ptrdiff_t>(SIZE));
+
+        Vector<std::thread::id> first_pass(SIZE);
+        Vector<std::thread::id> second_pass(SIZE);
+        for (Vector<std::thread::id>* pass : { &first_pass, &second_pass }) {
+            ParallelForEach(v, [&](int& value) {
+                (*pass)[&value - v.Data()] = std::this_thread::get_id();
+            }, options);
+        }
+        assert(std::equal(first_pass.begin(), first_pass.end(), second_pass.begin()));
+        assert(std::count(first_pass.begin(), first_pass.end(), std::this_thread::get_id()) == 0);
+        assert(std::set<std::thread::id>(first_pass.begin(), first_pass.end()).size() == 4);
+
+        // Growing a vector writes only the new elements
+        ParallelForEach(v, [](int& value) {
+            value = 1;
+        }, options);
+        ParallelResize(v, 2 * SIZE + 7, options);
+        assert(std::count(v.begin(), v.end(), 1) == static_cast<ptrdiff_t>(SIZE));
+        assert(v[SIZE - 1] == 1 && v[SIZE] == 0 && v[2 * SIZE + 6] == 0);
+
+        // Even a single chunk runs on a worker
+        std::thread::id runner;
+        ParallelForEach(Vector<int>(10), [&](int) {
+            runner = std::this_thread::get_id();
+        }, options);
+        assert(runner != std::this_thread::get_id());
+    }
+}
+
+void Test34() {
+    assert(CacheSize(CacheLevel::L1) != 0 && CacheSize(CacheLevel::L1) <= CacheSize(CacheLevel::L3));
+    {
+        // Elements come in the order of the indices, which may repeat, for any prefetch distance
+        Vector<int> values;
+        for (int i = 0; i < 1000; ++i) {
+            values.PushBack(i * 3);
+        }
+        Vector<uint32_t> indices;
+        for (uint32_t i = 0; i < 5000; ++i) {
+            indices.PushBack(i * 2654435761u % 1000);
+        }
+
+        for (size_t distance : { size_t{ 0 }, size_t{ 1 }, kDefaultPrefetchDistance, size_t{ 10'000 } }) {
+            Vector<int> gathered;
+            ForEachPrefetched(values, indices, [&](int value) {
+                gathered.PushBack(value);
+            }, distance);
+            assert(gathered.Size() == indices.Size());
+            for (size_t i = 0; i < indices.Size(); ++i) {
+                assert(gathered[i] == static_cast<int>(indices[i]) * 3);
+            }
+        }
+
+        // The function gets references into the range
+        ForEachPrefetched(values, std::span<const uint32_t>(indices.Data(), 10), [](int& value) {
+            value = -1;
+        });
+        assert(values[indices[0]] == -1 && values[indices[9]] == -1);
+        ForEachPrefetched(values, Vector<uint32_t>(), [](int&) {
+            assert(false);
+        });
+    }
+    {
+        // The blocks cover the range in order, and all but the first and the last are full and line aligned
+        Vector<int> v;
+        for (int i = 0; i < 100'003; ++i) {
+            v.PushBack(i);
+        }
+        for (std::span<int> range : { std::span<int>(v.Data(), v.Size()), std::span<int>(v.Data() + 3, 1000) }) {
+            Vector<std::span<int>> blocks;
+            ForEachBlock(range, [&](std::span<int> block) {
+                blocks.PushBack(block);
+            }, 4096);
+
+            assert(blocks.Front().data() == range.data() && blocks.Back().data() + blocks.Back().size() == range.data() + range.size());
+            for (size_t i = 1; i < blocks.Size(); ++i) {
+                assert(blocks[i].data() == blocks[i - 1].data() + blocks[i - 1].size());
+                assert(reinterpret_cast<uintptr_t>(blocks[i].data()) % 64 == 0);
+                assert(blocks[i - 1].size() <= 1024 && (i == 1 || blocks[i - 1].size() == 1024));
+            }
+        }
+
+        int64_t sum = 0;
+        ForEachBlock(std::as_const(v), [&](std::span<const int> block) {
+            sum += std::accumulate(block.begin(), block.end(), int64_t{ 0 });
+        });
+        assert(sum == int64_t{ 100'003 } * 100'002 / 2);
+    }
+    {
+        // Streaming stores write the same as ordinary ones at any alignment and length
+        Vector<int> source;
+        for (int i = 0; i < 10'000; ++i) {
+            source.PushBack(i);
+        }
+        for (size_t offset : { 0, 1, 3 }) {
+            for (size_t size : { 0, 1, 5, 4096, 9000 }) {
+                const std::span<const int> in(source.Data() + offset, size);
+
+                Vector<int> out;
+                out.ResizeUninitialized(size + 2);
+                out[size] = out[size + 1] = -1;
+                StreamCopy(in, std::span<int>(out.Data(), size));
+                assert(std::equal(in.begin(), in.end(), out.begin()) && out[size] == -1);
+
+                StreamFill(std::span<int>(out.Data() + 1, size), 7);
+                assert(std::count(out.begin() + 1, out.begin() + 1 + size, 7) == static_cast<ptrdiff_t>(size));
+                assert(out[size + 1] == -1);
+            }
+        }
+
+        // Elements of other sizes and doubles built from ints
+        struct Rgb {
+            uint8_t r, g, b;
+        };
+        Vector<Rgb> pixels;
+        pixels.Resize(1001);
+        StreamFill(pixels, Rgb{ 1, 2, 3 });
+        assert(std::all_of(pixels.begin(), pixels.end(), [](const Rgb& p) {
+            return p.r == 1 && p.g == 2 && p.b == 3;
+        }));
+
+        Vector<double> doubles(333);
+        StreamFill(doubles, 2);
+        assert(std::count(doubles.begin(), doubles.end(), 2.0) == 333);
+        Vector<double> copy(333);
+        StreamCopy(doubles, copy);
+        assert(std::equal(copy.begin(), copy.end(), doubles.begin(), doubles.end()));
+    }
+}
+
+void Test35() {
+    // Compared with std::vector<bool> through random operations around word boundaries
+    std::mt19937 random(35);
+    BitVector bits;
+    std::vector<bool> expected;
+    for (int step = 0; step < 20'000; ++step) {
+        const unsigned op = random() % 8;
+        if (op < 4) {
+            const bool value = random() % 3 == 0;
+            bits.PushBack(value);
+            expected.push_back(value);
+        }
+        else if (op == 4 && !expected.empty()) {
+            bits.PopBack();
+            expected.pop_back();
+        }
+        else if (op == 5 && !expected.empty()) {
+            const size_t index = random() % expected.size();
+            bits[index] = !bits[index];
+            expected[index] = !expected[index];
+        }
+        else if (op == 6 && step % 50 == 0) {
+            const size_t size = random() % 300;
+            const bool value = random() % 2 == 0;
+            bits.Resize(size, value);
+            expected.resize(size, value);
+        }
+    }
+    assert(bits.Size() == expected.size() && bits.Capacity() >= bits.Size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        assert(bits[i] == expected[i]);
+    }
+    const size_t count = static_cast<size_t>(std::count(expected.begin(), expected.end(), true));
+    assert(bits.Count() == count);
+
+    // The words hold the bits, with the bits past the size cleared
+    assert(bits.Words().size() == (bits.Size() + 63) / 64);
+    if (bits.Size() % 64 != 0) {
+        assert(bits.Words().back() >> (bits.Size() % 64) == 0);
+    }
+
+    {
+        // Rank, Select, FindFirst and ForEachSet agree with one another, and BitRankIndex with the scans
+        const BitRankIndex index(bits);
+        Vector<size_t> positions;
+        bits.ForEachSet([&](size_t position) {
+            positions.PushBack(position);
+        });
+        assert(positions.Size() == count);
+
+        size_t position = bits.FindFirst();
+        for (size_t rank = 0; rank < count; ++rank) {
+            assert(position == positions[rank] && expected[position]);
+            assert(bits.Select(rank) == position && index.Select(rank) == position);
+            assert(bits.Rank(position) == rank && index.Rank(position) == rank);
+            position = bits.FindFirst(position + 1);
+        }
+        assert(position == bits.Size() && bits.Select(count) == bits.Size() && index.Select(count) == bits.Size());
+        for (size_t i = 0; i <= bits.Size(); i += 7) {
+            assert(bits.Rank(i) == index.Rank(i));
+        }
+        assert(bits.Rank(bits.Size()) == count && index.Rank(bits.Size()) == count);
+    }
+    {
+        // Bulk operations
+        BitVector a(1000);
+        BitVector b(1000);
+        for (size_t i = 0; i < 1000; ++i) {
+            a[i] = i % 2 == 0;
+            b[i] = i % 3 == 0;
+        }
+        assert((a & b).Count() == 167 && (a | b).Count() == 667 && (a ^ b).Count() == 500);
+        assert((~a).Count() == 500 && (~a).Words().back() >> (1000 % 64) == 0);
+
+        BitVector c = a;
+        c &= b;
+        c |= ~b;
+        const BitVector d = a | ~b;
+        assert(c == d && c != a);
+        c ^= d;
+        assert(c.Count() == 0 && c.FindFirst() == c.Size());
+
+        a.Flip();
+        a.Flip();
+        assert(a.Count() == 500 && a.At(998) && !a.At(999));
+        try {
+            a.At(1000);
+            assert(false);
+        }
+        catch (const std::out_of_range&) {
+        }
+
+        // Reserve and move keep the bits
+        a.Reserve(100'000);
+        assert(a.Capacity() >= 100'000 && a.Count() == 500);
+        BitVector moved = std::move(a);
+        assert(moved.Size() == 1000 && a.Size() == 0 && moved[0] && !moved[1]);
+
+        moved.Resize(1500, true);
+        assert(moved.Count() == 1000 && moved[1499] && moved.Rank(1500) == 1000);
+        moved.Clear();
+        assert(moved.Size() == 0 && moved.Count() == 0 && moved.Capacity() >= 100'000);
+    }
+    {
+        // Under every instruction set
+        const simd::Isa detected = simd::DetectIsa();
+        BitVector v;
+        for (size_t i = 0; i < 10'007; ++i) {
+            v.PushBack(random() % 5 == 0);
+        }
+        size_t scalar = 0;
+        v.ForEachSet([&](size_t) {
+            ++scalar;
+        });
+        for (simd::Isa isa : { simd::Isa::Scalar, simd::Isa::Neon, simd::Isa::Sse42, simd::Isa::Avx2, simd::Isa::Avx512 }) {
+            if (!simd::IsSupported(isa)) continue;
+            simd::SetIsa(isa);
+            assert(v.Count() == scalar && (~v).Count() == v.Size() - scalar && (v & ~v).Count() == 0);
+        }
+        simd::SetIsa(detected);
+    }
+}
 
 int main() {
         Test1();
@@ -646,5 +3166,33 @@ int main() {
         Test4();
         Test5();
         Test6();
-        Benchmark();
+        Test7();
+        Test8();
+        Test9();
+        Test10();
+        Test11();
+        Test12();
+        Test13();
+        Test14();
+        Test15();
+        Test16();
+        Test17();
+        Test18();
+        Test19();
+        Test20();
+        Test21();
+        Test22();
+        Test23();
+        Test24();
+        Test25();
+        Test26();
+        Test27();
+        Test28();
+        Test29();
+        Test30();
+        Test31();
+        Test32();
+        Test33();
+        Test34();
+        Test35();
 }
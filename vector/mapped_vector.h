@@ -0,0 +1,377 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+
+
+enum class MapMode {
+    // Maps the file with PROT_READ, so processes opening it share the pages. Mutations are not allowed
+    ReadOnly,
+    // Opens the file or creates an empty one. Changes are written back to the file by the kernel
+    ReadWrite,
+};
+
+// A file mapped with MAP_SHARED, laid out as a Header followed by the elements.
+// The counterpart of RawMemory for MappedVector; Linux only, as it grows through mremap()
+template <typename T>
+class MappedMemory {
+    static_assert(std::is_trivially_copyable_v<T>, "The file holds the bytes of the elements");
+
+public:
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t element_size;
+        uint64_t size;
+    };
+
+    static constexpr uint64_t kMagic = 0x3130'5041'4D43'4556;  // "VECMAP01" read as little-endian
+    static constexpr uint32_t kVersion = 1;
+    // The elements start one cache line into the file, which keeps them aligned
+    static constexpr size_t kHeaderSize = 64;
+
+    static_assert(alignof(T) <= kHeaderSize, "The elements would be misaligned in the mapping");
+
+    MappedMemory() = default;
+
+    // Throws std::system_error when the file can't be opened or mapped, and std::runtime_error
+    // when it isn't a file of T
+    MappedMemory(const std::string& path, MapMode mode)
+        : writable_(mode == MapMode::ReadWrite)
+    {
+        fd_ = writable_ ? open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "Can't open " + path);
+        }
+
+        try {
+            struct stat file_stat {};
+            if (fstat(fd_, &file_stat) != 0) {
+                throw std::system_error(errno, std::generic_category(), "Can't stat " + path);
+            }
+
+            const bool is_new = file_stat.st_size == 0;
+            if (is_new) {
+                if (!writable_) {
+                    throw std::runtime_error(path + " is empty");
+                }
+                Truncate(kHeaderSize);
+                length_ = kHeaderSize;
+            }
+            else {
+                length_ = static_cast<size_t>(file_stat.st_size);
+                if (length_ < kHeaderSize) {
+                    throw std::runtime_error(path + " is too short for a vector header");
+                }
+            }
+
+            void* address = mmap(nullptr, length_, writable_ ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd_, 0);
+            if (address == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "Can't map " + path);
+            }
+            address_ = static_cast<std::byte*>(address);
+
+            if (is_new) {
+                GetHeader() = Header{ kMagic, kVersion, sizeof(T), 0 };
+            }
+            else if (const Header& header = GetHeader(); header.magic != kMagic || header.version != kVersion
+                                                         || header.element_size != sizeof(T) || header.size > Capacity()) {
+                throw std::runtime_error(path + " doesn't hold a vector of this element type");
+            }
+        }
+        catch (...) {
+            Release();
+            throw;
+        }
+    }
+
+    MappedMemory(const MappedMemory&) = delete;
+    MappedMemory& operator=(const MappedMemory&) = delete;
+
+    MappedMemory(MappedMemory&& other) noexcept {
+        Swap(other);
+    }
+
+    MappedMemory& operator=(MappedMemory&& rhs) noexcept {
+        if (this != &rhs) {
+            Release();
+            Swap(rhs);
+        }
+        return *this;
+    }
+
+    ~MappedMemory() {
+        Release();
+    }
+
+    T* GetAddress() noexcept {
+        return address_ != nullptr ? reinterpret_cast<T*>(address_ + kHeaderSize) : nullptr;
+    }
+
+    const T* GetAddress() const noexcept {
+        return const_cast<MappedMemory&>(*this).GetAddress();
+    }
+
+    size_t Capacity() const noexcept {
+        return length_ > kHeaderSize ? (length_ - kHeaderSize) / sizeof(T) : 0;
+    }
+
+    Header& GetHeader() noexcept {
+        VECTOR_CHECK(address_ != nullptr);
+        return *reinterpret_cast<Header*>(address_);
+    }
+
+    const Header& GetHeader() const noexcept {
+        return const_cast<MappedMemory&>(*this).GetHeader();
+    }
+
+    bool IsWritable() const noexcept {
+        return writable_;
+    }
+
+    // Extends the file and the mapping to new_capacity elements. The mapping may move, invalidating pointers
+    // into it. On failure the mapping is left intact
+    void Grow(size_t new_capacity) {
+        VECTOR_CHECK(writable_ && new_capacity >= Capacity());
+
+        // Checked before the file is truncated: a wrapped length would cut off the stored elements
+        if (new_capacity > (static_cast<size_t>(std::numeric_limits<ptrdiff_t>::max()) - kHeaderSize) / sizeof(T)) {
+            throw std::length_error("MappedVector is too long");
+        }
+        const size_t new_length = kHeaderSize + new_capacity * sizeof(T);
+        Truncate(new_length);
+
+        void* address = mremap(address_, length_, new_length, MREMAP_MAYMOVE);
+        if (address == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "Can't remap a mapped vector");
+        }
+        address_ = static_cast<std::byte*>(address);
+        length_ = new_length;
+    }
+
+    // Blocks until the changes reach the file
+    void Sync() {
+        if (address_ != nullptr && writable_ && msync(address_, length_, MS_SYNC) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Can't sync a mapped vector");
+        }
+    }
+
+    void Swap(MappedMemory& other) noexcept {
+        std::swap(fd_, other.fd_);
+        std::swap(address_, other.address_);
+        std::swap(length_, other.length_);
+        std::swap(writable_, other.writable_);
+    }
+
+private:
+    // Pages past the end of the disk space make writes fault with SIGBUS, as with any shared file mapping
+    void Truncate(size_t length) {
+        if (ftruncate(fd_, static_cast<off_t>(length)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Can't resize a mapped vector");
+        }
+    }
+
+    void Release() noexcept {
+        if (address_ != nullptr) {
+            munmap(address_, length_);
+            address_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        length_ = 0;
+    }
+
+    int fd_ = -1;
+    std::byte* address_ = nullptr;
+    size_t length_ = 0;
+    bool writable_ = false;
+};
+
+
+
+
+
+// Vector of trivially copyable elements living in a file. Reopening the file gives back the elements
+// without reading them: the pages are loaded on first access. The size is kept in the file header,
+// the capacity is the length of the file. Elements holding pointers are meaningless once reopened
+template <typename T, typename GrowthPolicy = DoublingGrowth>
+class MappedVector {
+public:
+
+    using iterator = T*;
+    using const_iterator = const T*;
+
+
+    explicit MappedVector(const std::string& path, MapMode mode = MapMode::ReadWrite)
+        : data_(path, mode)
+        , size_(data_.GetHeader().size) {
+    }
+
+    MappedVector(MappedVector&& other) noexcept
+        : data_(std::move(other.data_))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    MappedVector& operator=(MappedVector&& rhs) noexcept {
+        if (this != &rhs) {
+            data_ = std::move(rhs.data_);
+            size_ = std::exchange(rhs.size_, 0);
+        }
+        return *this;
+    }
+
+
+
+
+
+    iterator begin() noexcept {
+        return data_.GetAddress();
+    }
+    iterator end() noexcept {
+        return data_.GetAddress() + size_;
+    }
+
+    const_iterator begin() const noexcept {
+        return data_.GetAddress();
+    }
+    const_iterator end() const noexcept {
+        return data_.GetAddress() + size_;
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+
+    T& Back() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *std::prev(end());
+    }
+    const T& Back() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *std::prev(cend());
+    }
+    T& Front() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *begin();
+    }
+    const T& Front() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *cbegin();
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    size_t Capacity() const noexcept {
+        return data_.Capacity();
+    }
+
+    bool IsReadOnly() const noexcept {
+        return !data_.IsWritable();
+    }
+
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return data_.GetAddress()[index];
+    }
+
+    T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
+        return data_.GetAddress()[index];
+    }
+
+
+    // Grows the file. Unlike Vector::Reserve, pointers into the vector are invalidated only if the kernel
+    // can't extend the mapping in place
+    void Reserve(size_t new_capacity) {
+        VECTOR_CHECK(!IsReadOnly());
+        if (new_capacity <= Capacity()) return;
+
+        data_.Grow(new_capacity);
+    }
+
+    // New elements are value-initialized; the bytes past the old end of the file are zero already
+    void Resize(size_t new_size) {
+        VECTOR_CHECK(!IsReadOnly());
+        if (new_size == size_) return;
+
+        if (new_size > size_) {
+            Reserve(new_size);
+            detail::UninitializedValueConstructN(data_.GetAddress() + size_, new_size - size_);
+        }
+
+        SetSize(new_size);
+    }
+
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+
+    // The element is built before growing, as args may refer to elements of the vector
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        VECTOR_CHECK(!IsReadOnly());
+
+        if (size_ == Capacity()) {
+            T value(std::forward<Args>(args)...);
+            Reserve(GrowthPolicy::NextCapacity(Capacity(), size_ + 1, sizeof(T)));
+            detail::CopyBytes(&value, 1, end());
+        }
+        else {
+            new (end()) T(std::forward<Args>(args)...);
+        }
+
+        SetSize(size_ + 1);
+
+        return Back();
+    }
+
+
+    void PopBack() noexcept {
+        VECTOR_CHECK(!IsReadOnly() && size_ != 0);
+        SetSize(size_ - 1);
+    }
+
+
+    // Blocks until the elements and the size reach the file. Without it the kernel writes them back
+    // at its own pace, also after the process has crashed
+    void Sync() {
+        data_.Sync();
+    }
+
+
+private:
+    MappedMemory<T> data_;
+    size_t size_ = 0;
+
+
+    void SetSize(size_t new_size) noexcept {
+        size_ = new_size;
+        data_.GetHeader().size = new_size;
+    }
+};
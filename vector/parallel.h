@@ -0,0 +1,452 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+
+
+
+
+
+// Fixed set of worker threads, each with its own task deque. A worker takes the newest task of its deque
+// and steals the oldest one of another deque when its own is empty, so tasks spawned by a task stay
+// on the thread which has their data in cache. Tasks must not throw
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t num_threads = std::max(1u, std::thread::hardware_concurrency()))
+        : queues_(num_threads)
+    {
+        // Tasks submitted to a pool without workers would never run
+        if (num_threads == 0) {
+            throw std::invalid_argument("A ThreadPool needs at least one thread");
+        }
+
+        for (auto& queue : queues_) {
+            queue = std::make_unique<Queue>();
+        }
+
+        workers_.Reserve(num_threads);
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.EmplaceBack([this, i] {
+                WorkerLoop(i);
+            });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Waits for the queued tasks to finish
+    ~ThreadPool() {
+        {
+            std::lock_guard guard(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Pool with a thread per hardware thread, created on first use
+    static ThreadPool& Default() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t Size() const noexcept {
+        return workers_.Size();
+    }
+
+    // A task submitted by a worker goes to its own deque, other tasks are spread round-robin.
+    // If it throws, the task isn't queued
+    void Submit(std::function<void()> task) {
+        const size_t index = current_pool_ == this ? current_index_ : next_queue_.fetch_add(1, std::memory_order_relaxed);
+
+        Queue& queue = *queues_[index % queues_.Size()];
+        {
+            std::lock_guard guard(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard guard(sleep_mutex_);
+            ++pending_;
+        }
+        wake_.notify_one();
+    }
+
+    // Queues a task only the worker with the index runs: no other worker steals it, and neither does
+    // a thread in RunPendingTask(). If it throws, the task isn't queued
+    void Submit(size_t worker, std::function<void()> task) {
+        Queue& queue = *queues_[worker % queues_.Size()];
+        {
+            std::lock_guard guard(queue.mutex);
+            queue.pinned.push_back(std::move(task));
+        }
+        {
+            std::lock_guard guard(sleep_mutex_);
+            ++queue.pinned_pending;
+        }
+        // A single notification could wake a worker which can't run the task
+        wake_.notify_all();
+    }
+
+    // Runs a queued task on the calling thread, which lets a thread waiting for tasks help instead of blocking.
+    // Returns false if there was none
+    bool RunPendingTask() {
+        const size_t home = current_pool_ == this ? current_index_ : 0;
+
+        std::function<void()> task;
+        if (!(current_pool_ == this && TryPopPinned(home, task)) && !TryPop(home, task)) {
+            return false;
+        }
+
+        task();
+        return true;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        // Tasks for this queue's worker alone, counted under sleep_mutex_
+        std::deque<std::function<void()>> pinned;
+        ptrdiff_t pinned_pending = 0;
+    };
+
+    bool TryPopPinned(size_t home, std::function<void()>& task) {
+        Queue& queue = *queues_[home];
+        {
+            std::lock_guard guard(queue.mutex);
+            if (queue.pinned.empty()) {
+                return false;
+            }
+            task = std::move(queue.pinned.front());
+            queue.pinned.pop_front();
+        }
+
+        std::lock_guard sleep_guard(sleep_mutex_);
+        --queue.pinned_pending;
+        return true;
+    }
+
+    bool TryPop(size_t home, std::function<void()>& task) {
+        for (size_t i = 0; i < queues_.Size(); ++i) {
+            Queue& queue = *queues_[(home + i) % queues_.Size()];
+            std::lock_guard guard(queue.mutex);
+
+            if (!queue.tasks.empty()) {
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+
+                std::lock_guard sleep_guard(sleep_mutex_);
+                --pending_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t index) {
+        current_pool_ = this;
+        current_index_ = index;
+
+        while (true) {
+            if (RunPendingTask()) continue;
+
+            const Queue& queue = *queues_[index];
+            std::unique_lock lock(sleep_mutex_);
+            wake_.wait(lock, [this, &queue] {
+                return pending_ > 0 || queue.pinned_pending > 0 || stopping_;
+            });
+            if (pending_ <= 0 && queue.pinned_pending <= 0 && stopping_) return;
+        }
+    }
+
+    Vector<std::unique_ptr<Queue>> queues_;
+    Vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_{ 0 };
+
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    // May dip below zero while a task is taken before its Submit() has counted it
+    ptrdiff_t pending_ = 0;
+    bool stopping_ = false;
+
+    static inline thread_local ThreadPool* current_pool_ = nullptr;
+    static inline thread_local size_t current_index_ = 0;
+};
+
+
+
+struct ParallelOptions {
+    // Number of elements below which a range isn't split further
+    size_t grain_size = 16384;
+    // nullptr stands for ThreadPool::Default()
+    ThreadPool* pool = nullptr;
+    // Runs chunk i on worker i % pool size instead of sharing the chunks out by stealing. Calls over ranges
+    // at the same address with the same size and grain give each worker the same elements, which stay
+    // in its caches, or on its NUMA node for a vector filled this way (see NumaPolicy::Local)
+    bool static_schedule = false;
+};
+
+namespace detail {
+    inline constexpr size_t kCacheLineSize = 64;
+
+    // Runs f(0) ... f(count - 1) on the pool and on the calling thread, which runs queued tasks while it waits.
+    // Rethrows the first exception thrown by f once all the calls are over
+    template <typename Function>
+    void ParallelInvoke(size_t count, const ParallelOptions& options, Function&& f) {
+        if (count == 0) return;
+        if (count == 1 && !options.static_schedule) {
+            f(size_t{ 0 });
+            return;
+        }
+
+        ThreadPool& pool = options.pool != nullptr ? *options.pool : ThreadPool::Default();
+
+        std::atomic<size_t> remaining{ count };
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        auto run = [&](size_t index) noexcept {
+            try {
+                f(index);
+            }
+            catch (...) {
+                std::lock_guard guard(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            remaining.fetch_sub(1, std::memory_order_acq_rel);
+        };
+
+        // Under a static schedule the calling thread only helps with other work while it waits
+        const size_t first_submitted = options.static_schedule ? 0 : 1;
+        for (size_t i = first_submitted; i < count; ++i) {
+            try {
+                auto task = [&run, i] {
+                    run(i);
+                };
+                if (options.static_schedule) {
+                    pool.Submit(i, std::move(task));
+                }
+                else {
+                    pool.Submit(std::move(task));
+                }
+            }
+            catch (...) {
+                run(i);
+            }
+        }
+        if (first_submitted != 0) {
+            run(0);
+        }
+
+        while (remaining.load(std::memory_order_acquire) != 0) {
+            if (!pool.RunPendingTask()) {
+                std::this_thread::yield();
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Splits [first, first + size) into chunks of about grain_size elements. Inner boundaries are moved
+    // to cache line boundaries where the element size allows, so neighbouring chunks don't share lines.
+    // Returns chunk count + 1 boundaries
+    template <typename T>
+    Vector<size_t> SplitIntoChunks(const T* first, size_t size, size_t grain_size) {
+        const size_t grain = std::max<size_t>(grain_size, 1);
+        const size_t count = std::max<size_t>((size + grain - 1) / grain, 1);
+
+        Vector<size_t> bounds;
+        bounds.Reserve(count + 1);
+        bounds.PushBack(0);
+
+        for (size_t i = 1; i < count; ++i) {
+            size_t bound = i * grain;
+            if constexpr (kCacheLineSize % sizeof(T) == 0) {
+                const uintptr_t address = reinterpret_cast<uintptr_t>(first + bound);
+                bound += ((kCacheLineSize - address % kCacheLineSize) % kCacheLineSize) / sizeof(T);
+            }
+
+            if (bound > bounds.Back() && bound < size) {
+                bounds.PushBack(bound);
+            }
+        }
+        bounds.PushBack(size);
+
+        return bounds;
+    }
+
+    // Calls f(chunk_index, chunk_first, chunk_size) for every chunk of the range in parallel. Returns the number of chunks
+    template <typename T, typename Function>
+    size_t ForEachChunk(T* first, size_t size, const ParallelOptions& options, Function&& f) {
+        const Vector<size_t> bounds = SplitIntoChunks(first, size, options.grain_size);
+        const size_t count = bounds.Size() - 1;
+
+        ParallelInvoke(count, options, [&](size_t index) {
+            f(index, first + bounds[index], bounds[index + 1] - bounds[index]);
+        });
+
+        return count;
+    }
+}
+
+
+
+
+
+// The algorithms take any contiguous range: Vector, SmallVector, MappedVector, std::span.
+// The pieces of a range are processed on ThreadPool workers, so the functions must be safe to call concurrently
+
+// Calls f for every element
+template <std::ranges::contiguous_range Range, typename Function>
+void ParallelForEach(Range&& range, Function f, const ParallelOptions& options = {}) {
+    detail::ForEachChunk(std::ranges::data(range), std::ranges::size(range), options, [&](size_t, auto* first, size_t size) {
+        std::for_each(first, first + size, f);
+    });
+}
+
+// Writes op(element) for every element of in to the element of out with the same index. out must be at least as long as in
+template <std::ranges::contiguous_range InRange, std::ranges::contiguous_range OutRange, typename UnaryOperation>
+void ParallelTransform(InRange&& in, OutRange&& out, UnaryOperation op, const ParallelOptions& options = {}) {
+    assert(std::ranges::size(out) >= std::ranges::size(in));
+
+    auto* out_first = std::ranges::data(out);
+    const auto* in_first = std::ranges::data(in);
+
+    detail::ForEachChunk(in_first, std::ranges::size(in), options, [&](size_t, const auto* first, size_t size) {
+        std::transform(first, first + size, out_first + (first - in_first), op);
+    });
+}
+
+// Folds the elements with op, which must be associative but not necessarily commutative:
+// the chunks are reduced in parallel and their results are combined in order, starting from init
+template <std::ranges::contiguous_range Range, typename Value, typename BinaryOperation = std::plus<>>
+Value ParallelReduce(Range&& range, Value init, BinaryOperation op = {}, const ParallelOptions& options = {}) {
+    const size_t size = std::ranges::size(range);
+    if (size == 0) return init;
+
+    const auto* data = std::ranges::data(range);
+    const Vector<size_t> bounds = detail::SplitIntoChunks(data, size, options.grain_size);
+    Vector<std::optional<Value>> partial(bounds.Size() - 1);
+
+    detail::ParallelInvoke(partial.Size(), options, [&](size_t index) {
+        Value acc(data[bounds[index]]);
+        for (size_t i = bounds[index] + 1; i < bounds[index + 1]; ++i) {
+            acc = op(std::move(acc), data[i]);
+        }
+        partial[index].emplace(std::move(acc));
+    });
+
+    for (std::optional<Value>& value : partial) {
+        init = op(std::move(init), std::move(*value));
+    }
+    return init;
+}
+
+// Sorts the chunks in parallel, then merges neighbouring runs in parallel rounds. Not stable
+template <std::ranges::contiguous_range Range, typename Compare = std::less<>>
+void ParallelSort(Range&& range, Compare comp = {}, const ParallelOptions& options = {}) {
+    auto* data = std::ranges::data(range);
+    const Vector<size_t> bounds = detail::SplitIntoChunks(data, std::ranges::size(range), options.grain_size);
+    const size_t count = bounds.Size() - 1;
+
+    detail::ParallelInvoke(count, options, [&](size_t index) {
+        std::sort(data + bounds[index], data + bounds[index + 1], comp);
+    });
+
+    for (size_t width = 1; width < count; width *= 2) {
+        const size_t merges = (count + 2 * width - 1) / (2 * width);
+
+        detail::ParallelInvoke(merges, options, [&](size_t index) {
+            const size_t left = index * 2 * width;
+            const size_t middle = std::min(left + width, count);
+            const size_t right = std::min(left + 2 * width, count);
+
+            std::inplace_merge(data + bounds[left], data + bounds[middle], data + bounds[right], comp);
+        });
+    }
+}
+
+
+
+// Parallel counterparts of Vector::Resize and the size and copy constructors. They split the work for trivial
+// element types, whose construction can't throw, and fall back to the serial versions otherwise.
+// The new elements are written by the workers which get their chunks in a parallel algorithm over the
+// whole vector with the same options, so with ParallelOptions::static_schedule and a NumaAllocator the
+// pages of a chunk are placed on the node of the worker which later scans it
+
+template <typename T, typename Allocator, typename GrowthPolicy>
+void ParallelResize(Vector<T, Allocator, GrowthPolicy>& v, size_t new_size, const ParallelOptions& options = {}) {
+    if constexpr (std::is_trivial_v<T>) {
+        const size_t old_size = v.Size();
+        v.ResizeUninitialized(new_size);
+
+        if (new_size > old_size) {
+            T* const fresh = v.Data() + old_size;
+            detail::ForEachChunk(v.Data(), new_size, options, [fresh](size_t, T* first, size_t size) {
+                T* const last = first + size;
+                if (last > fresh) {
+                    first = std::max(first, fresh);
+                    detail::UninitializedValueConstructN(first, static_cast<size_t>(last - first));
+                }
+            });
+        }
+    }
+    else {
+        v.Resize(new_size);
+    }
+}
+
+// A vector of size value-initialized elements
+template <typename T, typename Allocator = std::allocator<T>, typename GrowthPolicy = DoublingGrowth>
+Vector<T, Allocator, GrowthPolicy> ParallelVector(size_t size, const ParallelOptions& options = {},
+                                                  const Allocator& alloc = Allocator()) {
+    Vector<T, Allocator, GrowthPolicy> result(alloc);
+    ParallelResize(result, size, options);
+    return result;
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy>
+Vector<T, Allocator, GrowthPolicy> ParallelCopy(const Vector<T, Allocator, GrowthPolicy>& v, const ParallelOptions& options = {}) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        Vector<T, Allocator, GrowthPolicy> result(
+            std::allocator_traits<Allocator>::select_on_container_copy_construction(v.GetAllocator()));
+        result.ResizeUninitialized(v.Size());
+
+        T* out = result.Data();
+        detail::ForEachChunk(v.Data(), v.Size(), options, [&](size_t, const T* first, size_t size) {
+            detail::CopyBytes(first, size, out + (first - v.Data()));
+        });
+
+        return result;
+    }
+    else {
+        return v;
+    }
+}
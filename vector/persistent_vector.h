@@ -0,0 +1,579 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <array>
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+
+
+
+
+
+// Persistent vector: copies share their elements, and modifying one copies only the nodes on the path to the
+// changed element. The elements live in RawMemory chunks of kChunkSize, the leaves of a trie of kChunkSize-way
+// branches, except for the last chunk, the tail, which is kept out of the trie so appends rarely touch it.
+// Copying takes O(1); Set, PushBack and PopBack copy at most one node per trie level, O(log n), and work
+// in place on nodes no other copy shares. A copy per revision costs the changed paths instead of n elements:
+//
+//     PersistentVector<Item> state(std::move(items));
+//     history.PushBack(state);
+//     state.Set(3, edited);
+//
+// There is no non-const operator[]: an element is changed with Set. The reference counts are atomic, so
+// copies may be used and destroyed in different threads
+template <typename T, typename Allocator = std::allocator<T>>
+class PersistentVector {
+    static constexpr size_t kBits = 5;
+    static constexpr size_t kMask = (size_t{ 1 } << kBits) - 1;
+
+public:
+    static constexpr size_t kChunkSize = size_t{ 1 } << kBits;
+
+private:
+    struct Node {
+        std::atomic<size_t> refs{ 1 };
+    };
+
+    // A chunk with its first size elements constructed
+    struct Leaf : Node {
+        explicit Leaf(const Allocator& alloc)
+            : elements(kChunkSize, alloc) {
+        }
+
+        Leaf(const Leaf& other, size_t count)
+            : elements(kChunkSize, other.elements.GetAllocator()) {
+            detail::UninitializedCopyN(other.elements.GetAddress(), count, elements.GetAddress());
+            size = count;
+        }
+
+        ~Leaf() {
+            std::destroy_n(elements.GetAddress(), size);
+        }
+
+        RawMemory<T, Allocator> elements;
+        size_t size = 0;
+    };
+
+    struct Branch : Node {
+        Branch() = default;
+
+        // Shares the children of other
+        Branch(const Branch& other) noexcept
+            : count(other.count)
+            , children(other.children) {
+            for (size_t i = 0; i < count; ++i) {
+                children[i]->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        size_t count = 0;
+        std::array<Node*, kChunkSize> children{};
+    };
+
+    class Iterator;
+
+public:
+    using value_type = T;
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+    using allocator_type = Allocator;
+
+
+    PersistentVector() = default;
+
+    explicit PersistentVector(const Allocator& alloc) noexcept
+        : alloc_(alloc) {
+    }
+
+    // Copies the elements chunk by chunk, so trivially copyable ones are copied with memcpy
+    explicit PersistentVector(const Vector<T, Allocator>& elements)
+        : alloc_(elements.GetAllocator()) {
+        AppendChunks(elements.Data(), elements.Size(), [](const T* from, size_t count, T* to) {
+            detail::UninitializedCopyN(from, count, to);
+        });
+    }
+
+    explicit PersistentVector(Vector<T, Allocator>&& elements)
+        : alloc_(elements.GetAllocator()) {
+        AppendChunks(elements.Data(), elements.Size(), [](T* from, size_t count, T* to) {
+            std::uninitialized_move_n(from, count, to);
+        });
+    }
+
+    PersistentVector(const PersistentVector& other) noexcept
+        : alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.alloc_))
+        , root_(Share(other.root_))
+        , tail_(Share(other.tail_))
+        , shift_(other.shift_)
+        , size_(other.size_) {
+    }
+
+    PersistentVector(PersistentVector&& other) noexcept
+        : alloc_(other.alloc_)
+        , root_(std::exchange(other.root_, nullptr))
+        , tail_(std::exchange(other.tail_, nullptr))
+        , shift_(std::exchange(other.shift_, kBits))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    PersistentVector& operator=(PersistentVector rhs) noexcept {
+        Swap(rhs);
+        return *this;
+    }
+
+    ~PersistentVector() {
+        Release(root_, shift_);
+        Release(tail_, 0);
+    }
+
+
+    // Copies the elements into one buffer, a chunk at a time
+    Vector<T, Allocator> ToVector() const {
+        Vector<T, Allocator> result(alloc_);
+        result.Reserve(size_);
+        for (size_t first = 0; first < size_; first += kChunkSize) {
+            const Leaf* leaf = LeafFor(first);
+            result.Append(std::span<const T>(leaf->elements.GetAddress(), leaf->size));
+        }
+        return result;
+    }
+
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(this, size_);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    Allocator GetAllocator() const noexcept {
+        return alloc_;
+    }
+
+    // Takes O(log n), walking the trie from the root. Iterators walk it once per chunk
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return LeafFor(index)->elements[index & kMask];
+    }
+
+    const T& Back() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return tail_->elements[tail_->size - 1];
+    }
+    const T& Front() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return (*this)[0];
+    }
+
+
+    void Swap(PersistentVector& other) noexcept {
+        using std::swap;
+        swap(alloc_, other.alloc_);
+        std::swap(root_, other.root_);
+        std::swap(tail_, other.tail_);
+        std::swap(shift_, other.shift_);
+        std::swap(size_, other.size_);
+    }
+
+
+    // If copying a node throws, the vector is left holding the same elements
+    void Set(size_t index, const T& value) {
+        Mutable(index) = value;
+    }
+
+    void Set(size_t index, T&& value) {
+        Mutable(index) = std::move(value);
+    }
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+    void PushBack(T&& value) {
+        EmplaceBack(std::move(value));
+    }
+
+    // Provides the strong exception guarantee
+    template <typename... Args>
+    const T& EmplaceBack(Args&&... args) {
+        if (tail_ != nullptr && tail_->size < kChunkSize) {
+            OwnTail(tail_->size);
+            T* element = new (tail_->elements + tail_->size) T(std::forward<Args>(args)...);
+            ++tail_->size;
+            ++size_;
+            return *element;
+        }
+
+        auto fresh = std::make_unique<Leaf>(alloc_);
+        new (fresh->elements.GetAddress()) T(std::forward<Args>(args)...);
+        fresh->size = 1;
+        if (tail_ != nullptr) {
+            PushTail();
+        }
+        tail_ = fresh.release();
+        ++size_;
+        return tail_->elements[0];
+    }
+
+    // Takes the last chunk of the trie as the tail when the tail runs empty
+    void PopBack() {
+        VECTOR_CHECK(size_ != 0);
+
+        if (tail_->size > 1) {
+            if (tail_->refs.load(std::memory_order_acquire) == 1) {
+                std::destroy_at(tail_->elements + (tail_->size - 1));
+                --tail_->size;
+            }
+            else {
+                OwnTail(tail_->size - 1);
+            }
+        }
+        else if (size_ == 1) {
+            Release(std::exchange(tail_, nullptr), 0);
+        }
+        else {
+            Leaf* last = PopTail();
+            Release(std::exchange(tail_, last), 0);
+        }
+        --size_;
+    }
+
+private:
+    [[no_unique_address]] Allocator alloc_{};
+    Node* root_ = nullptr;
+    Leaf* tail_ = nullptr;
+    // The index bits the root branch selects its child by start at shift_; leaves are at shift 0
+    size_t shift_ = kBits;
+    size_t size_ = 0;
+
+
+    size_t TailOffset() const noexcept {
+        return size_ - (tail_ != nullptr ? tail_->size : 0);
+    }
+
+    const Leaf* LeafFor(size_t index) const noexcept {
+        if (index >= TailOffset()) {
+            return tail_;
+        }
+
+        const Node* node = root_;
+        for (size_t level = shift_; level > 0; level -= kBits) {
+            node = static_cast<const Branch*>(node)->children[(index >> level) & kMask];
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    template <typename NodeType>
+    static NodeType* Share(NodeType* node) noexcept {
+        if (node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    // Frees the node when this was its last owner. level tells leaves, at 0, from branches
+    static void Release(Node* node, size_t level) noexcept {
+        if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        if (level == 0) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Branch* branch = static_cast<Branch*>(node);
+        for (size_t i = 0; i < branch->count; ++i) {
+            Release(branch->children[i], level - kBits);
+        }
+        delete branch;
+    }
+
+    // Replaces a shared branch at level with a copy of its own, which holds the same elements, so the vector
+    // stays unchanged if the copy throws
+    static Branch* OwnBranch(Node*& node, size_t level) {
+        if (node->refs.load(std::memory_order_acquire) == 1) return static_cast<Branch*>(node);
+
+        Branch* copy = new Branch(*static_cast<Branch*>(node));
+        Release(std::exchange(node, copy), level);
+        return copy;
+    }
+
+    static Leaf* OwnLeaf(Node*& node) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        if (leaf->refs.load(std::memory_order_acquire) == 1) return leaf;
+
+        Leaf* copy = new Leaf(*leaf, leaf->size);
+        Release(std::exchange(node, copy), 0);
+        return copy;
+    }
+
+    // Owns the tail, copying only its first count elements when it is shared
+    void OwnTail(size_t count) {
+        if (tail_->refs.load(std::memory_order_acquire) == 1) return;
+
+        Leaf* copy = new Leaf(*tail_, count);
+        Release(std::exchange(tail_, copy), 0);
+    }
+
+    T& Mutable(size_t index) {
+        VECTOR_CHECK(index < size_);
+
+        if (index >= TailOffset()) {
+            OwnTail(tail_->size);
+            return tail_->elements[index & kMask];
+        }
+
+        Branch* node = OwnBranch(root_, shift_);
+        for (size_t level = shift_; level > kBits; level -= kBits) {
+            node = OwnBranch(node->children[(index >> level) & kMask], level - kBits);
+        }
+        return OwnLeaf(node->children[(index >> kBits) & kMask])->elements[index & kMask];
+    }
+
+    // A chain of single-child branches from level down to leaf. Frees the branches built if one throws
+    static Node* NewPath(size_t level, Leaf* leaf) {
+        Node* node = leaf;
+        try {
+            for (size_t l = kBits; l <= level; l += kBits) {
+                Branch* branch = new Branch;
+                branch->children[0] = node;
+                branch->count = 1;
+                node = branch;
+            }
+        }
+        catch (...) {
+            while (node != leaf) {
+                Branch* branch = static_cast<Branch*>(node);
+                node = branch->children[0];
+                delete branch;
+            }
+            throw;
+        }
+        return node;
+    }
+
+    // Moves the full tail into the trie, at index TailOffset(). The tail is left in place for the caller to replace
+    void PushTail() {
+        const size_t index = TailOffset();
+
+        if (root_ == nullptr) {
+            root_ = NewPath(kBits, tail_);
+            return;
+        }
+
+        // The trie is full: a new root gets the old one and a path to the tail
+        if (index == (kChunkSize << shift_)) {
+            Node* path = NewPath(shift_, tail_);
+            Branch* root = nullptr;
+            try {
+                root = new Branch;
+            }
+            catch (...) {
+                DeletePath(path, shift_);
+                throw;
+            }
+            root->children[0] = root_;
+            root->children[1] = path;
+            root->count = 2;
+            root_ = root;
+            shift_ += kBits;
+            return;
+        }
+
+        Branch* node = OwnBranch(root_, shift_);
+        for (size_t level = shift_;; level -= kBits) {
+            const size_t slot = (index >> level) & kMask;
+            if (level == kBits) {
+                node->children[slot] = tail_;
+                node->count = slot + 1;
+                return;
+            }
+            if (slot == node->count) {
+                node->children[slot] = NewPath(level - kBits, tail_);
+                node->count = slot + 1;
+                return;
+            }
+
+            node = OwnBranch(node->children[slot], level - kBits);
+        }
+    }
+
+    // Frees the branches of a path made by NewPath, leaving the leaf at its end
+    static void DeletePath(Node* node, size_t level) noexcept {
+        for (; level > 0; level -= kBits) {
+            Branch* branch = static_cast<Branch*>(node);
+            node = branch->children[0];
+            delete branch;
+        }
+    }
+
+    // Takes the last leaf out of the trie and returns it. The path to it is owned first, so a throwing copy
+    // leaves the trie unchanged, then emptied branches are freed and a root with one child is replaced by it
+    Leaf* PopTail() {
+        const size_t index = size_ - 2;
+
+        Branch* path[sizeof(size_t) * 8 / kBits + 1];
+        size_t depth = 0;
+        path[depth++] = OwnBranch(root_, shift_);
+        for (size_t level = shift_; level > kBits; level -= kBits) {
+            path[depth] = OwnBranch(path[depth - 1]->children[(index >> level) & kMask], level - kBits);
+            ++depth;
+        }
+
+        Leaf* leaf = static_cast<Leaf*>(path[depth - 1]->children[--path[depth - 1]->count]);
+        while (depth > 1 && path[depth - 1]->count == 0) {
+            delete path[--depth];
+            --path[depth - 1]->count;
+        }
+
+        if (path[0]->count == 0) {
+            delete path[0];
+            root_ = nullptr;
+            shift_ = kBits;
+        }
+        else if (path[0]->count == 1 && shift_ > kBits) {
+            root_ = path[0]->children[0];
+            delete path[0];
+            shift_ -= kBits;
+        }
+        return leaf;
+    }
+
+    // Builds the trie from a buffer, filling each chunk with transfer(from, count, to)
+    template <typename Pointer, typename Transfer>
+    void AppendChunks(Pointer elements, size_t size, Transfer transfer) {
+        try {
+            for (size_t first = 0; first < size; first += kChunkSize) {
+                auto leaf = std::make_unique<Leaf>(alloc_);
+                const size_t count = std::min(kChunkSize, size - first);
+                transfer(elements + first, count, leaf->elements.GetAddress());
+                leaf->size = count;
+
+                if (tail_ != nullptr) {
+                    PushTail();
+                }
+                tail_ = leaf.release();
+                size_ += count;
+            }
+        }
+        catch (...) {
+            Release(std::exchange(root_, nullptr), shift_);
+            Release(std::exchange(tail_, nullptr), 0);
+            throw;
+        }
+    }
+};
+
+
+// Random access iterator which keeps a pointer to the chunk of its element, so only crossing into
+// another chunk walks the trie
+template <typename T, typename Allocator>
+class PersistentVector<T, Allocator>::Iterator {
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    Iterator() = default;
+
+    Iterator(const PersistentVector* owner, size_t index) noexcept
+        : owner_(owner)
+        , index_(index) {
+        Locate();
+    }
+
+    reference operator*() const noexcept {
+        return chunk_[index_ & kMask];
+    }
+    pointer operator->() const noexcept {
+        return chunk_ + (index_ & kMask);
+    }
+    reference operator[](difference_type n) const noexcept {
+        return *(*this + n);
+    }
+
+    Iterator& operator++() noexcept {
+        if ((++index_ & kMask) == 0 || chunk_ == nullptr) {
+            Locate();
+        }
+        return *this;
+    }
+    Iterator operator++(int) noexcept {
+        Iterator copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    Iterator& operator--() noexcept {
+        // end() has no chunk, so stepping back from it always looks the element up
+        if ((index_-- & kMask) == 0 || chunk_ == nullptr) {
+            Locate();
+        }
+        return *this;
+    }
+    Iterator operator--(int) noexcept {
+        Iterator copy = *this;
+        --*this;
+        return copy;
+    }
+
+    Iterator& operator+=(difference_type n) noexcept {
+        const size_t chunk = index_ >> kBits;
+        index_ += n;
+        if ((index_ >> kBits) != chunk || chunk_ == nullptr) {
+            Locate();
+        }
+        return *this;
+    }
+    Iterator& operator-=(difference_type n) noexcept {
+        return *this += -n;
+    }
+
+    friend Iterator operator+(Iterator it, difference_type n) noexcept {
+        return it += n;
+    }
+    friend Iterator operator+(difference_type n, Iterator it) noexcept {
+        return it += n;
+    }
+    friend Iterator operator-(Iterator it, difference_type n) noexcept {
+        return it -= n;
+    }
+    friend difference_type operator-(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return static_cast<difference_type>(lhs.index_) - static_cast<difference_type>(rhs.index_);
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ == rhs.index_;
+    }
+    friend std::strong_ordering operator<=>(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ <=> rhs.index_;
+    }
+
+private:
+    void Locate() noexcept {
+        chunk_ = index_ < owner_->size_ ? owner_->LeafFor(index_)->elements.GetAddress() : nullptr;
+    }
+
+    const PersistentVector* owner_ = nullptr;
+    size_t index_ = 0;
+    const T* chunk_ = nullptr;
+};
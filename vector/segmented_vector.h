@@ -0,0 +1,436 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+
+
+
+
+
+// Double-ended vector of RawMemory blocks of kBlockSize elements, which never moves its elements: references
+// stay valid until their element is removed, and appending at either end costs no more than allocating
+// a block. The blocks are kept in an index table used as a ring, so the elements may start anywhere in it;
+// only the table, a pointer per block, is copied when the ring is full.
+// Blocks emptied by pops stay allocated and are reused, so a vector used as a queue stops allocating once
+// it reaches its working size. ShrinkToFit frees them.
+// ForEachSegment gives the elements block by block as spans, which loops can be vectorized over
+template <typename T, typename Allocator = std::allocator<T>>
+class SegmentedVector {
+    using Block = RawMemory<T, Allocator>;
+
+    template <bool IsConst>
+    class Iterator;
+
+public:
+    // About 4 KiB per block, and a power of two so an index splits into a block and an offset with a shift
+    static constexpr size_t kBlockSize = std::bit_floor(std::max<size_t>(16, 4096 / sizeof(T)));
+
+    using value_type = T;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+    using allocator_type = Allocator;
+
+
+    SegmentedVector() = default;
+
+    explicit SegmentedVector(const Allocator& alloc) noexcept
+        : alloc_(alloc) {
+    }
+
+    SegmentedVector(const SegmentedVector& other)
+        : alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.alloc_)) {
+        try {
+            other.ForEachSegment([this](std::span<const T> segment) {
+                for (const T& value : segment) {
+                    EmplaceBack(value);
+                }
+            });
+        }
+        catch (...) {
+            Clear();
+            throw;
+        }
+    }
+
+    SegmentedVector(SegmentedVector&& other) noexcept
+        : alloc_(other.alloc_)
+        , blocks_(std::move(other.blocks_))
+        , first_(std::exchange(other.first_, 0))
+        , size_(std::exchange(other.size_, 0)) {
+    }
+
+    SegmentedVector& operator=(const SegmentedVector& rhs) {
+        if (this != &rhs) {
+            SegmentedVector copy(rhs);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    SegmentedVector& operator=(SegmentedVector&& rhs) noexcept {
+        if (this != &rhs) {
+            SegmentedVector moved(std::move(rhs));
+            Swap(moved);
+        }
+        return *this;
+    }
+
+    ~SegmentedVector() {
+        Clear();
+    }
+
+
+    iterator begin() noexcept {
+        return iterator(this, 0);
+    }
+    iterator end() noexcept {
+        return iterator(this, size_);
+    }
+    const_iterator begin() const noexcept {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(this, size_);
+    }
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    // The number of elements the allocated blocks hold
+    size_t Capacity() const noexcept {
+        size_t capacity = 0;
+        for (const Block& block : blocks_) {
+            capacity += block.Capacity();
+        }
+        return capacity;
+    }
+
+    Allocator GetAllocator() const noexcept {
+        return alloc_;
+    }
+
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return *Slot(Position(index));
+    }
+
+    T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
+        return *Slot(Position(index));
+    }
+
+    const T& Front() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *Slot(first_);
+    }
+    T& Front() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *Slot(first_);
+    }
+
+    const T& Back() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *Slot(Position(size_ - 1));
+    }
+    T& Back() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return *Slot(Position(size_ - 1));
+    }
+
+
+    // Calls f(std::span<const T>) for the runs of elements in one block, from the front to the back
+    template <typename Function>
+    void ForEachSegment(Function f) const {
+        VisitSegments(*this, f);
+    }
+
+    // Calls f(std::span<T>)
+    template <typename Function>
+    void ForEachSegment(Function f) {
+        VisitSegments(*this, f);
+    }
+
+
+    // The allocators must be equal unless they propagate on swap, as for Vector
+    void Swap(SegmentedVector& other) noexcept {
+        if constexpr (std::allocator_traits<Allocator>::propagate_on_container_swap::value) {
+            using std::swap;
+            swap(alloc_, other.alloc_);
+        }
+        else {
+            VECTOR_CHECK(alloc_ == other.alloc_);
+        }
+        blocks_.Swap(other.blocks_);
+        std::swap(first_, other.first_);
+        std::swap(size_, other.size_);
+    }
+
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+    void PushBack(T&& value) {
+        EmplaceBack(std::move(value));
+    }
+
+    void PushFront(const T& value) {
+        EmplaceFront(value);
+    }
+
+    void PushFront(T&& value) {
+        EmplaceFront(std::move(value));
+    }
+
+    // Provides the strong exception guarantee. No element is moved, so args may refer to elements of the vector
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        size_t position = Position(size_);
+        if (size_ == 0 || position % kBlockSize == 0) {
+            position = PrepareBlock(size_ == 0 ? first_ : position, true);
+        }
+
+        T* element = new (Slot(position)) T(std::forward<Args>(args)...);
+        if (size_ == 0) {
+            first_ = position;
+        }
+        ++size_;
+        return *element;
+    }
+
+    template <typename... Args>
+    T& EmplaceFront(Args&&... args) {
+        if (size_ == 0) {
+            return EmplaceBack(std::forward<Args>(args)...);
+        }
+
+        size_t position = Position(RingSize() - 1);
+        if (first_ % kBlockSize == 0) {
+            position = PrepareBlock(position, false);
+        }
+
+        T* element = new (Slot(position)) T(std::forward<Args>(args)...);
+        first_ = position;
+        ++size_;
+        return *element;
+    }
+
+    void PopBack() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        std::destroy_at(Slot(Position(size_ - 1)));
+        --size_;
+    }
+
+    void PopFront() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        std::destroy_at(Slot(first_));
+        first_ = Position(1);
+        --size_;
+    }
+
+    // Keeps the blocks for reuse
+    void Clear() noexcept {
+        ForEachSegment([](std::span<T> segment) {
+            std::destroy(segment.begin(), segment.end());
+        });
+        first_ = 0;
+        size_ = 0;
+    }
+
+    // Frees the blocks no element is in, and the index table if the vector is empty
+    void ShrinkToFit() noexcept {
+        if (size_ == 0) {
+            blocks_.Clear(ClearMode::ReleaseCapacity);
+            first_ = 0;
+            return;
+        }
+
+        const size_t first_block = first_ / kBlockSize;
+        const size_t last_block = Position(size_ - 1) / kBlockSize;
+        for (size_t block = (last_block + 1) & (blocks_.Size() - 1); block != first_block; block = (block + 1) & (blocks_.Size() - 1)) {
+            blocks_[block] = Block(alloc_);
+        }
+    }
+
+private:
+    [[no_unique_address]] Allocator alloc_{};
+    // A power of two of slots, each holding an allocated block or an empty one, all with a copy of alloc_
+    Vector<Block> blocks_;
+    // The position of the front element, counted over the ring of blocks
+    size_t first_ = 0;
+    size_t size_ = 0;
+
+
+    size_t RingSize() const noexcept {
+        return blocks_.Size() * kBlockSize;
+    }
+
+    // The position of the element index places after the front, wrapped around the ring
+    size_t Position(size_t index) const noexcept {
+        return (first_ + index) & (RingSize() - 1);
+    }
+
+    T* Slot(size_t position) const noexcept {
+        return const_cast<T*>(blocks_[position / kBlockSize].GetAddress()) + position % kBlockSize;
+    }
+
+    // Makes sure the block with position, which the vector is about to enter at its back or front, is allocated
+    // and holds no elements of the other end. Otherwise the table doubles, keeping the blocks in order from
+    // the front one. Returns the position of the new element, which moves if the table does
+    size_t PrepareBlock(size_t position, bool at_back) {
+        if (blocks_.Size() == 0 || (size_ != 0 && position / kBlockSize == (at_back ? first_ : Position(size_ - 1)) / kBlockSize)) {
+            GrowTable();
+            position = at_back ? Position(size_) : Position(RingSize() - 1);
+        }
+
+        Block& block = blocks_[position / kBlockSize];
+        if (block.Capacity() == 0) {
+            block = Block(kBlockSize, alloc_);
+        }
+        return position;
+    }
+
+    void GrowTable() {
+        const size_t old_blocks = blocks_.Size();
+        const size_t new_blocks = std::max<size_t>(old_blocks * 2, 2);
+
+        // Every slot holds a copy of the allocator, so the blocks moved into it are freed through that allocator
+        // even when it doesn't propagate on move assignment
+        Vector<Block> blocks;
+        blocks.Reserve(new_blocks);
+        for (size_t i = 0; i < new_blocks; ++i) {
+            blocks.EmplaceBack(alloc_);
+        }
+
+        const size_t first_block = first_ / kBlockSize;
+        for (size_t i = 0; i < old_blocks; ++i) {
+            blocks[i] = std::move(blocks_[(first_block + i) % old_blocks]);
+        }
+        blocks_.Swap(blocks);
+        first_ %= kBlockSize;
+    }
+
+    template <typename Self, typename Function>
+    static void VisitSegments(Self& self, Function& f) {
+        using Element = std::conditional_t<std::is_const_v<Self>, const T, T>;
+
+        for (size_t index = 0; index < self.size_;) {
+            const size_t position = self.Position(index);
+            const size_t count = std::min(kBlockSize - position % kBlockSize, self.size_ - index);
+            f(std::span<Element>(self.Slot(position), count));
+            index += count;
+        }
+    }
+};
+
+
+// Random access iterator over the elements in order. Finding the element takes a few instructions;
+// ForEachSegment is faster for whole passes
+template <typename T, typename Allocator>
+template <bool IsConst>
+class SegmentedVector<T, Allocator>::Iterator {
+    using Owner = std::conditional_t<IsConst, const SegmentedVector, SegmentedVector>;
+
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<IsConst, const T*, T*>;
+    using reference = std::conditional_t<IsConst, const T&, T&>;
+
+    Iterator() = default;
+
+    Iterator(Owner* owner, size_t index) noexcept
+        : owner_(owner)
+        , index_(index) {
+    }
+
+    template <bool OtherConst>
+        requires (IsConst && !OtherConst)
+    Iterator(const Iterator<OtherConst>& other) noexcept
+        : owner_(other.owner_)
+        , index_(other.index_) {
+    }
+
+    reference operator*() const noexcept {
+        return (*owner_)[index_];
+    }
+    pointer operator->() const noexcept {
+        return &(*owner_)[index_];
+    }
+    reference operator[](difference_type n) const noexcept {
+        return (*owner_)[index_ + n];
+    }
+
+    Iterator& operator++() noexcept {
+        ++index_;
+        return *this;
+    }
+    Iterator operator++(int) noexcept {
+        Iterator copy = *this;
+        ++index_;
+        return copy;
+    }
+    Iterator& operator--() noexcept {
+        --index_;
+        return *this;
+    }
+    Iterator operator--(int) noexcept {
+        Iterator copy = *this;
+        --index_;
+        return copy;
+    }
+
+    Iterator& operator+=(difference_type n) noexcept {
+        index_ += n;
+        return *this;
+    }
+    Iterator& operator-=(difference_type n) noexcept {
+        index_ -= n;
+        return *this;
+    }
+
+    friend Iterator operator+(Iterator it, difference_type n) noexcept {
+        return it += n;
+    }
+    friend Iterator operator+(difference_type n, Iterator it) noexcept {
+        return it += n;
+    }
+    friend Iterator operator-(Iterator it, difference_type n) noexcept {
+        return it -= n;
+    }
+    friend difference_type operator-(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return static_cast<difference_type>(lhs.index_) - static_cast<difference_type>(rhs.index_);
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ == rhs.index_;
+    }
+    friend std::strong_ordering operator<=>(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ <=> rhs.index_;
+    }
+
+private:
+    template <bool>
+    friend class Iterator;
+
+    Owner* owner_ = nullptr;
+    size_t index_ = 0;
+};
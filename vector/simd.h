@@ -0,0 +1,621 @@
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_SIMD_X86 1
+#endif
+
+
+
+
+
+// Vectorized kernels for contiguous ranges of 4- and 8-byte arithmetic elements, like Vector<float> or Vector<int64_t>.
+// The kernels are written once with GCC/Clang vector extensions and compiled for each instruction set;
+// the widest one the CPU supports is picked at run time. Elements are loaded into locals, so unlike loops
+// over a container the compiler doesn't have to prove that stores don't alias the size or the data pointer
+namespace simd {
+
+enum class Isa {
+    Scalar,
+    // 16-byte vectors, always there on AArch64
+    Neon,
+    Sse42,
+    Avx2,
+    Avx512,
+};
+
+inline Isa DetectIsa() noexcept {
+#if defined(VECTOR_SIMD_X86)
+    if (__builtin_cpu_supports("avx512f")) return Isa::Avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Isa::Avx2;
+    if (__builtin_cpu_supports("sse4.2")) return Isa::Sse42;
+    return Isa::Scalar;
+#elif defined(__aarch64__)
+    return Isa::Neon;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+inline bool IsSupported(Isa isa) noexcept {
+    if (isa == Isa::Scalar) return true;
+#if defined(VECTOR_SIMD_X86)
+    return isa != Isa::Neon && isa <= DetectIsa();
+#else
+    return isa == DetectIsa();
+#endif
+}
+
+namespace detail {
+    inline Isa& ActiveIsa() noexcept {
+        static Isa isa = DetectIsa();
+        return isa;
+    }
+}
+
+inline Isa GetIsa() noexcept {
+    return detail::ActiveIsa();
+}
+
+// Makes the kernels use isa, which must be supported. Meant for tests and benchmarks, not thread-safe
+inline void SetIsa(Isa isa) noexcept {
+    assert(IsSupported(isa));
+    detail::ActiveIsa() = isa;
+}
+
+template <typename T>
+concept Element = std::is_arithmetic_v<T> && !std::is_same_v<T, bool> && (sizeof(T) == 4 || sizeof(T) == 8);
+
+template <typename Range>
+concept ElementRange = std::ranges::contiguous_range<Range> && Element<std::ranges::range_value_t<Range>>;
+
+
+
+
+
+namespace detail {
+    template <typename T, size_t Width>
+    struct VecOf {
+        typedef T type __attribute__((vector_size(Width)));
+    };
+
+    // Width bytes of T, or a plain T for Width 0
+    template <typename T, size_t Width>
+    using Vec = typename VecOf<T, Width>::type;
+
+#define VECTOR_SIMD_INLINE [[gnu::always_inline]] inline
+
+    // Vectors are passed by reference only: passing them by value from code compiled without AVX
+    // would change their ABI
+    template <typename V>
+    VECTOR_SIMD_INLINE void Load(V& v, const void* p) noexcept {
+        std::memcpy(&v, p, sizeof(V));
+    }
+
+    template <typename V>
+    VECTOR_SIMD_INLINE void Store(void* p, const V& v) noexcept {
+        std::memcpy(p, &v, sizeof(V));
+    }
+
+    template <typename Mask>
+    VECTOR_SIMD_INLINE bool Any(const Mask& mask) noexcept {
+        constexpr size_t kLanes = sizeof(Mask) / sizeof(mask[0]);
+
+        bool any = false;
+        for (size_t j = 0; j < kLanes; ++j) {
+            any |= mask[j] != 0;
+        }
+        return any;
+    }
+
+    template <typename T, typename V>
+    VECTOR_SIMD_INLINE T HorizontalSum(const V& v) noexcept {
+        T sum{};
+        for (size_t j = 0; j < sizeof(V) / sizeof(T); ++j) {
+            sum += v[j];
+        }
+        return sum;
+    }
+
+    // Each kernel is a struct with a static Run<Width> template, Width 0 being the scalar version.
+    // Run is always inlined into a trampoline compiled for the instruction set of the width
+
+    struct FindKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static size_t Run(const T* data, size_t size, T value) noexcept {
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+                const V needle = V{} + value;
+
+                for (V v; i + kLanes <= size; i += kLanes) {
+                    Load(v, data + i);
+                    if (Any(v == needle)) break;
+                }
+            }
+            for (; i < size; ++i) {
+                if (data[i] == value) return i;
+            }
+            return size;
+        }
+    };
+
+    struct CountKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static size_t Run(const T* data, size_t size, T value) noexcept {
+            size_t count = 0;
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+                const V needle = V{} + value;
+
+                // Matches are subtracted as -1 lanes, which are flushed before 32-bit lanes could overflow
+                while (i + kLanes <= size) {
+                    const size_t end = i + std::min((size - i) / kLanes, size_t{ 1 } << 30) * kLanes;
+
+                    decltype(needle == needle) matches{};
+                    for (V v; i < end; i += kLanes) {
+                        Load(v, data + i);
+                        matches += v == needle;
+                    }
+                    for (size_t j = 0; j < kLanes; ++j) {
+                        count += static_cast<size_t>(-matches[j]);
+                    }
+                }
+            }
+            for (; i < size; ++i) {
+                count += data[i] == value;
+            }
+            return count;
+        }
+    };
+
+    template <bool IsMax>
+    struct ExtremumKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static T Run(const T* data, size_t size) noexcept {
+            T result = data[0];
+            size_t i = 1;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+
+                if (size >= kLanes) {
+                    i = kLanes;
+                    V acc;
+                    Load(acc, data);
+                    for (V v; i + kLanes <= size; i += kLanes) {
+                        Load(v, data + i);
+                        acc = (IsMax ? v > acc : v < acc) ? v : acc;
+                    }
+                    result = acc[0];
+                    for (size_t j = 1; j < kLanes; ++j) {
+                        result = (IsMax ? acc[j] > result : acc[j] < result) ? acc[j] : result;
+                    }
+                }
+            }
+            for (; i < size; ++i) {
+                result = (IsMax ? data[i] > result : data[i] < result) ? data[i] : result;
+            }
+            return result;
+        }
+    };
+
+    // Sums a[i] * b[i], or a[i] when b is nullptr. Four accumulators hide the latency of the additions
+    struct SumKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static T Run(const T* a, const T* b, size_t size) noexcept {
+            T sum{};
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+
+                V acc[4] = {};
+                for (; i + 4 * kLanes <= size; i += 4 * kLanes) {
+                for (size_t k = 0; k < 4; ++k) {
+                        AddTerm(acc[k], a, b, i + k * kLanes);
+                    }
+                }
+                for (; i + kLanes <= size; i += kLanes) {
+                    AddTerm(acc[0], a, b, i);
+                }
+                sum = HorizontalSum<T>((acc[0] + acc[1]) + (acc[2] + acc[3]));
+            }
+            for (; i < size; ++i) {
+                sum += b != nullptr ? a[i] * b[i] : a[i];
+            }
+            return sum;
+        }
+
+        template <typename V, typename T>
+        VECTOR_SIMD_INLINE static void AddTerm(V& acc, const T* a, const T* b, size_t index) noexcept {
+            V term;
+            Load(term, a + index);
+            if (b != nullptr) {
+                V factor;
+                Load(factor, b + index);
+                term *= factor;
+            }
+            acc += term;
+        }
+    };
+
+    struct FillKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static void Run(T* data, size_t size, T value) noexcept {
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+                const V v = V{} + value;
+
+                for (; i + kLanes <= size; i += kLanes) {
+                    Store(data + i, v);
+                }
+            }
+            for (; i < size; ++i) {
+                data[i] = value;
+            }
+        }
+    };
+
+    // out[i] = op(a[i], b[i], c[i]), where op stores its result in its first argument. c is only read by ternary operations
+    template <typename Operation>
+    struct ElementwiseKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static void Run(const T* a, const T* b, const T* c, T* out, size_t size) noexcept {
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<T, Width>;
+                constexpr size_t kLanes = Width / sizeof(T);
+
+                for (V va, vb, vc{}; i + kLanes <= size; i += kLanes) {
+                    Load(va, a + i);
+                    Load(vb, b + i);
+                    if (c != nullptr) {
+                        Load(vc, c + i);
+                    }
+                    Operation::Apply(va, vb, vc);
+                    Store(out + i, va);
+                }
+            }
+            for (T va, vb, vc{}; i < size; ++i) {
+                va = a[i];
+                vb = b[i];
+                if (c != nullptr) {
+                    vc = c[i];
+                }
+                Operation::Apply(va, vb, vc);
+                out[i] = va;
+            }
+        }
+    };
+
+    struct AddOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& /*c*/) noexcept {
+            a += b;
+        }
+    };
+
+    struct MulOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& /*c*/) noexcept {
+            a *= b;
+        }
+    };
+
+    struct FmaOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& c) noexcept {
+            a = a * b + c;
+        }
+    };
+
+    struct AndOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& /*c*/) noexcept {
+            a &= b;
+        }
+    };
+
+    struct OrOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& /*c*/) noexcept {
+            a |= b;
+        }
+    };
+
+    struct XorOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& b, const V& /*c*/) noexcept {
+            a ^= b;
+        }
+    };
+
+    struct NotOperation {
+        template <typename V>
+        VECTOR_SIMD_INLINE static void Apply(V& a, const V& /*b*/, const V& /*c*/) noexcept {
+            a = ~a;
+        }
+    };
+
+    // Counts the set bits of 64-bit words. The vector version counts bits within the bytes of each lane with shifts
+    // and masks, which every instruction set has for 64-bit lanes, and adds the byte counts up in bytes for
+    // up to 31 vectors before they could overflow
+    struct PopCountKernel {
+        template <size_t Width>
+        VECTOR_SIMD_INLINE static size_t Run(const uint64_t* data, size_t size) noexcept {
+            size_t count = 0;
+            size_t i = 0;
+            if constexpr (Width != 0) {
+                using V = Vec<uint64_t, Width>;
+                constexpr size_t kLanes = Width / sizeof(uint64_t);
+                const V m1 = V{} + 0x5555555555555555u;
+                const V m2 = V{} + 0x3333333333333333u;
+                const V m4 = V{} + 0x0F0F0F0F0F0F0F0Fu;
+                const V m8 = V{} + 0x00FF00FF00FF00FFu;
+                const V m16 = V{} + 0x0000FFFF0000FFFFu;
+                const V m32 = V{} + 0x00000000FFFFFFFFu;
+
+                V total{};
+                while (i + kLanes <= size) {
+                    const size_t end = i + std::min((size - i) / kLanes, size_t{ 31 }) * kLanes;
+
+                    V bytes{};
+                    for (V v; i < end; i += kLanes) {
+                        Load(v, data + i);
+                        v = v - ((v >> 1) & m1);
+                        v = (v & m2) + ((v >> 2) & m2);
+                        bytes += (v + (v >> 4)) & m4;
+                    }
+                    bytes = (bytes & m8) + ((bytes >> 8) & m8);
+                    bytes = (bytes & m16) + ((bytes >> 16) & m16);
+                    total += (bytes & m32) + (bytes >> 32);
+                }
+                count = HorizontalSum<size_t>(total);
+            }
+            for (; i < size; ++i) {
+                count += static_cast<size_t>(__builtin_popcountll(data[i]));
+            }
+            return count;
+        }
+    };
+
+    // Copies the elements with a true keep flag to the front of out without branches: every element is stored,
+    // and the write position moves on only past the kept ones
+    struct CompactKernel {
+        template <size_t Width, typename T>
+        VECTOR_SIMD_INLINE static size_t Run(const T* in, const bool* keep, T* out, size_t size) noexcept {
+            size_t count = 0;
+            for (size_t i = 0; i < size; ++i) {
+                out[count] = in[i];
+                count += keep[i];
+            }
+            return count;
+        }
+    };
+
+#if defined(VECTOR_SIMD_X86)
+
+    template <typename Kernel, typename... Args>
+    [[gnu::target("sse4.2")]] auto RunSse42(Args... args) noexcept {
+        return Kernel::template Run<16>(args...);
+    }
+
+    template <typename Kernel, typename... Args>
+    [[gnu::target("avx2,fma")]] auto RunAvx2(Args... args) noexcept {
+        return Kernel::template Run<32>(args...);
+    }
+
+    template <typename Kernel, typename... Args>
+    [[gnu::target("avx512f")]] auto RunAvx512(Args... args) noexcept {
+        return Kernel::template Run<64>(args...);
+    }
+
+    // AVX-512 stores the kept lanes of a whole vector at once with a compress store
+    template <typename T>
+    [[gnu::target("avx512f")]] size_t CompactAvx512(const T* in, const bool* keep, T* out, size_t size) noexcept {
+        size_t count = 0;
+        size_t i = 0;
+        if constexpr (sizeof(T) == 4) {
+            for (; i + 16 <= size; i += 16) {
+                const __m512i flags = _mm512_maskz_cvtepu8_epi32(0xFFFF, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keep + i)));
+                const __mmask16 mask = _mm512_test_epi32_mask(flags, flags);
+                _mm512_mask_compressstoreu_epi32(out + count, mask, _mm512_loadu_si512(in + i));
+                count += __builtin_popcount(mask);
+            }
+        }
+        else {
+            for (; i + 8 <= size; i += 8) {
+                const __m512i flags = _mm512_maskz_cvtepu8_epi64(0xFF, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(keep + i)));
+                const __mmask8 mask = _mm512_test_epi64_mask(flags, flags);
+                _mm512_mask_compressstoreu_epi64(out + count, mask, _mm512_loadu_si512(in + i));
+                count += __builtin_popcount(mask);
+            }
+        }
+        return count + CompactKernel::Run<0>(in + i, keep + i, out + count, size - i);
+    }
+
+#endif
+
+    template <typename Kernel, typename... Args>
+    auto Dispatch(Args... args) noexcept {
+        switch (GetIsa()) {
+#if defined(VECTOR_SIMD_X86)
+        case Isa::Avx512:
+            return RunAvx512<Kernel>(args...);
+        case Isa::Avx2:
+            return RunAvx2<Kernel>(args...);
+        case Isa::Sse42:
+            return RunSse42<Kernel>(args...);
+#elif defined(__aarch64__)
+        case Isa::Neon:
+            return Kernel::template Run<16>(args...);
+#endif
+        default:
+            return Kernel::template Run<0>(args...);
+        }
+    }
+
+#undef VECTOR_SIMD_INLINE
+
+    template <typename Range>
+    using ElementOf = std::ranges::range_value_t<Range>;
+}
+
+
+
+
+
+// Iterator to the first element equal to value, or the end of the range
+template <ElementRange Range>
+auto Find(Range&& range, detail::ElementOf<Range> value) noexcept {
+    return std::ranges::begin(range)
+           + detail::Dispatch<detail::FindKernel>(std::ranges::cdata(range), std::ranges::size(range), value);
+}
+
+template <ElementRange Range>
+size_t Count(const Range& range, detail::ElementOf<Range> value) noexcept {
+    return detail::Dispatch<detail::CountKernel>(std::ranges::cdata(range), std::ranges::size(range), value);
+}
+
+// The range must not be empty. The result is unspecified if it holds a NaN
+template <ElementRange Range>
+detail::ElementOf<Range> Min(const Range& range) noexcept {
+    assert(std::ranges::size(range) != 0);
+    return detail::Dispatch<detail::ExtremumKernel<false>>(std::ranges::cdata(range), std::ranges::size(range));
+}
+
+template <ElementRange Range>
+detail::ElementOf<Range> Max(const Range& range) noexcept {
+    assert(std::ranges::size(range) != 0);
+    return detail::Dispatch<detail::ExtremumKernel<true>>(std::ranges::cdata(range), std::ranges::size(range));
+}
+
+// Floating-point sums are added in a different order than by std::accumulate, so they may differ in the last bits
+template <ElementRange Range>
+detail::ElementOf<Range> Sum(const Range& range) noexcept {
+    using T = detail::ElementOf<Range>;
+    return detail::Dispatch<detail::SumKernel>(std::ranges::cdata(range), static_cast<const T*>(nullptr),
+                                               std::ranges::size(range));
+}
+
+template <ElementRange Range1, ElementRange Range2>
+    requires std::is_same_v<detail::ElementOf<Range1>, detail::ElementOf<Range2>>
+detail::ElementOf<Range1> Dot(const Range1& a, const Range2& b) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b));
+    return detail::Dispatch<detail::SumKernel>(std::ranges::cdata(a), std::ranges::cdata(b), std::ranges::size(a));
+}
+
+template <ElementRange Range>
+void Fill(Range&& range, detail::ElementOf<Range> value) noexcept {
+    detail::Dispatch<detail::FillKernel>(std::ranges::data(range), std::ranges::size(range), value);
+}
+
+// The elementwise operations write element i of out from element i of the inputs. out must be as long as
+// the inputs and may be one of them
+template <ElementRange Range1, ElementRange Range2, ElementRange OutRange>
+void Add(const Range1& a, const Range2& b, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::AddOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+template <ElementRange Range1, ElementRange Range2, ElementRange OutRange>
+void Mul(const Range1& a, const Range2& b, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::MulOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+// out = a * b + c. Where the instruction set has FMA the product may be fused with the addition
+template <ElementRange Range1, ElementRange Range2, ElementRange Range3, ElementRange OutRange>
+void Fma(const Range1& a, const Range2& b, const Range3& c, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(c)
+           && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::FmaOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), std::ranges::cdata(c), std::ranges::data(out), std::ranges::size(a));
+}
+
+// Copies the elements of in whose keep flag is true to the front of out, keeping their order, and returns their number.
+// out must be as long as in, its elements past the returned count are overwritten with unspecified values.
+// out may be in itself, which compacts in place
+template <ElementRange Range, ElementRange OutRange>
+size_t Compact(const Range& in, std::span<const bool> keep, OutRange&& out) noexcept {
+    assert(keep.size() == std::ranges::size(in) && std::ranges::size(out) >= std::ranges::size(in));
+
+    auto* first = std::ranges::cdata(in);
+    auto* out_first = std::ranges::data(out);
+    const size_t size = std::ranges::size(in);
+
+#if defined(VECTOR_SIMD_X86)
+    if (GetIsa() == Isa::Avx512) {
+        return detail::CompactAvx512(first, keep.data(), out_first, size);
+    }
+#endif
+    return detail::CompactKernel::Run<0>(first, keep.data(), out_first, size);
+}
+
+
+// Bitwise operations on ranges of integers, with the same rules as Add. out may be one of the inputs
+template <ElementRange Range1, ElementRange Range2, ElementRange OutRange>
+    requires std::integral<detail::ElementOf<Range1>>
+void And(const Range1& a, const Range2& b, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::AndOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+template <ElementRange Range1, ElementRange Range2, ElementRange OutRange>
+    requires std::integral<detail::ElementOf<Range1>>
+void Or(const Range1& a, const Range2& b, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::OrOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+template <ElementRange Range1, ElementRange Range2, ElementRange OutRange>
+    requires std::integral<detail::ElementOf<Range1>>
+void Xor(const Range1& a, const Range2& b, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(b) && std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::XorOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(b), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+template <ElementRange Range, ElementRange OutRange>
+    requires std::integral<detail::ElementOf<Range>>
+void Not(const Range& a, OutRange&& out) noexcept {
+    assert(std::ranges::size(a) == std::ranges::size(out));
+    detail::Dispatch<detail::ElementwiseKernel<detail::NotOperation>>(
+        std::ranges::cdata(a), std::ranges::cdata(a), static_cast<decltype(std::ranges::cdata(a))>(nullptr),
+        std::ranges::data(out), std::ranges::size(a));
+}
+
+// The number of set bits in the words of a range of 64-bit unsigned integers
+template <std::ranges::contiguous_range Range>
+    requires std::is_same_v<std::remove_cv_t<detail::ElementOf<Range>>, uint64_t>
+size_t PopCount(const Range& words) noexcept {
+    return detail::Dispatch<detail::PopCountKernel>(std::ranges::cdata(words), std::ranges::size(words));
+}
+
+}
@@ -0,0 +1,384 @@
+#pragma once
+
+
+#include "vector.h"
+
+
+
+
+
+// Vector which keeps up to N elements in an inline buffer and spills to a RawMemory heap buffer beyond that.
+// Once spilled, the elements stay on the heap. Provides the same exception guarantees as Vector
+template <typename T, size_t N, typename Allocator = std::allocator<T>, typename GrowthPolicy = DoublingGrowth>
+class SmallVector {
+    static_assert(N > 0, "Use Vector for sequences without inline storage");
+
+    using AllocTraits = std::allocator_traits<Allocator>;
+    using Storage = RawMemory<T, Allocator>;
+
+public:
+
+    using iterator = T*;
+    using const_iterator = const T*;
+    using allocator_type = Allocator;
+
+
+    SmallVector() = default;
+
+    explicit SmallVector(const Allocator& alloc) noexcept
+        : heap_(alloc) {
+    }
+
+
+    explicit SmallVector(size_t size, const Allocator& alloc = Allocator())
+        : heap_(alloc)
+    {
+        Reserve(size);
+        std::uninitialized_value_construct_n(Data(), size);
+        size_ = size;
+    }
+
+    SmallVector(const SmallVector& other)
+        : heap_(AllocTraits::select_on_container_copy_construction(other.GetAllocator()))
+    {
+        Reserve(other.size_);
+        std::uninitialized_copy_n(other.Data(), other.size_, Data());
+        size_ = other.size_;
+    }
+
+    // Inline elements are moved one by one, a heap buffer is taken over
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        : heap_(other.GetAllocator())
+    {
+        if (other.IsInline()) {
+            std::uninitialized_move_n(other.Data(), other.size_, Data());
+            size_ = other.size_;
+            other.DestroyElements();
+        }
+        else {
+            heap_.Swap(other.heap_);
+            size_ = std::exchange(other.size_, 0);
+        }
+    }
+
+
+
+    ~SmallVector() {
+        DestroyElements();
+    }
+
+
+
+
+
+    iterator begin() noexcept {
+        return Data();
+    }
+    iterator end() noexcept {
+        return Data() + size_;
+    }
+
+    const_iterator begin() const noexcept {
+        return Data();
+    }
+    const_iterator end() const noexcept {
+        return Data() + size_;
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+
+    T& Back() noexcept {
+        return *std::prev(end());
+    }
+    const T& Back() const noexcept {
+        return *std::prev(cend());
+    }
+    T& Front() noexcept {
+        return *begin();
+    }
+    const T& Front() const noexcept {
+        return *cbegin();
+    }
+
+
+
+
+    SmallVector& operator=(const SmallVector& rhs) {
+        if (this != &rhs) {
+            if (rhs.size_ > Capacity()) {
+                Storage new_data(rhs.size_, GetAllocator());
+                std::uninitialized_copy_n(rhs.Data(), rhs.size_, new_data.GetAddress());
+
+                DestroyElements();
+                heap_.Swap(new_data);
+                size_ = rhs.size_;
+            }
+            else {
+                std::copy_n(rhs.Data(), std::min(size_, rhs.size_), Data());
+
+                if (rhs.size_ < size_) {
+                    std::destroy_n(Data() + rhs.size_, size_ - rhs.size_);
+                }
+                else {
+                    std::uninitialized_copy_n(rhs.Data() + size_, rhs.size_ - size_, Data() + size_);
+                }
+
+                size_ = rhs.size_;
+            }
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& rhs) noexcept(std::is_nothrow_move_constructible_v<T>
+                                                      && std::is_nothrow_move_assignable_v<T>
+                                                      && (AllocTraits::propagate_on_container_move_assignment::value
+                                                          || AllocTraits::is_always_equal::value)) {
+        if (this == &rhs) return *this;
+
+        const bool can_steal = AllocTraits::propagate_on_container_move_assignment::value
+                               || GetAllocator() == rhs.GetAllocator();
+
+        if (!rhs.IsInline() && can_steal) {
+            DestroyElements();
+            heap_ = std::move(rhs.heap_);
+            size_ = std::exchange(rhs.size_, 0);
+
+            return *this;
+        }
+
+        if (rhs.size_ > Capacity()) {
+            DestroyElements();
+            Reserve(rhs.size_);
+        }
+
+        std::move(rhs.Data(), rhs.Data() + std::min(size_, rhs.size_), Data());
+
+        if (rhs.size_ < size_) {
+            std::destroy_n(Data() + rhs.size_, size_ - rhs.size_);
+        }
+        else {
+            std::uninitialized_move_n(rhs.Data() + size_, rhs.size_ - size_, Data() + size_);
+        }
+
+        size_ = rhs.size_;
+        rhs.DestroyElements();
+
+        return *this;
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    size_t Capacity() const noexcept {
+        return IsInline() ? N : heap_.Capacity();
+    }
+
+    // Tells whether the elements live in the inline buffer
+    bool IsInline() const noexcept {
+        return heap_.Capacity() == 0;
+    }
+
+    Allocator GetAllocator() const noexcept {
+        return heap_.GetAllocator();
+    }
+
+    const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return Data()[index];
+    }
+
+    T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
+        return Data()[index];
+    }
+
+
+    void Reserve(size_t new_capacity) {
+        if (new_capacity <= Capacity()) return;
+
+        Storage new_data(new_capacity, GetAllocator());
+        detail::Relocate(Data(), size_, new_data.GetAddress());
+
+        heap_.Swap(new_data);
+    }
+
+    // Buffers are exchanged when both vectors are on the heap, otherwise the elements are moved
+    void Swap(SmallVector& other) noexcept(std::is_nothrow_move_constructible_v<T>
+                                           && std::is_nothrow_move_assignable_v<T>) {
+        VECTOR_CHECK(AllocTraits::propagate_on_container_swap::value || GetAllocator() == other.GetAllocator());
+
+        if (!IsInline() && !other.IsInline()) {
+            heap_.Swap(other.heap_);
+            std::swap(size_, other.size_);
+        }
+        else {
+            SmallVector tmp(std::move(other));
+            other = std::move(*this);
+            *this = std::move(tmp);
+        }
+    }
+
+
+
+    void Resize(size_t new_size) {
+        if (new_size == size_) return;
+
+        if (new_size < size_) {
+            std::destroy_n(Data() + new_size, size_ - new_size);
+        }
+        else {
+            Reserve(new_size);
+            std::uninitialized_value_construct_n(Data() + size_, new_size - size_);
+        }
+
+        size_ = new_size;
+    }
+
+
+
+
+    void PushBack(const T& value) {
+        EmplaceBack(value);
+    }
+
+    void PushBack(T&& value) {
+        EmplaceBack(std::move(value));
+    }
+
+
+
+
+
+    template <typename... Args>
+    iterator Emplace(const_iterator pos, Args&&... args) {
+        VECTOR_CHECK(pos >= begin() && pos <= end());
+
+        const size_t index = pos - begin();
+        iterator it = Data() + index;
+
+        if (size_ == Capacity()) {
+            it = GrowAndEmplace(index, std::forward<Args>(args)...);
+        }
+        else {
+            if (pos != end()) {
+                if constexpr (IsTriviallyRelocatable<T>::value) {
+                    // The element is built aside first, so a throwing constructor leaves the vector untouched
+                    alignas(T) std::byte buffer[sizeof(T)];
+                    T* value = new (buffer) T(std::forward<Args>(args)...);
+
+                    detail::MoveBytes(it, size_ - index, std::next(it));
+                    detail::CopyBytes(value, 1, it);
+                }
+                else {
+                    new (end()) T(std::move(Back()));
+                    std::move_backward(it, std::prev(end()), end());
+
+                    *it = std::move(T(std::forward<Args>(args)...));
+                }
+            }
+            else {
+                new (end()) T(std::forward<Args>(args)...);
+            }
+        }
+
+        ++size_;
+
+        return it;
+    }
+
+
+
+    template <typename... Args>
+    T& EmplaceBack(Args&&... args) {
+        if (size_ == Capacity()) {
+            GrowAndEmplace(size_, std::forward<Args>(args)...);
+        }
+        else {
+            new (end()) T(std::forward<Args>(args)...);
+        }
+
+        ++size_;
+
+        return Back();
+    }
+
+
+
+
+    iterator Insert(const_iterator pos, const T& value) {
+        return Emplace(pos, value);
+    }
+
+    iterator Insert(const_iterator pos, T&& value) {
+        return Emplace(pos, std::move(value));
+    }
+
+
+
+
+    void PopBack() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        std::destroy_at(Data() + (--size_));
+    }
+
+
+    iterator Erase(const_iterator pos) noexcept {
+        VECTOR_CHECK(pos >= begin() && pos < end());
+        iterator it = Data() + (pos - begin());
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            std::destroy_at(it);
+            detail::MoveBytes(std::next(it), end() - std::next(it), it);
+            --size_;
+        }
+        else {
+            std::move(std::next(it), end(), it);
+            PopBack();
+        }
+
+        return it;
+    }
+
+
+private:
+    Storage heap_;
+    alignas(T) std::byte inline_[N * sizeof(T)];
+    size_t size_ = 0;
+
+
+    T* Data() noexcept {
+        return IsInline() ? reinterpret_cast<T*>(inline_) : heap_.GetAddress();
+    }
+
+    const T* Data() const noexcept {
+        return const_cast<SmallVector&>(*this).Data();
+    }
+
+    void DestroyElements() noexcept {
+        std::destroy_n(Data(), size_);
+        size_ = 0;
+    }
+
+    // Moves the elements of a full vector to a bigger heap buffer and constructs an element at index in it.
+    // Returns that element, size_ is left for the caller to update
+    template <typename... Args>
+    T* GrowAndEmplace(size_t index, Args&&... args) {
+        Storage new_data(GrowthPolicy::NextCapacity(Capacity(), size_ + 1, sizeof(T)), GetAllocator());
+
+        T* slot = new_data + index;
+        new (slot) T(std::forward<Args>(args)...);
+
+        detail::RelocateAround(Data(), size_, new_data.GetAddress(), index);
+        heap_.Swap(new_data);
+
+        return slot;
+    }
+};
@@ -0,0 +1,465 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <compare>
+#include <span>
+#include <tuple>
+#include <utility>
+
+
+
+
+
+// Vector of rows whose fields are stored column by column, each in its own RawMemory buffer, so loops touching
+// a few fields of every row read only the columns of those fields. Rows are accessed through tuples of references:
+//
+//     SoAVector<float, float, int> particles;
+//     particles.PushBack(1.0f, 2.0f, 3);
+//     auto [x, y, id] = particles[0];
+//     for (float& x : particles.Column<0>()) ...
+//
+// Provides the same exception guarantees as Vector: a growing operation either succeeds for all the columns
+// or leaves every one of them unchanged. BasicSoAVector takes a growth policy like Vector does, which gets
+// the size of a whole row as the element size
+template <typename GrowthPolicy, typename... Fields>
+class BasicSoAVector {
+    static_assert(sizeof...(Fields) > 0, "A SoAVector needs at least one column");
+
+    using Columns = std::tuple<RawMemory<Fields>...>;
+    using Indices = std::index_sequence_for<Fields...>;
+
+    template <size_t I>
+    using FieldAt = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    template <bool IsConst>
+    class Iterator;
+
+public:
+
+    using value_type = std::tuple<Fields...>;
+    using reference = std::tuple<Fields&...>;
+    using const_reference = std::tuple<const Fields&...>;
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+
+    BasicSoAVector() = default;
+
+    explicit BasicSoAVector(size_t size)
+        : columns_(RawMemory<Fields>(size)...)
+    {
+        ConstructColumns(columns_, Indices(), [size](auto* first, auto) {
+            detail::UninitializedValueConstructN(first, size);
+        }, [size](auto* first) {
+            std::destroy_n(first, size);
+        });
+        size_ = size;
+    }
+
+    BasicSoAVector(const BasicSoAVector& other)
+        : columns_(RawMemory<Fields>(other.size_)...)
+    {
+        const size_t size = other.size_;
+        ConstructColumns(columns_, Indices(), [&other, size]<size_t I>(auto* first, std::integral_constant<size_t, I>) {
+            detail::UninitializedCopyN(std::get<I>(other.columns_).GetAddress(), size, first);
+        }, [size](auto* first) {
+            std::destroy_n(first, size);
+        });
+        size_ = size;
+    }
+
+    BasicSoAVector(BasicSoAVector&& other) noexcept {
+        Swap(other);
+    }
+
+    BasicSoAVector& operator=(const BasicSoAVector& rhs) {
+        if (this != &rhs) {
+            BasicSoAVector copy(rhs);
+            Swap(copy);
+        }
+        return *this;
+    }
+
+    BasicSoAVector& operator=(BasicSoAVector&& rhs) noexcept {
+        if (this != &rhs) {
+            DestroyRows(0, size_);
+            size_ = 0;
+            Swap(rhs);
+        }
+        return *this;
+    }
+
+    ~BasicSoAVector() {
+        DestroyRows(0, size_);
+    }
+
+
+
+
+
+    iterator begin() noexcept {
+        return iterator(this, 0);
+    }
+    iterator end() noexcept {
+        return iterator(this, size_);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(this, size_);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+
+    reference Back() noexcept {
+        return (*this)[size_ - 1];
+    }
+    const_reference Back() const noexcept {
+        return (*this)[size_ - 1];
+    }
+    reference Front() noexcept {
+        return (*this)[0];
+    }
+    const_reference Front() const noexcept {
+        return (*this)[0];
+    }
+
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    size_t Capacity() const noexcept {
+        return std::get<0>(columns_).Capacity();
+    }
+
+    const_reference operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
+        return RowAt(index, Indices());
+    }
+
+    reference operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
+        return RowAt(index, Indices());
+    }
+
+    // The elements of a single field, contiguous in memory
+    template <size_t I>
+    std::span<FieldAt<I>> Column() noexcept {
+        return { std::get<I>(columns_).GetAddress(), size_ };
+    }
+
+    template <size_t I>
+    std::span<const FieldAt<I>> Column() const noexcept {
+        return { std::get<I>(columns_).GetAddress(), size_ };
+    }
+
+
+    // Buffers for all the columns are allocated before any element is relocated
+    void Reserve(size_t new_capacity) {
+        if (new_capacity <= Capacity()) return;
+
+        Columns new_columns{ RawMemory<Fields>(new_capacity)... };
+        RelocateColumns(new_columns);
+
+        columns_.swap(new_columns);
+    }
+
+    void Swap(BasicSoAVector& other) noexcept {
+        columns_.swap(other.columns_);
+        std::swap(size_, other.size_);
+    }
+
+
+
+    void Resize(size_t new_size) {
+        if (new_size == size_) return;
+
+        if (new_size < size_) {
+            DestroyRows(new_size, size_);
+        }
+        else {
+            Reserve(new_size);
+
+            const size_t count = new_size - size_;
+            ConstructColumns(columns_, Indices(), [this, count](auto* column, auto) {
+                detail::UninitializedValueConstructN(column + size_, count);
+            }, [this, count](auto* column) {
+                std::destroy_n(column + size_, count);
+            });
+        }
+
+        size_ = new_size;
+    }
+
+
+
+
+    void PushBack(const Fields&... values) {
+        EmplaceBack(values...);
+    }
+
+    void PushBack(Fields&&... values) {
+        EmplaceBack(std::move(values)...);
+    }
+
+    // Constructs every field of the new row from the argument at the same position
+    template <typename... Args>
+    reference EmplaceBack(Args&&... args) {
+        static_assert(sizeof...(Args) == sizeof...(Fields), "EmplaceBack takes an argument per column");
+
+        if (size_ == Capacity()) {
+            GrowAndEmplace(std::forward<Args>(args)...);
+        }
+        else {
+            ConstructRow(columns_, size_, std::forward<Args>(args)...);
+        }
+
+        ++size_;
+
+        return Back();
+    }
+
+
+
+
+    void PopBack() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        DestroyRows(size_ - 1, size_);
+        --size_;
+    }
+
+
+    iterator Erase(const_iterator pos) noexcept {
+        VECTOR_CHECK(pos >= cbegin() && pos < cend());
+        const size_t index = pos - cbegin();
+
+        ForEachColumn(columns_, Indices(), [this, index]<typename T>(T* column, auto) {
+            if constexpr (IsTriviallyRelocatable<T>::value) {
+                std::destroy_at(column + index);
+                detail::MoveBytes(column + index + 1, size_ - index - 1, column + index);
+            }
+            else {
+                std::move(column + index + 1, column + size_, column + index);
+                std::destroy_at(column + size_ - 1);
+            }
+        });
+        --size_;
+
+        return begin() + index;
+    }
+
+
+private:
+    Columns columns_;
+    size_t size_ = 0;
+
+
+    template <size_t... I>
+    reference RowAt(size_t index, std::index_sequence<I...>) noexcept {
+        return reference(std::get<I>(columns_).GetAddress()[index]...);
+    }
+
+    template <size_t... I>
+    const_reference RowAt(size_t index, std::index_sequence<I...>) const noexcept {
+        return const_reference(std::get<I>(columns_).GetAddress()[index]...);
+    }
+
+    // Calls f(column, std::integral_constant<size_t, I>()) for the first element of every column I in order
+    template <typename Function, size_t... I>
+    static void ForEachColumn(Columns& columns, std::index_sequence<I...>, Function&& f) {
+        (f(std::get<I>(columns).GetAddress(), std::integral_constant<size_t, I>()), ...);
+    }
+
+    // Calls construct for every column in order. If one throws, calls destroy for the columns
+    // already constructed and rethrows
+    template <typename Construct, typename Destroy, size_t... I>
+    static void ConstructColumns(Columns& columns, std::index_sequence<I...>, Construct&& construct, Destroy&& destroy) {
+        size_t constructed = 0;
+        try {
+            ((construct(std::get<I>(columns).GetAddress(), std::integral_constant<size_t, I>()), ++constructed), ...);
+        }
+        catch (...) {
+            ((I < constructed ? destroy(std::get<I>(columns).GetAddress()) : void()), ...);
+            throw;
+        }
+    }
+
+    template <typename... Args>
+    static void ConstructRow(Columns& columns, size_t index, Args&&... args) {
+        auto arguments = std::forward_as_tuple(std::forward<Args>(args)...);
+
+        ConstructColumns(columns, Indices(), [index, &arguments]<typename T, size_t I>(T* column, std::integral_constant<size_t, I>) {
+            new (column + index) T(std::get<I>(std::move(arguments)));
+        }, [index](auto* column) {
+            std::destroy_at(column + index);
+        });
+    }
+
+    void DestroyRows(size_t first, size_t last) noexcept {
+        ForEachColumn(columns_, Indices(), [first, last](auto* column, auto) {
+            std::destroy(column + first, column + last);
+        });
+    }
+
+    template <typename T>
+    static constexpr bool MayThrowOnRelocation() noexcept {
+        return !IsTriviallyRelocatable<T>::value && !std::is_nothrow_move_constructible_v<T>;
+    }
+
+    // Copies the columns whose relocation may throw to new_columns first. If a copy throws, the copies made
+    // so far are destroyed and the vector is unchanged. The other columns are then relocated bytewise
+    // or by nothrow moves, which can't fail
+    void RelocateColumns(Columns& new_columns) {
+        RelocateColumns(new_columns, Indices());
+    }
+
+    template <size_t... I>
+    void RelocateColumns(Columns& new_columns, std::index_sequence<I...>) {
+        size_t copied = 0;
+        try {
+            ((MayThrowOnRelocation<FieldAt<I>>()
+                ? (detail::UninitializedMoveOrCopyN(std::get<I>(columns_).GetAddress(), size_, std::get<I>(new_columns).GetAddress()), ++copied)
+                : copied), ...);
+        }
+        catch (...) {
+            size_t destroyed = 0;
+            ((MayThrowOnRelocation<FieldAt<I>>() && destroyed++ < copied
+                ? std::destroy_n(std::get<I>(new_columns).GetAddress(), size_)
+                : nullptr), ...);
+            throw;
+        }
+
+        ((MayThrowOnRelocation<FieldAt<I>>()
+            ? (std::destroy_n(std::get<I>(columns_).GetAddress(), size_), void())
+            : detail::Relocate(std::get<I>(columns_).GetAddress(), size_, std::get<I>(new_columns).GetAddress())), ...);
+    }
+
+    // Builds the new row in the new buffers before relocating the old rows, as args may refer to elements of the vector
+    template <typename... Args>
+    void GrowAndEmplace(Args&&... args) {
+        const size_t new_capacity = GrowthPolicy::NextCapacity(Capacity(), size_ + 1, (sizeof(Fields) + ...));
+        Columns new_columns{ RawMemory<Fields>(new_capacity)... };
+
+        ConstructRow(new_columns, size_, std::forward<Args>(args)...);
+        try {
+            RelocateColumns(new_columns);
+        }
+        catch (...) {
+            ForEachColumn(new_columns, Indices(), [this](auto* column, auto) {
+                std::destroy_at(column + size_);
+            });
+            throw;
+        }
+
+        columns_.swap(new_columns);
+    }
+};
+
+template <typename... Fields>
+using SoAVector = BasicSoAVector<DoublingGrowth, Fields...>;
+
+
+
+// Random access iterator over the rows. Dereferencing gives a tuple of references to the fields of the row,
+// so algorithms relying on the iterator yielding a real reference don't work with it
+template <typename GrowthPolicy, typename... Fields>
+template <bool IsConst>
+class BasicSoAVector<GrowthPolicy, Fields...>::Iterator {
+    using Owner = std::conditional_t<IsConst, const BasicSoAVector, BasicSoAVector>;
+
+    friend class BasicSoAVector;
+    friend class Iterator<!IsConst>;
+
+public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+    using value_type = BasicSoAVector::value_type;
+    using difference_type = ptrdiff_t;
+    using reference = std::conditional_t<IsConst, BasicSoAVector::const_reference, BasicSoAVector::reference>;
+
+    Iterator() = default;
+
+    // Makes a const_iterator of an iterator
+    template <bool OtherConst>
+        requires (IsConst && !OtherConst)
+    Iterator(const Iterator<OtherConst>& other) noexcept
+        : owner_(other.owner_)
+        , index_(other.index_) {
+    }
+
+    reference operator*() const noexcept {
+        return (*owner_)[index_];
+    }
+
+    reference operator[](difference_type offset) const noexcept {
+        return (*owner_)[index_ + offset];
+    }
+
+    Iterator& operator++() noexcept {
+        ++index_;
+        return *this;
+    }
+    Iterator operator++(int) noexcept {
+        Iterator old = *this;
+        ++index_;
+        return old;
+    }
+    Iterator& operator--() noexcept {
+        --index_;
+        return *this;
+    }
+    Iterator operator--(int) noexcept {
+        Iterator old = *this;
+        --index_;
+        return old;
+    }
+
+    Iterator& operator+=(difference_type offset) noexcept {
+        index_ += offset;
+        return *this;
+    }
+    Iterator& operator-=(difference_type offset) noexcept {
+        index_ -= offset;
+        return *this;
+    }
+
+    friend Iterator operator+(Iterator it, difference_type offset) noexcept {
+        return it += offset;
+    }
+    friend Iterator operator+(difference_type offset, Iterator it) noexcept {
+        return it += offset;
+    }
+    friend Iterator operator-(Iterator it, difference_type offset) noexcept {
+        return it -= offset;
+    }
+    friend difference_type operator-(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return static_cast<difference_type>(lhs.index_) - static_cast<difference_type>(rhs.index_);
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ == rhs.index_;
+    }
+    friend auto operator<=>(const Iterator& lhs, const Iterator& rhs) noexcept {
+        return lhs.index_ <=> rhs.index_;
+    }
+
+private:
+    Iterator(Owner* owner, size_t index) noexcept
+        : owner_(owner)
+        , index_(index) {
+    }
+
+    Owner* owner_ = nullptr;
+    size_t index_ = 0;
+};
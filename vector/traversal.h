@@ -0,0 +1,235 @@
+#pragma once
+
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <span>
+#include <type_traits>
+
+#include "vector_hardening.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VECTOR_TRAVERSAL_X86 1
+#endif
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+
+
+
+
+// Traversals of contiguous ranges (Vector, SmallVector, MappedVector, std::span) which keep memory from
+// stalling the loop: gathers which prefetch the elements they will need, tiled passes which stay in a cache
+// level, and fills and copies with non-temporal stores for outputs larger than the last level cache.
+// They work on the pointers of the range, so in VECTOR_HARDENING_MODE 2 they skip the checked iterators
+// just like the loops the compiler vectorizes
+
+// Sizes of the data caches in bytes, from the C library where it tells or typical values otherwise
+enum class CacheLevel {
+    L1,
+    L2,
+    L3,
+};
+
+inline size_t CacheSize(CacheLevel level) noexcept {
+    static const size_t sizes[3] = {
+#if defined(__linux__) && defined(_SC_LEVEL1_DCACHE_SIZE)
+        sysconf(_SC_LEVEL1_DCACHE_SIZE) > 0 ? static_cast<size_t>(sysconf(_SC_LEVEL1_DCACHE_SIZE)) : size_t{ 32 } << 10,
+        sysconf(_SC_LEVEL2_CACHE_SIZE) > 0 ? static_cast<size_t>(sysconf(_SC_LEVEL2_CACHE_SIZE)) : size_t{ 1 } << 20,
+        sysconf(_SC_LEVEL3_CACHE_SIZE) > 0 ? static_cast<size_t>(sysconf(_SC_LEVEL3_CACHE_SIZE)) : size_t{ 32 } << 20,
+#else
+        size_t{ 32 } << 10,
+        size_t{ 1 } << 20,
+        size_t{ 32 } << 20,
+#endif
+    };
+    return sizes[static_cast<int>(level)];
+}
+
+// How many elements ahead ForEachPrefetched requests by default: enough to cover a memory access
+// at the pace of a light loop body, few enough for the lines to stay in L1 until used
+inline constexpr size_t kDefaultPrefetchDistance = 16;
+
+namespace detail {
+    template <typename T>
+    inline void PrefetchRead(const T* address) noexcept {
+#if defined(__GNUC__)
+        __builtin_prefetch(address, 0, 3);
+#else
+        (void)address;
+#endif
+    }
+}
+
+
+// Calls f(range[index]) for every index of indices in order, prefetching the element distance indices ahead.
+// Pays off when the elements are scattered over more memory than the caches hold; for sorted indices
+// the hardware prefetcher already does the job
+template <std::ranges::contiguous_range Range, std::ranges::contiguous_range Indices, typename Function>
+void ForEachPrefetched(Range&& range, const Indices& indices, Function f, size_t distance = kDefaultPrefetchDistance) {
+    auto* data = std::ranges::data(range);
+    const auto* index = std::ranges::data(indices);
+    const size_t count = std::ranges::size(indices);
+    const size_t prefetched = count > distance ? count - distance : 0;
+
+    for (size_t i = 0; i < std::min(distance, count); ++i) {
+        detail::PrefetchRead(data + index[i]);
+    }
+    // Split so the loop body has no bounds check for the prefetch
+    size_t i = 0;
+    for (; i < prefetched; ++i) {
+        VECTOR_CHECK(static_cast<size_t>(index[i]) < std::ranges::size(range));
+        detail::PrefetchRead(data + index[i + distance]);
+        f(data[index[i]]);
+    }
+    for (; i < count; ++i) {
+        VECTOR_CHECK(static_cast<size_t>(index[i]) < std::ranges::size(range));
+        f(data[index[i]]);
+    }
+}
+
+// Calls f(std::span) for consecutive blocks of the range of about block_bytes each, so a function
+// making several passes over a block finds it in cache after the first one. The default block takes
+// half of L1 and leaves the other half to what the function reads besides. Blocks after the first
+// one start on a cache line where the element size allows
+template <std::ranges::contiguous_range Range, typename Function>
+void ForEachBlock(Range&& range, Function f, size_t block_bytes = CacheSize(CacheLevel::L1) / 2) {
+    auto* data = std::ranges::data(range);
+    using Element = std::remove_reference_t<decltype(*data)>;
+    constexpr size_t kCacheLineSize = 64;
+
+    const size_t size = std::ranges::size(range);
+    const size_t block = std::max<size_t>(block_bytes / sizeof(Element), 1);
+
+    size_t first = 0;
+    if constexpr (kCacheLineSize % sizeof(Element) == 0) {
+        // The first block is shortened so the others start on a cache line
+        const size_t shift = (reinterpret_cast<uintptr_t>(data) + block * sizeof(Element)) % kCacheLineSize / sizeof(Element);
+        if (shift != 0 && shift < block && block < size) {
+            f(std::span<Element>(data, block - shift));
+            first = block - shift;
+        }
+    }
+
+    for (; first < size; first += block) {
+        f(std::span<Element>(data + first, std::min(block, size - first)));
+    }
+}
+
+
+namespace detail {
+    // Writes bytes to a 16-byte aligned destination with stores which bypass the caches. The stores are
+    // weakly ordered, so the caller fences once done
+    inline void StreamBytes(void* destination, const void* source, size_t bytes) noexcept {
+#if defined(VECTOR_TRAVERSAL_X86)
+        auto* out = static_cast<__m128i*>(destination);
+        const auto* in = static_cast<const __m128i*>(source);
+        for (size_t i = 0; i < bytes / 16; ++i) {
+            _mm_stream_si128(out + i, _mm_loadu_si128(in + i));
+        }
+#else
+        std::memcpy(destination, source, bytes);
+#endif
+    }
+
+    inline void StreamPattern(void* destination, const void* pattern, size_t bytes) noexcept {
+#if defined(VECTOR_TRAVERSAL_X86)
+        auto* out = static_cast<__m128i*>(destination);
+        const __m128i value = _mm_loadu_si128(static_cast<const __m128i*>(pattern));
+        for (size_t i = 0; i < bytes / 16; ++i) {
+            _mm_stream_si128(out + i, value);
+        }
+#else
+        for (size_t i = 0; i < bytes / 16; ++i) {
+            std::memcpy(static_cast<char*>(destination) + 16 * i, pattern, 16);
+        }
+#endif
+    }
+
+    inline void StreamFence() noexcept {
+#if defined(VECTOR_TRAVERSAL_X86)
+        _mm_sfence();
+#endif
+    }
+
+    // The number of bytes before the first 16-byte boundary at or after address
+    inline size_t HeadBytes(const void* address) noexcept {
+        return (16 - reinterpret_cast<uintptr_t>(address) % 16) % 16;
+    }
+}
+
+// Non-temporal counterparts of std::fill and std::copy for trivially copyable elements. The written lines
+// go to memory without being read into the caches first and without evicting what the caches hold, which
+// saves the read of every written line and keeps the working set of the rest of the program. That only
+// pays off for outputs larger than the last level cache which aren't read back soon; smaller outputs
+// are faster with ordinary stores, as the next reader finds them in cache.
+// Elsewhere than x86 these are plain fills and copies. A write-once output vector is best sized with
+// ResizeUninitialized, so its elements aren't written twice:
+//
+//     out.ResizeUninitialized(in.Size());
+//     StreamCopy(in, out);
+
+// Elements whose size divides 16 are written 16 bytes at a time; others, and elements not aligned to
+// their size, fall back to std::fill
+template <std::ranges::contiguous_range Range, typename T>
+void StreamFill(Range&& range, const T& value) noexcept {
+    auto* data = std::ranges::data(range);
+    using Element = std::remove_reference_t<decltype(*data)>;
+    static_assert(std::is_trivially_copyable_v<Element>, "StreamFill writes the bytes of the elements");
+
+    const size_t size = std::ranges::size(range);
+    const Element element(value);
+
+    if constexpr (16 % sizeof(Element) == 0) {
+        if (reinterpret_cast<uintptr_t>(data) % sizeof(Element) == 0) {
+            const size_t head = std::min(size, detail::HeadBytes(data) / sizeof(Element));
+            std::fill(data, data + head, element);
+
+            alignas(16) unsigned char pattern[16];
+            for (size_t i = 0; i < 16 / sizeof(Element); ++i) {
+                std::memcpy(pattern + i * sizeof(Element), &element, sizeof(Element));
+            }
+
+            const size_t body = (size - head) / (16 / sizeof(Element)) * (16 / sizeof(Element));
+            detail::StreamPattern(data + head, pattern, body * sizeof(Element));
+            detail::StreamFence();
+
+            std::fill(data + head + body, data + size, element);
+            return;
+        }
+    }
+    std::fill(data, data + size, element);
+}
+
+// Copies in to the elements of out with the same indices. out must be at least as long as in and not overlap it
+template <std::ranges::contiguous_range InRange, std::ranges::contiguous_range OutRange>
+void StreamCopy(const InRange& in, OutRange&& out) noexcept {
+    const auto* source = std::ranges::data(in);
+    auto* destination = std::ranges::data(out);
+    using Element = std::remove_reference_t<decltype(*destination)>;
+    static_assert(std::is_same_v<std::remove_const_t<std::remove_reference_t<decltype(*source)>>, Element>,
+                  "StreamCopy copies between ranges of one element type");
+    static_assert(std::is_trivially_copyable_v<Element>, "StreamCopy copies the bytes of the elements");
+    VECTOR_CHECK(std::ranges::size(out) >= std::ranges::size(in));
+
+    const size_t bytes = std::ranges::size(in) * sizeof(Element);
+    if (bytes == 0) return;
+
+    auto* out_bytes = reinterpret_cast<unsigned char*>(destination);
+    const auto* in_bytes = reinterpret_cast<const unsigned char*>(source);
+
+    const size_t head = std::min(bytes, detail::HeadBytes(out_bytes));
+    std::memcpy(out_bytes, in_bytes, head);
+
+    const size_t body = (bytes - head) / 16 * 16;
+    detail::StreamBytes(out_bytes + head, in_bytes + head, body);
+    detail::StreamFence();
+
+    std::memcpy(out_bytes + head + body, in_bytes + head + body, bytes - head - body);
+}
@@ -2,94 +2,200 @@
 
 
 #include <cassert>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <new>
 #include <utility>
 #include <memory>
+#include <memory_resource>
 #include <algorithm>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
 
+#include "vector_hardening.h"
+#include "vector_stats.h"
 
 
 
 
+
+// Tells whether an object can be moved to another address by copying its bytes, after which the source
+// is treated as raw memory and not destroyed. Specialize it for types which are safe to relocate this way
+template <typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {
+};
+
+template <typename T, typename Deleter>
+struct IsTriviallyRelocatable<std::unique_ptr<T, Deleter>> : IsTriviallyRelocatable<Deleter> {
+};
+
+// Tells whether a value-initialized object consists of zero bytes, so that memset can create it.
+// Holds for arithmetic, enumeration and pointer types; specialize it for trivial aggregates of such types
 template <typename T>
+struct IsZeroInitializable : std::bool_constant<std::is_scalar_v<T> && !std::is_member_pointer_v<T>> {
+};
+
+
+
+
+
+// Detects allocators which report the real size of the block they hand out, like C++23 allocate_at_least:
+// an aggregate of {T* ptr; size_t count;} with count >= n
+template <typename Allocator, typename = void>
+struct HasAllocateAtLeast : std::false_type {
+};
+
+template <typename Allocator>
+struct HasAllocateAtLeast<Allocator, std::void_t<decltype(std::declval<Allocator&>().allocate_at_least(size_t{}))>>
+    : std::true_type {
+};
+
+// Detects allocators which can resize a block keeping its contents, in place when possible:
+// T* reallocate(T* p, size_t old_n, size_t new_n), throwing and leaving p valid on failure
+template <typename Allocator, typename = void>
+struct HasReallocate : std::false_type {
+};
+
+template <typename Allocator>
+struct HasReallocate<Allocator, std::void_t<decltype(std::declval<Allocator&>().reallocate(
+        std::declval<typename Allocator::value_type*>(), size_t{}, size_t{}))>> : std::true_type {
+};
+
+
+
+
+
+template <typename T, typename Allocator = std::allocator<T>>
 class RawMemory {
+    using AllocTraits = std::allocator_traits<Allocator>;
+
 public:
+    using allocator_type = Allocator;
+
     RawMemory() = default;
 
-    explicit RawMemory(size_t capacity)
-        : buffer_(Allocate(capacity))
+    constexpr explicit RawMemory(const Allocator& alloc) noexcept
+        : alloc_(alloc) {
+    }
+
+    // The capacity may turn out larger than requested if the allocator reports the real block size
+    constexpr explicit RawMemory(size_t capacity, const Allocator& alloc = Allocator())
+        : alloc_(alloc)
+        , buffer_(Allocate(capacity))
         , capacity_(capacity) {
     }
 
-    ~RawMemory() {
-        Deallocate(buffer_);
+    constexpr ~RawMemory() {
+        Deallocate(buffer_, capacity_);
     }
 
     RawMemory(const RawMemory&) = delete;
     RawMemory& operator=(const RawMemory& rhs) = delete;
 
-    RawMemory(RawMemory&& other) noexcept
-        : buffer_(std::exchange(other.buffer_, nullptr))
-        , capacity_(other.capacity_) 
+    constexpr RawMemory(RawMemory&& other) noexcept
+        : alloc_(std::move(other.alloc_))
+        , buffer_(std::exchange(other.buffer_, nullptr))
+        , capacity_(other.capacity_)
     {
         other.capacity_ = 0;
     }
 
-    RawMemory& operator=(RawMemory&& rhs) noexcept {
-        Swap(rhs);
+    // The allocator is taken over only if it propagates on move assignment,
+    // otherwise the caller must ensure both allocators compare equal
+    constexpr RawMemory& operator=(RawMemory&& rhs) noexcept {
+        if (this != &rhs) {
+            Deallocate(buffer_, capacity_);
+
+            if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+                alloc_ = std::move(rhs.alloc_);
+            }
+            buffer_ = std::exchange(rhs.buffer_, nullptr);
+            capacity_ = std::exchange(rhs.capacity_, 0);
+        }
 
         return *this;
     }
 
 
-    T* operator+(size_t offset) noexcept {
+    constexpr T* operator+(size_t offset) noexcept {
         //     ,     
-        assert(offset <= capacity_);
+        VECTOR_CHECK(offset <= capacity_);
         return buffer_ + offset;
     }
 
-    const T* operator+(size_t offset) const noexcept {
+    constexpr const T* operator+(size_t offset) const noexcept {
         return const_cast<RawMemory&>(*this) + offset;
     }
 
-    const T& operator[](size_t index) const noexcept {
+    constexpr const T& operator[](size_t index) const noexcept {
         return const_cast<RawMemory&>(*this)[index];
     }
 
-    T& operator[](size_t index) noexcept {
-        assert(index < capacity_);
+    constexpr T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < capacity_);
         return buffer_[index];
     }
 
-    void Swap(RawMemory& other) noexcept {
+    constexpr void Swap(RawMemory& other) noexcept {
+        if constexpr (AllocTraits::propagate_on_container_swap::value) {
+            using std::swap;
+            swap(alloc_, other.alloc_);
+        }
         std::swap(buffer_, other.buffer_);
         std::swap(capacity_, other.capacity_);
     }
 
-    const T* GetAddress() const noexcept {
+    constexpr const T* GetAddress() const noexcept {
         return buffer_;
     }
 
-    T* GetAddress() noexcept {
+    constexpr T* GetAddress() noexcept {
         return buffer_;
     }
 
-    size_t Capacity() const {
+    constexpr size_t Capacity() const {
         return capacity_;
     }
 
+    constexpr Allocator GetAllocator() const noexcept {
+        return alloc_;
+    }
+
+    // Resizes the buffer keeping its bytes, which is valid only for trivially relocatable T.
+    // Requires an allocator with reallocate(), see HasReallocate. On failure the buffer is left intact
+    constexpr void Reallocate(size_t new_capacity) {
+        buffer_ = alloc_.reallocate(buffer_, capacity_, new_capacity);
+        capacity_ = new_capacity;
+    }
+
 private:
     //     n      
-    static T* Allocate(size_t n) {
-        return n != 0 ? static_cast<T*>(operator new(n * sizeof(T))) : nullptr;
+    constexpr T* Allocate(size_t& n) {
+        if (n == 0) return nullptr;
+
+        if constexpr (HasAllocateAtLeast<Allocator>::value) {
+            auto [buf, count] = alloc_.allocate_at_least(n);
+            n = count;
+            return buf;
+        }
+        else {
+            return AllocTraits::allocate(alloc_, n);
+        }
     }
 
     //   ,     buf   Allocate
-    static void Deallocate(T* buf) noexcept {
-        operator delete(buf);
+    constexpr void Deallocate(T* buf, size_t n) noexcept {
+        if (buf != nullptr) {
+            AllocTraits::deallocate(alloc_, buf, n);
+        }
     }
 
+    [[no_unique_address]] Allocator alloc_{};
     T* buffer_ = nullptr;
     size_t capacity_ = 0;
 };
@@ -98,92 +204,528 @@ private:
 
 
 
-template <typename T>
+// Growth policies tell the capacity a full vector is reallocated to. NextCapacity gets the current capacity,
+// the capacity required right now and the element size, and returns at least the required capacity
+
+// Doubles the capacity, starting from a single element
+struct DoublingGrowth {
+    static constexpr size_t NextCapacity(size_t capacity, size_t required, size_t /*element_size*/) noexcept {
+        return std::max(required, capacity == 0 ? 1 : capacity * 2);
+    }
+};
+
+// Multiplies the capacity by Numerator / Denominator. Factors below 2 leave less memory unused
+// and let a freed block be reused by later reallocations
+template <size_t Numerator, size_t Denominator>
+struct FactorGrowth {
+    static_assert(Numerator > Denominator, "The growth factor must be greater than 1");
+
+    static constexpr size_t NextCapacity(size_t capacity, size_t required, size_t /*element_size*/) noexcept {
+        const size_t grown = capacity / Denominator * Numerator + capacity % Denominator * Numerator / Denominator;
+        return std::max({ required, grown, capacity + 1 });
+    }
+};
+
+using OneAndHalfGrowth = FactorGrowth<3, 2>;
+using GoldenRatioGrowth = FactorGrowth<1618, 1000>;
+
+// Makes the first allocation span at least MinBytes, by default a cache line, and grows as Base afterwards
+template <typename Base = DoublingGrowth, size_t MinBytes = 64>
+struct MinBytesGrowth {
+    static constexpr size_t NextCapacity(size_t capacity, size_t required, size_t element_size) noexcept {
+        const size_t min_capacity = (MinBytes + element_size - 1) / element_size;
+        return std::max(min_capacity, Base::NextCapacity(capacity, required, element_size));
+    }
+};
+
+// A growth policy may also give memory back with static size_t ShrinkCapacity(size_t capacity, size_t size,
+// size_t element_size), which returns the capacity a vector that has just lost elements is shrunk to,
+// or capacity to keep the buffer
+template <typename GrowthPolicy, typename = void>
+struct HasShrinkCapacity : std::false_type {
+};
+
+template <typename GrowthPolicy>
+struct HasShrinkCapacity<GrowthPolicy, std::void_t<decltype(GrowthPolicy::ShrinkCapacity(size_t{}, size_t{}, size_t{}))>>
+    : std::true_type {
+};
+
+// Grows as Base and shrinks a vector whose size has fallen below a Divisor-th of its capacity to twice its size.
+// The gap between the two thresholds keeps a vector whose size goes up and down from reallocating on every change.
+// Buffers of MinBytes or less are kept
+template <typename Base = DoublingGrowth, size_t Divisor = 4, size_t MinBytes = 4096>
+struct ShrinkingGrowth {
+    static_assert(Divisor > 2, "A vector shrunk to twice its size must be below the threshold to grow");
+
+    static constexpr size_t NextCapacity(size_t capacity, size_t required, size_t element_size) noexcept {
+        return Base::NextCapacity(capacity, required, element_size);
+    }
+
+    static constexpr size_t ShrinkCapacity(size_t capacity, size_t size, size_t element_size) noexcept {
+        const size_t min_capacity = MinBytes / element_size;
+        if (capacity <= min_capacity || size >= capacity / Divisor) {
+            return capacity;
+        }
+        return std::max(size * 2, min_capacity);
+    }
+};
+
+
+
+
+
+namespace detail {
+
+    // In constant evaluation memcpy and the std::uninitialized_* algorithms are unavailable, so the helpers below
+    // construct the elements one by one with std::construct_at instead. No exception escapes a constant evaluation,
+    // which lets those loops skip the rollback
+
+    template <typename T>
+    constexpr void UninitializedMoveOrCopyN(T* first, size_t num, T* destination) {
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < num; ++i) {
+                std::construct_at(destination + i, std::move_if_noexcept(first[i]));
+            }
+        }
+        else if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>)
+            std::uninitialized_move_n(first, num, destination);
+        else
+            std::uninitialized_copy_n(first, num, destination);
+    }
+
+    // What copying the bytes of an element amounts to in constant evaluation: a copy for trivially copyable T,
+    // otherwise a relocation, which is the only use of bytewise copies of other types
+    template <typename T>
+    constexpr void CopyElementBytes(const T* source, T* destination) noexcept {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::construct_at(destination, *source);
+        }
+        else if constexpr (std::is_move_constructible_v<T>) {
+            T* from = const_cast<T*>(source);
+            std::construct_at(destination, std::move(*from));
+            std::destroy_at(from);
+        }
+    }
+
+    template <typename T>
+    constexpr void CopyBytes(const T* first, size_t num, T* destination) noexcept {
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < num; ++i) {
+                CopyElementBytes(first + i, destination + i);
+            }
+        }
+        else if (num != 0) {
+            std::memcpy(static_cast<void*>(destination), static_cast<const void*>(first), num * sizeof(T));
+        }
+    }
+
+    // Same as CopyBytes but the ranges may overlap
+    template <typename T>
+    constexpr void MoveBytes(const T* first, size_t num, T* destination) noexcept {
+        if (std::is_constant_evaluated()) {
+            if (destination < first) {
+                for (size_t i = 0; i < num; ++i) {
+                    CopyElementBytes(first + i, destination + i);
+                }
+            }
+            else {
+                for (size_t i = num; i-- != 0;) {
+                    CopyElementBytes(first + i, destination + i);
+                }
+            }
+        }
+        else if (num != 0) {
+            std::memmove(static_cast<void*>(destination), static_cast<const void*>(first), num * sizeof(T));
+        }
+    }
+
+    template <typename T>
+    constexpr void UninitializedValueConstructN(T* first, size_t num) {
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < num; ++i) {
+                std::construct_at(first + i);
+            }
+        }
+        else if constexpr (IsZeroInitializable<T>::value) {
+            if (num != 0) {
+                std::memset(static_cast<void*>(first), 0, num * sizeof(T));
+            }
+        }
+        else {
+            std::uninitialized_value_construct_n(first, num);
+        }
+    }
+
+    // Leaves trivial values indeterminate, except in constant evaluation, where they are value-initialized
+    template <typename T>
+    constexpr void UninitializedDefaultConstructN(T* first, size_t num) {
+        if (std::is_constant_evaluated()) {
+            UninitializedValueConstructN(first, num);
+        }
+        else {
+            std::uninitialized_default_construct_n(first, num);
+        }
+    }
+
+    template <typename InputIt, typename T>
+    constexpr void UninitializedCopyN(InputIt first, size_t num, T* destination) {
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < num; ++i, ++first) {
+                std::construct_at(destination + i, *first);
+            }
+        }
+        else if constexpr (std::is_pointer_v<InputIt> && std::is_same_v<std::remove_cv_t<std::iter_value_t<InputIt>>, T>
+                           && std::is_trivially_copyable_v<T>) {
+            CopyBytes(first, num, destination);
+        }
+        else {
+            std::uninitialized_copy_n(first, num, destination);
+        }
+    }
+
+    template <typename T>
+    constexpr void UninitializedFillN(T* first, size_t num, const T& value) {
+        if (std::is_constant_evaluated()) {
+            for (size_t i = 0; i < num; ++i) {
+                std::construct_at(first + i, value);
+            }
+        }
+        else {
+            std::uninitialized_fill_n(first, num, value);
+        }
+    }
+
+    // Moves num elements to uninitialized memory and ends the lifetime of the originals
+    template <typename T>
+    constexpr void Relocate(T* first, size_t num, T* destination) {
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            CopyBytes(first, num, destination);
+        }
+        else {
+            UninitializedMoveOrCopyN(first, num, destination);
+            std::destroy_n(first, num);
+        }
+    }
+
+    // Relocates size elements to destination leaving a gap of gap_size at index, which already holds constructed
+    // elements. If an element fails to be copied, the gap elements are destroyed and the source range is unchanged
+    template <typename T>
+    constexpr void RelocateAround(T* first, size_t size, T* destination, size_t index, size_t gap_size = 1) {
+        T* slot = destination + index;
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            CopyBytes(first, index, destination);
+            CopyBytes(first + index, size - index, slot + gap_size);
+        }
+        else {
+            try {
+                UninitializedMoveOrCopyN(first, index, destination);
+                try {
+                    UninitializedMoveOrCopyN(first + index, size - index, slot + gap_size);
+                }
+                catch (...) {
+                    std::destroy_n(destination, index);
+                    throw;
+                }
+            }
+            catch (...) {
+                std::destroy_n(slot, gap_size);
+                throw;
+            }
+
+            std::destroy_n(first, size);
+        }
+    }
+
+}
+
+
+
+
+
+#if VECTOR_HARDENING_MODE >= 2
+
+namespace detail {
+
+    // Iterator of hardening mode 2. Remembers the vector and its buffer generation, and traps when used after
+    // the vector has moved to another buffer or when dereferenced out of range. Iterators of a vector which has
+    // been moved from or swapped are invalidated too, although the standard containers keep them valid
+    template <typename Owner, typename T>
+    class CheckedIterator {
+        template <typename, typename>
+        friend class CheckedIterator;
+
+    public:
+        using iterator_concept = std::contiguous_iterator_tag;
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_const_t<T>;
+        using element_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        CheckedIterator() = default;
+
+        constexpr CheckedIterator(const Owner* owner, T* element) noexcept
+            : owner_(owner)
+            , element_(element)
+            , generation_(owner->generation_.Get()) {
+        }
+
+        // Makes a const_iterator of an iterator
+        template <typename U>
+            requires std::is_same_v<const U, T> && (!std::is_const_v<U>)
+        constexpr CheckedIterator(const CheckedIterator<Owner, U>& other) noexcept
+            : owner_(other.owner_)
+            , element_(other.element_)
+            , generation_(other.generation_) {
+        }
+
+        constexpr T& operator*() const noexcept {
+            CheckValid();
+            VECTOR_CHECK(element_ >= owner_->data_.GetAddress() && element_ < owner_->data_.GetAddress() + owner_->size_);
+            return *element_;
+        }
+
+        // Checks the buffer only, as std::to_address gets the address of end() through it
+        constexpr T* operator->() const noexcept {
+            CheckValid();
+            return element_;
+        }
+
+        constexpr T& operator[](difference_type offset) const noexcept {
+            return *(*this + offset);
+        }
+
+        constexpr CheckedIterator& operator++() noexcept {
+            ++element_;
+            return *this;
+        }
+        constexpr CheckedIterator operator++(int) noexcept {
+            CheckedIterator old = *this;
+            ++element_;
+            return old;
+        }
+        constexpr CheckedIterator& operator--() noexcept {
+            --element_;
+            return *this;
+        }
+        constexpr CheckedIterator operator--(int) noexcept {
+            CheckedIterator old = *this;
+            --element_;
+            return old;
+        }
+
+        constexpr CheckedIterator& operator+=(difference_type offset) noexcept {
+            element_ += offset;
+            return *this;
+        }
+        constexpr CheckedIterator& operator-=(difference_type offset) noexcept {
+            element_ -= offset;
+            return *this;
+        }
+
+        friend constexpr CheckedIterator operator+(CheckedIterator it, difference_type offset) noexcept {
+            return it += offset;
+        }
+        friend constexpr CheckedIterator operator+(difference_type offset, CheckedIterator it) noexcept {
+            return it += offset;
+        }
+        friend constexpr CheckedIterator operator-(CheckedIterator it, difference_type offset) noexcept {
+            return it -= offset;
+        }
+
+        // Iterators are compared only when both point into the current buffer of the same vector
+        friend constexpr difference_type operator-(const CheckedIterator& lhs, const CheckedIterator& rhs) noexcept {
+            lhs.CheckComparable(rhs);
+            return lhs.element_ - rhs.element_;
+        }
+        friend constexpr bool operator==(const CheckedIterator& lhs, const CheckedIterator& rhs) noexcept {
+            lhs.CheckComparable(rhs);
+            return lhs.element_ == rhs.element_;
+        }
+        friend constexpr std::strong_ordering operator<=>(const CheckedIterator& lhs, const CheckedIterator& rhs) noexcept {
+            lhs.CheckComparable(rhs);
+            return lhs.element_ <=> rhs.element_;
+        }
+
+    private:
+        constexpr void CheckValid() const noexcept {
+            VECTOR_CHECK(owner_ != nullptr && generation_ == owner_->generation_.Get());
+        }
+
+        constexpr void CheckComparable(const CheckedIterator& other) const noexcept {
+            VECTOR_CHECK(owner_ == other.owner_);
+            if (owner_ != nullptr) {
+                CheckValid();
+                other.CheckValid();
+            }
+        }
+
+        const Owner* owner_ = nullptr;
+        T* element_ = nullptr;
+        uint64_t generation_ = 0;
+    };
+
+}
+
+#endif
+
+
+
+enum class ClearMode {
+    KeepCapacity,
+    ReleaseCapacity,
+};
+
+template <typename T, typename Allocator = std::allocator<T>, typename GrowthPolicy = DoublingGrowth>
 class Vector {
+    using AllocTraits = std::allocator_traits<Allocator>;
+    using Storage = RawMemory<T, Allocator>;
+
+    // The buffer may be resized by the allocator itself, ideally in place, when elements survive a bytewise move
+    static constexpr bool kCanReallocate = IsTriviallyRelocatable<T>::value && HasReallocate<Allocator>::value;
+
 public:
 
+#if VECTOR_HARDENING_MODE >= 2
+    using iterator = detail::CheckedIterator<Vector, T>;
+    using const_iterator = detail::CheckedIterator<Vector, const T>;
+#else
     using iterator = T*;
     using const_iterator = const T*;
+#endif
+    using allocator_type = Allocator;
 
 
     Vector() = default;
 
+    constexpr explicit Vector(const Allocator& alloc) noexcept
+        : data_(alloc) {
+    }
+
 
-    explicit Vector(size_t size)
-        : data_(size)
-        , size_(size) 
+    constexpr explicit Vector(size_t size, const Allocator& alloc = Allocator())
+        : data_(size, alloc)
+        , size_(size)
     {
-        std::uninitialized_value_construct_n(begin(), size);
+        detail::UninitializedValueConstructN(Data(), size);
+        RecordAllocation();
+    }
+
+    constexpr Vector(const Vector& other)
+        : Vector(other, AllocTraits::select_on_container_copy_construction(other.GetAllocator())) {
     }
 
-    Vector(const Vector& other)
-        : data_(other.size_)
+    constexpr Vector(const Vector& other, const Allocator& alloc)
+        : data_(other.size_, alloc)
         , size_(other.size_)
+        , stats_(other.stats_)
     {
-        std::uninitialized_copy_n(other.begin(), other.Size(), begin());
+        detail::UninitializedCopyN(other.Data(), other.Size(), Data());
+        RecordAllocation();
     }
 
-    Vector(Vector&& other) noexcept
+    constexpr Vector(Vector&& other) noexcept
         : data_(std::move(other.data_))
-        , size_(other.size_) 
-    { 
+        , size_(other.size_)
+        , stats_(other.stats_)
+    {
         other.size_ = 0;
+        other.generation_.Advance();
+    }
+
+    constexpr Vector(Vector&& other, const Allocator& alloc)
+        : data_(alloc)
+        , stats_(other.stats_)
+    {
+        if (alloc == other.GetAllocator()) {
+            data_.Swap(other.data_);
+            size_ = std::exchange(other.size_, 0);
+            other.generation_.Advance();
+        }
+        else {
+            Storage new_data(other.size_, alloc);
+            std::uninitialized_move_n(other.Data(), other.size_, new_data.GetAddress());
+
+            data_.Swap(new_data);
+            size_ = other.size_;
+            RecordAllocation();
+        }
     }
 
 
 
-    ~Vector() {
-        std::destroy_n(begin(), size_);
+    constexpr ~Vector() {
+        std::destroy_n(Data(), size_);
     }
 
 
 
 
 
-    iterator begin() noexcept {
-        return data_.GetAddress();
+    constexpr iterator begin() noexcept {
+        return MakeIterator(data_.GetAddress());
     }
-    iterator end() noexcept {
-        return data_ + size_;
+    constexpr iterator end() noexcept {
+        return MakeIterator(data_ + size_);
     }
 
-    const_iterator begin() const noexcept {
-        return data_.GetAddress();
+    constexpr const_iterator begin() const noexcept {
+        return MakeIterator(data_.GetAddress());
     }
-    const_iterator end() const noexcept {
-        return data_ + size_;
+    constexpr const_iterator end() const noexcept {
+        return MakeIterator(data_ + size_);
     }
 
-    const_iterator cbegin() const noexcept {
+    constexpr const_iterator cbegin() const noexcept {
         return begin();
     }
-    const_iterator cend() const noexcept {
+    constexpr const_iterator cend() const noexcept {
         return end();
     }
 
 
-    T& Back() noexcept {
-        return *std::prev(end());
+    constexpr T& Back() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return data_[size_ - 1];
+    }
+    constexpr const T& Back() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return data_[size_ - 1];
+    }
+    constexpr T& Front() noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return data_[0];
     }
-    const T& Back() const noexcept {
-        return *std::prev(cend());
+    constexpr const T& Front() const noexcept {
+        VECTOR_CHECK(size_ != 0);
+        return data_[0];
     }
-    T& Front() noexcept {
-        return *begin();
+
+    // The address of the first element, for code taking raw pointers whatever the iterator type
+    constexpr T* Data() noexcept {
+        return data_.GetAddress();
     }
-    const T& Front() const noexcept {
-        return *cbegin();
+    constexpr const T* Data() const noexcept {
+        return data_.GetAddress();
     }
 
 
 
 
-    Vector& operator=(const Vector& rhs) {
+    // The destination keeps its own allocator: propagate_on_container_copy_assignment is not honoured.
+    // A vector too small for rhs is left unchanged if the bigger buffer can't be allocated
+    constexpr Vector& operator=(const Vector& rhs) {
         if (this != &rhs) {
             if (rhs.size_ > data_.Capacity()) {
-                Vector<T> new_vector(rhs);
+                Vector new_vector(rhs, GetAllocator());
                 Swap(new_vector);
             }
+            else if constexpr (std::is_trivially_copyable_v<T>) {
+                detail::CopyBytes(rhs.data_.GetAddress(), rhs.size_, data_.GetAddress());
+                size_ = rhs.size_;
+            }
             else {
                 std::copy_n(rhs.data_.GetAddress(), std::min(Size(), rhs.Size()), data_.GetAddress());
 
@@ -191,7 +733,7 @@ public:
                     std::destroy_n((data_.GetAddress() + rhs.Size()), (Size() - rhs.Size()));
                 }
                 else {
-                    std::uninitialized_copy_n((rhs.data_.GetAddress() + Size()), (rhs.Size() - Size()), (data_.GetAddress() + Size()));
+                    detail::UninitializedCopyN((rhs.data_.GetAddress() + Size()), (rhs.Size() - Size()), (data_.GetAddress() + Size()));
                 }
 
                 size_ = rhs.size_;
@@ -200,102 +742,159 @@ public:
         return *this;
     }
 
-    Vector& operator=(Vector&& rhs) noexcept {
+    constexpr Vector& operator=(Vector&& rhs) noexcept(AllocTraits::propagate_on_container_move_assignment::value
+                                            || AllocTraits::is_always_equal::value) {
+        if (this == &rhs) return *this;
+
+        if constexpr (!AllocTraits::propagate_on_container_move_assignment::value
+                      && !AllocTraits::is_always_equal::value) {
+            if (GetAllocator() != rhs.GetAllocator()) {
+                // Memory of rhs can't be released by our allocator, so the elements are moved one by one
+                Vector new_vector(std::move(rhs), GetAllocator());
+                Swap(new_vector);
+
+                return *this;
+            }
+        }
+
+        std::destroy_n(Data(), size_);
         data_ = std::move(rhs.data_);
         size_ = rhs.size_;
         rhs.size_ = 0;
+        generation_.Advance();
+        rhs.generation_.Advance();
 
         return *this;
     }
 
 
-    size_t Size() const noexcept {
+    constexpr size_t Size() const noexcept {
         return size_;
     }
 
-    size_t Capacity() const noexcept {
+    constexpr size_t Capacity() const noexcept {
         return data_.Capacity();
     }
 
-    const T& operator[](size_t index) const noexcept {
-        assert(index < size_);
+    constexpr Allocator GetAllocator() const noexcept {
+        return data_.GetAllocator();
+    }
+
+    // Counts the allocations of this vector under tag in VectorStatsRegistry, e.g. CallSiteTag().
+    // Does nothing unless VECTOR_ENABLE_STATS is defined
+    void SetStatsTag(std::string_view tag) {
+        stats_.SetTag(tag);
+    }
+
+    constexpr const T& operator[](size_t index) const noexcept {
+        VECTOR_CHECK(index < size_);
         return data_[index];
     }
 
-    T& operator[](size_t index) noexcept {
-        assert(index < size_);
+    constexpr T& operator[](size_t index) noexcept {
+        VECTOR_CHECK(index < size_);
         return data_[index];
     }
 
+    // Checks the index in every build and hardening mode
+    constexpr const T& At(size_t index) const {
+        if (index >= size_) {
+            throw std::out_of_range("Vector index out of range");
+        }
+        return data_[index];
+    }
 
-    void Reserve(size_t new_capacity) {
+    constexpr T& At(size_t index) {
+        return const_cast<T&>(std::as_const(*this).At(index));
+    }
+
+
+    constexpr void Reserve(size_t new_capacity) {
         if (new_capacity <= Capacity()) return;
-        
-        RawMemory<T> new_data(new_capacity);
 
-        if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>) 
-            std::uninitialized_move_n(data_.GetAddress(), size_, new_data.GetAddress());
-        else 
-            std::uninitialized_copy_n(data_.GetAddress(), size_, new_data.GetAddress());
+        ReallocateTo(new_capacity);
+    }
+
+    // Moves the elements to a buffer of their size, or frees the buffer of an empty vector.
+    // Leaves the vector unchanged if that throws
+    constexpr void ShrinkToFit() {
+        if (size_ == Capacity()) return;
 
-        std::destroy_n(data_.GetAddress(), size_);
-        data_.Swap(new_data);
+        ReallocateTo(size_);
     }
 
-    void Swap(Vector& other) noexcept {
+    // Destroys the elements. With ClearMode::ReleaseCapacity also frees the buffer
+    constexpr void Clear(ClearMode mode = ClearMode::KeepCapacity) noexcept {
+        std::destroy_n(Data(), size_);
+        size_ = 0;
+
+        if (mode == ClearMode::ReleaseCapacity && Capacity() != 0) {
+            data_ = Storage(GetAllocator());
+            generation_.Advance();
+        }
+    }
+
+    // Allocators of both vectors must compare equal unless they propagate on swap
+    constexpr void Swap(Vector& other) noexcept {
+        VECTOR_CHECK(AllocTraits::propagate_on_container_swap::value || GetAllocator() == other.GetAllocator());
+
         data_.Swap(other.data_);
         std::swap(size_, other.size_);
+        generation_.Advance();
+        other.generation_.Advance();
     }
 
 
 
-    void Resize(size_t new_size) {
+    constexpr void Resize(size_t new_size) {
         if (new_size == size_) return;
 
         if (new_size < size_) {
             std::destroy_n(data_.GetAddress() + new_size, size_ - new_size);
+            size_ = new_size;
+            MaybeShrink();
         }
         else {
             Reserve(new_size);
-            std::uninitialized_value_construct_n(data_.GetAddress() + size_, new_size - size_);
+            detail::UninitializedValueConstructN(data_.GetAddress() + size_, new_size - size_);
+            size_ = new_size;
         }
-
-        size_ = new_size;
     }
 
+    // Same as Resize, but new elements are default-initialized: values of trivial types are left indeterminate,
+    // so the buffer can be filled by read() or recv() without being zeroed first
+    constexpr void ResizeUninitialized(size_t new_size) {
+        if (new_size <= size_) {
+            Resize(new_size);
+            return;
+        }
 
+        Reserve(new_size);
+        detail::UninitializedDefaultConstructN(data_.GetAddress() + size_, new_size - size_);
 
+        size_ = new_size;
+    }
 
-    void PushBack(const T& value) {
-        if (Size() == Capacity()) {
-            RawMemory<T> new_data(size_ == 0 ? 1 : size_ * 2);
 
-            new (new_data + size_) T(value);
-            UninitializedMoveOrCopyN(begin(), size_, new_data.GetAddress());
 
 
-            std::destroy_n(begin(), size_);
-            data_.Swap(new_data);
+    constexpr void PushBack(const T& value) {
+        if (Size() == Capacity()) {
+            GrowAndEmplace(size_, value);
         }
         else {
-            new (data_ + size_) T(value);
+            std::construct_at(data_ + size_, value);
         }
 
         ++size_;
     }
 
-    void PushBack(T&& value) {
+    constexpr void PushBack(T&& value) {
         if (Size() == Capacity()) {
-            RawMemory<T> new_data(size_ == 0 ? 1 : size_ * 2);
-
-            new (new_data + size_) T(std::move(value));
-            UninitializedMoveOrCopyN(begin(), size_, new_data.GetAddress());
-
-            std::destroy_n(begin(), size_);
-            data_.Swap(new_data);
+            GrowAndEmplace(size_, std::move(value));
         }
         else {
-            new (data_ + size_) T(std::move(value));
+            std::construct_at(data_ + size_, std::move(value));
         }
 
         ++size_;
@@ -306,57 +905,59 @@ public:
 
 
     template <typename... Args>
-    iterator Emplace(const_iterator pos, Args&&... args) {
-        assert(pos >= begin() && pos <= end());
+    constexpr iterator Emplace(const_iterator pos, Args&&... args) {
+        VECTOR_CHECK(pos >= cbegin() && pos <= cend());
 
-        iterator non_const_pos = data_ + (pos - begin());
-        iterator it = non_const_pos;
+        const size_t index = pos - cbegin();
+        T* it = data_ + index;
 
         if (Size() == Capacity()) {
-            RawMemory<T> new_data(size_ == 0 ? 1 : size_ * 2);
-
-            it = new_data + (pos - begin());
-            new (it) T(std::forward<Args>(args)...);
-
-
-            UninitializedMoveOrCopy(begin(), non_const_pos, new_data.GetAddress());
-            UninitializedMoveOrCopy(non_const_pos, end(), std::next(it));
-
-            std::destroy_n(begin(), size_);
-            data_.Swap(new_data);
+            it = GrowAndEmplace(index, std::forward<Args>(args)...);
         }
         else {
-            if (pos != end()) {
-                new (data_ + size_) T(std::move(Back()));
-                std::move_backward(non_const_pos, std::prev(end()), end());
+            if (index != size_) {
+                if constexpr (IsTriviallyRelocatable<T>::value) {
+                    // The element is built aside first, so a throwing constructor leaves the vector untouched
+                    if (std::is_constant_evaluated()) {
+                        T value(std::forward<Args>(args)...);
+                        detail::MoveBytes(it, size_ - index, std::next(it));
+                        std::construct_at(it, std::move(value));
+                    }
+                    else {
+                        alignas(T) std::byte buffer[sizeof(T)];
+                        T* value = new (buffer) T(std::forward<Args>(args)...);
+
+                        detail::MoveBytes(it, size_ - index, std::next(it));
+                        detail::CopyBytes(value, 1, it);
+                    }
+                }
+                else {
+                    T* last = data_ + size_;
+                    std::construct_at(last, std::move(Back()));
+                    std::move_backward(it, std::prev(last), last);
 
-                *it = std::move(T(std::forward<Args>(args)...));
+                    *it = std::move(T(std::forward<Args>(args)...));
+                }
             }
             else {
-                new (data_ + size_) T(std::forward<Args>(args)...);
+                std::construct_at(data_ + size_, std::forward<Args>(args)...);
             }
         }
 
         ++size_;
 
-        return it;
+        return MakeIterator(it);
     }
 
 
 
     template <typename... Args>
-    T& EmplaceBack(Args&&... args) {
+    constexpr T& EmplaceBack(Args&&... args) {
         if (Size() == Capacity()) {
-            RawMemory<T> new_data(size_ == 0 ? 1 : size_ * 2);
-
-            new (new_data + size_) T(std::forward<Args>(args)...);
-            UninitializedMoveOrCopyN(begin(), size_, new_data.GetAddress());
-
-            std::destroy_n(data_.GetAddress(), size_);
-            data_.Swap(new_data);
+            GrowAndEmplace(size_, std::forward<Args>(args)...);
         }
         else {
-            new (data_ + size_) T(std::forward<Args>(args)...);
+            std::construct_at(data_ + size_, std::forward<Args>(args)...);
         }
 
         ++size_;
@@ -367,52 +968,393 @@ public:
 
 
 
-    iterator Insert(const_iterator pos, const T& value) {
+    constexpr iterator Insert(const_iterator pos, const T& value) {
         return Emplace(pos, value);
     }
 
-    iterator Insert(const_iterator pos, T&& value) {
+    constexpr iterator Insert(const_iterator pos, T&& value) {
         return Emplace(pos, std::move(value));
     }
 
+    // Inserts count copies of value with a single reallocation and shift of the tail
+    constexpr iterator Insert(const_iterator pos, size_t count, const T& value) {
+        VECTOR_CHECK(pos >= cbegin() && pos <= cend());
+
+        // value may be an element which the shift would overwrite
+        const T copy(value);
+        return InsertN(pos - cbegin(), count, false, [&](T* destination) {
+            detail::UninitializedFillN(destination, count, copy);
+        });
+    }
+
+    // Inserts [first, last), which must not point into the vector unless pos is end(),
+    // with a single reallocation and shift of the tail when the length of the range is known
+    template <std::input_iterator InputIt>
+    constexpr iterator Insert(const_iterator pos, InputIt first, InputIt last) {
+        VECTOR_CHECK(pos >= cbegin() && pos <= cend());
+        const size_t index = pos - cbegin();
+
+        if constexpr (std::forward_iterator<InputIt>) {
+            const size_t count = std::distance(first, last);
+
+            bool source_in_buffer = false;
+            // Only matters for a reallocation in place, which constant evaluation never does
+            if constexpr (kCanReallocate && std::contiguous_iterator<InputIt>) {
+                const auto* source = std::to_address(first);
+                source_in_buffer = count != 0 && !std::less<>()(source, Data()) && std::less<>()(source, Data() + size_);
+            }
+
+            return InsertN(index, count, source_in_buffer, [&](T* destination) {
+                detail::UninitializedCopyN(first, count, destination);
+            });
+        }
+        else {
+            // The length is unknown, so the elements are appended and then rotated into place
+            const size_t old_size = size_;
+            try {
+                for (; first != last; ++first) {
+                    EmplaceBack(*first);
+                }
+            }
+            catch (...) {
+                Resize(old_size);
+                throw;
+            }
 
+            std::rotate(Data() + index, Data() + old_size, Data() + size_);
+            return begin() + index;
+        }
+    }
 
+    constexpr void Append(std::span<const T> values) {
+        Insert(cend(), values.begin(), values.end());
+    }
 
-    void PopBack() noexcept {
-        assert(size_ != 0);
+    constexpr void AppendN(size_t count, const T& value) {
+        Insert(cend(), count, value);
+    }
+
+
+
+
+    constexpr void PopBack() noexcept {
+        VECTOR_CHECK(size_ != 0);
         std::destroy_at(data_.GetAddress() + (--size_));
+        MaybeShrink();
+    }
+
+
+    constexpr iterator Erase(const_iterator pos) noexcept {
+        VECTOR_CHECK(pos >= cbegin() && pos < cend());
+        const size_t index = pos - cbegin();
+        T* it = data_ + index;
+        T* last = data_ + size_;
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            std::destroy_at(it);
+            detail::MoveBytes(std::next(it), last - std::next(it), it);
+        }
+        else {
+            std::move(std::next(it), last, it);
+            std::destroy_at(std::prev(last));
+        }
+        --size_;
+
+        MaybeShrink();
+        return begin() + index;
+    }
+
+    // Erases [first, last) with a single shift of the tail
+    constexpr iterator Erase(const_iterator first, const_iterator last) noexcept {
+        VECTOR_CHECK(first >= cbegin() && first <= last && last <= cend());
+        const size_t index = first - cbegin();
+        // Moving the tail onto itself would empty moved-from elements like std::string
+        if (first == last) return begin() + index;
+
+        T* it_first = data_ + index;
+        T* it_last = data_ + (last - cbegin());
+        T* it_end = data_ + size_;
+        const size_t count = last - first;
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            std::destroy(it_first, it_last);
+            detail::MoveBytes(it_last, it_end - it_last, it_first);
+        }
+        else {
+            std::move(it_last, it_end, it_first);
+            std::destroy_n(it_end - count, count);
+        }
+
+        size_ -= count;
+
+        MaybeShrink();
+        return begin() + index;
     }
 
+    // Erases in O(1) by moving the last element into pos, so the order of the elements is not preserved
+    constexpr iterator EraseUnordered(const_iterator pos) noexcept {
+        VECTOR_CHECK(pos >= cbegin() && pos < cend());
+        const size_t index = pos - cbegin();
+        T* it = data_ + index;
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            std::destroy_at(it);
+            --size_;
+            if (T* last = data_ + size_; it != last) {
+                detail::CopyBytes(last, 1, it);
+            }
+        }
+        else {
+            T* last = data_ + size_ - 1;
+            if (it != last) {
+                *it = std::move(*last);
+            }
+            std::destroy_at(last);
+            --size_;
+        }
+
+        MaybeShrink();
+        return begin() + index;
+    }
 
-    iterator Erase(const_iterator pos) noexcept {
-        assert(pos >= begin() && pos < end());
-        iterator it = data_ + (pos - begin());
+    // Erases the elements satisfying pred in a single compacting pass keeping the order of the rest.
+    // Returns the number of erased elements
+    template <typename Predicate>
+    constexpr size_t EraseIf(Predicate pred) {
+        T* last = data_ + size_;
+        T* new_end = std::remove_if(Data(), last, pred);
+        const size_t count = last - new_end;
 
-        std::move(std::next(it), end(), it);
-        PopBack();
+        std::destroy(new_end, last);
+        size_ -= count;
+        MaybeShrink();
 
-        return it;
+        return count;
     }
 
 
 private:
-    RawMemory<T> data_;
+    Storage data_;
     size_t size_ = 0;
+    [[no_unique_address]] VectorStatsHandle stats_;
+    [[no_unique_address]] detail::BufferGeneration generation_;
 
+#if VECTOR_HARDENING_MODE >= 2
+    friend iterator;
+    friend const_iterator;
 
-    template <typename Iterator>
-    static void UninitializedMoveOrCopy(Iterator begin, Iterator end, Iterator destination) {
-        if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>)
-            std::uninitialized_move(begin, end, destination);
-        else
-            std::uninitialized_copy(begin, end, destination);
+    constexpr iterator MakeIterator(T* element) noexcept {
+        return iterator(this, element);
+    }
+    constexpr const_iterator MakeIterator(const T* element) const noexcept {
+        return const_iterator(this, element);
+    }
+#else
+    static constexpr iterator MakeIterator(T* element) noexcept {
+        return element;
     }
+    static constexpr const_iterator MakeIterator(const T* element) noexcept {
+        return element;
+    }
+#endif
 
-    template <typename Iterator>
-    static void UninitializedMoveOrCopyN(Iterator begin, size_t num, Iterator destination) {
-        if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>)
-            std::uninitialized_move_n(begin, num, destination);
-        else
-            std::uninitialized_copy_n(begin, num, destination);
+
+    // Vectors built in constant evaluation aren't counted
+    constexpr void RecordAllocation() const noexcept {
+        if (!std::is_constant_evaluated() && Capacity() != 0) {
+            stats_.OnAllocate(Capacity() * sizeof(T));
+        }
     }
-};
\ No newline at end of file
+
+    // Counts the buffer the vector has just moved to along with the relocated elements
+    constexpr void RecordReallocation(size_t relocated) const noexcept {
+        if (!std::is_constant_evaluated()) {
+            RecordAllocation();
+            stats_.OnRelocate(relocated, relocated * sizeof(T));
+        }
+    }
+
+    // Moves the elements to a buffer of new_capacity, which holds them all, or frees the buffer of an empty vector
+    constexpr void ReallocateTo(size_t new_capacity) {
+        if (new_capacity == 0) {
+            data_ = Storage(GetAllocator());
+        }
+        else if constexpr (kCanReallocate) {
+            data_.Reallocate(new_capacity);
+        }
+        else {
+            Storage new_data(new_capacity, GetAllocator());
+            detail::Relocate(data_.GetAddress(), size_, new_data.GetAddress());
+
+            data_.Swap(new_data);
+        }
+
+        generation_.Advance();
+        if (new_capacity != 0) {
+            RecordReallocation(size_);
+        }
+    }
+
+    // Shrinks the buffer after the vector has lost elements if GrowthPolicy asks for it, see HasShrinkCapacity.
+    // Does nothing for elements whose relocation may throw, and keeps the buffer if the allocation fails
+    constexpr void MaybeShrink() noexcept {
+        if constexpr (HasShrinkCapacity<GrowthPolicy>::value
+                      && (IsTriviallyRelocatable<T>::value || std::is_nothrow_move_constructible_v<T>)) {
+            const size_t new_capacity = GrowthPolicy::ShrinkCapacity(Capacity(), size_, sizeof(T));
+            if (new_capacity < Capacity()) {
+                try {
+                    ReallocateTo(new_capacity);
+                }
+                catch (...) {
+                }
+            }
+        }
+    }
+
+
+    // Makes room for count elements at index and calls construct(destination) to create them in uninitialized
+    // memory; construct must destroy whatever it created if it throws. source_in_buffer tells that construct
+    // reads the elements of the vector, which keeps the old buffer alive until the new elements are done
+    template <typename Construct>
+    constexpr iterator InsertN(size_t index, size_t count, bool source_in_buffer, Construct construct) {
+        if (count == 0) return MakeIterator(data_ + index);
+
+        // Checked before size_ + count, which would wrap past a too long count
+        if (count > static_cast<size_t>(std::numeric_limits<ptrdiff_t>::max()) / sizeof(T) - size_) {
+            throw std::length_error("Vector is too long");
+        }
+        if (size_ + count > Capacity()) {
+            const size_t new_capacity = GrowthPolicy::NextCapacity(Capacity(), size_ + count, sizeof(T));
+
+            bool reallocated = false;
+            if constexpr (kCanReallocate) {
+                if (!source_in_buffer) {
+                    data_.Reallocate(new_capacity);
+                    generation_.Advance();
+                    RecordReallocation(size_);
+                    reallocated = true;
+                }
+            }
+
+            if (!reallocated) {
+                Storage new_data(new_capacity, GetAllocator());
+
+                T* slot = new_data + index;
+                construct(slot);
+
+                detail::RelocateAround(data_.GetAddress(), size_, new_data.GetAddress(), index, count);
+                data_.Swap(new_data);
+                generation_.Advance();
+                RecordReallocation(size_);
+                size_ += count;
+
+                return MakeIterator(slot);
+            }
+        }
+
+        T* slot = data_ + index;
+
+        if constexpr (IsTriviallyRelocatable<T>::value) {
+            detail::MoveBytes(slot, size_ - index, slot + count);
+            try {
+                construct(slot);
+            }
+            catch (...) {
+                detail::MoveBytes(slot + count, size_ - index, slot);
+                throw;
+            }
+        }
+        else {
+            // The new elements are created past the end, so a throwing construction leaves the vector untouched,
+            // and then rotated into place; a throwing move of T leaves the vector valid but reordered, with
+            // the elements then past the end destroyed
+            T* last = data_ + size_;
+            construct(last);
+            try {
+                std::rotate(slot, last, last + count);
+            }
+            catch (...) {
+                std::destroy_n(last, count);
+                throw;
+            }
+        }
+
+        size_ += count;
+
+        return MakeIterator(slot);
+    }
+
+    // Reallocates a full vector and constructs an element at index in the new buffer. Returns that element,
+    // size_ is left for the caller to update
+    template <typename... Args>
+    constexpr T* GrowAndEmplace(size_t index, Args&&... args) {
+        // No buffer holds more than PTRDIFF_MAX bytes. The check also bounds the byte counts of the copies
+        // below for the compiler, which otherwise warns of memcpy sizes wrapped past size_ + 1
+        if (size_ >= static_cast<size_t>(std::numeric_limits<ptrdiff_t>::max()) / sizeof(T)) {
+            throw std::length_error("Vector is too long");
+        }
+        const size_t new_capacity = GrowthPolicy::NextCapacity(Capacity(), size_ + 1, sizeof(T));
+
+        if constexpr (kCanReallocate) {
+            // args may refer to an element, so the value is constructed before the buffer moves
+            alignas(T) std::byte buffer[sizeof(T)];
+            T* value = new (buffer) T(std::forward<Args>(args)...);
+
+            try {
+                data_.Reallocate(new_capacity);
+            }
+            catch (...) {
+                std::destroy_at(value);
+                throw;
+            }
+
+            generation_.Advance();
+            RecordReallocation(size_);
+
+            T* slot = data_ + index;
+            detail::MoveBytes(slot, size_ - index, std::next(slot));
+            detail::CopyBytes(value, 1, slot);
+
+            return slot;
+        }
+        else {
+            Storage new_data(new_capacity, GetAllocator());
+
+            T* slot = new_data + index;
+            std::construct_at(slot, std::forward<Args>(args)...);
+
+            detail::RelocateAround(data_.GetAddress(), size_, new_data.GetAddress(), index);
+            data_.Swap(new_data);
+            generation_.Advance();
+            RecordReallocation(size_);
+
+            return slot;
+        }
+    }
+};
+
+
+
+
+namespace pmr {
+    // Vector whose memory comes from a std::pmr::memory_resource, e.g. monotonic_buffer_resource
+    // for bump allocation released all at once or unsynchronized_pool_resource for size-class pools
+    template <typename T, typename GrowthPolicy = DoublingGrowth>
+    using Vector = ::Vector<T, std::pmr::polymorphic_allocator<T>, GrowthPolicy>;
+}
+
+
+
+// Copies the elements of the Vector returned by make, a captureless lambda, into a std::array sized to fit them.
+// The Vector is built and freed during constant evaluation, and the array can outlive it:
+//     constexpr auto kSquares = ToStaticArray([] { Vector<int> v; for (...) v.PushBack(i * i); return v; });
+template <typename Make>
+consteval auto ToStaticArray(Make make) {
+    constexpr size_t kSize = Make{}().Size();
+
+    const auto v = make();
+    std::array<std::remove_cvref_t<decltype(v[0])>, kSize> result{};
+    std::copy(v.begin(), v.end(), result.begin());
+
+    return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+
+#include <cassert>
+#include <cstdint>
+
+
+
+
+
+// VECTOR_HARDENING_MODE selects the checks compiled into the containers:
+//   0 - asserts only, which NDEBUG removes. The default
+//   1 - index and iterator range checks kept in release builds. A failed check traps, and a passing one
+//       costs a compare and a branch predicted not taken
+//   2 - the checks of mode 1, and Vector iterators which trap when used after the vector has changed its buffer
+#ifndef VECTOR_HARDENING_MODE
+#define VECTOR_HARDENING_MODE 0
+#endif
+
+#if VECTOR_HARDENING_MODE > 0
+
+#define VECTOR_CHECK(condition)          \
+    do {                                 \
+        if (!(condition)) [[unlikely]] { \
+            __builtin_trap();            \
+        }                                \
+    } while (false)
+
+#else
+
+#define VECTOR_CHECK(condition) assert(condition)
+
+#endif
+
+
+
+
+namespace detail {
+
+// Counts the buffers a container has moved to, so its iterators can tell whether they still point into it.
+// Compiled to an empty object with no-op hooks below hardening mode 2
+#if VECTOR_HARDENING_MODE >= 2
+
+    class BufferGeneration {
+    public:
+        constexpr uint64_t Get() const noexcept {
+            return value_;
+        }
+
+        constexpr void Advance() noexcept {
+            ++value_;
+        }
+
+    private:
+        uint64_t value_ = 0;
+    };
+
+#else
+
+    class BufferGeneration {
+    public:
+        constexpr void Advance() noexcept {
+        }
+    };
+
+#endif
+
+}
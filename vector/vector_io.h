@@ -0,0 +1,350 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+
+
+
+// Binary format of a vector stream: a StreamHeader, then either header.count elements or, for chunked streams,
+// chunks of a uint64_t element count followed by the elements, ended by an empty chunk.
+// Integers and elements are written in the byte order of the writer, which the byte_order field tells.
+// Elements of arithmetic and enumeration types are converted when read on a machine of the other byte order
+struct StreamHeader {
+    uint8_t magic[4];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t element_size;
+    uint64_t count;
+};
+
+namespace detail {
+    inline constexpr uint8_t kStreamMagic[4] = { 'V', 'E', 'C', 'S' };
+    inline constexpr uint32_t kStreamByteOrder = 0x0102'0304;
+    inline constexpr uint32_t kStreamForeignByteOrder = 0x0403'0201;
+    inline constexpr uint16_t kStreamVersion = 1;
+    inline constexpr uint16_t kStreamChunked = 1;
+
+    template <typename Integer>
+    Integer ByteSwap(Integer value) noexcept {
+        auto* bytes = reinterpret_cast<unsigned char*>(&value);
+        std::reverse(bytes, bytes + sizeof(Integer));
+        return value;
+    }
+
+    template <typename T>
+    void ByteSwapElements(T* first, size_t num) noexcept {
+        for (auto* bytes = reinterpret_cast<unsigned char*>(first); num != 0; --num, bytes += sizeof(T)) {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+    }
+
+    template <typename T>
+    StreamHeader MakeStreamHeader(uint16_t flags, uint64_t count) noexcept {
+        StreamHeader header{};
+        std::copy_n(kStreamMagic, 4, header.magic);
+        header.byte_order = kStreamByteOrder;
+        header.version = kStreamVersion;
+        header.flags = flags;
+        header.element_size = sizeof(T);
+        header.count = count;
+        return header;
+    }
+
+    // Writes all the bytes of both buffers with as few writev() calls as the kernel allows
+    inline void WriteAll(int fd, const void* head, size_t head_size, const void* body, size_t body_size) {
+        iovec iov[2] = { { const_cast<void*>(head), head_size }, { const_cast<void*>(body), body_size } };
+        iovec* first = iov;
+        int iov_count = body_size != 0 ? 2 : 1;
+
+        while (iov_count != 0) {
+            const ssize_t written = writev(fd, first, iov_count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "Can't write a vector");
+            }
+
+            size_t left = static_cast<size_t>(written);
+            for (; iov_count != 0 && left >= first->iov_len; ++first, --iov_count) {
+                left -= first->iov_len;
+            }
+            if (iov_count != 0) {
+                first->iov_base = static_cast<char*>(first->iov_base) + left;
+                first->iov_len -= left;
+            }
+        }
+    }
+
+    inline void WriteAll(std::ostream& out, const void* head, size_t head_size, const void* body, size_t body_size) {
+        out.write(static_cast<const char*>(head), static_cast<std::streamsize>(head_size));
+        out.write(static_cast<const char*>(body), static_cast<std::streamsize>(body_size));
+        if (!out) {
+            throw std::runtime_error("Can't write a vector");
+        }
+    }
+
+    inline void ReadAll(int fd, void* buf, size_t size) {
+        auto* dest = static_cast<char*>(buf);
+        while (size != 0) {
+            const ssize_t got = read(fd, dest, size);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                throw std::system_error(errno, std::generic_category(), "Can't read a vector");
+            }
+            if (got == 0) {
+                throw std::runtime_error("Unexpected end of a vector stream");
+            }
+            dest += got;
+            size -= static_cast<size_t>(got);
+        }
+    }
+
+    inline void ReadAll(std::istream& in, void* buf, size_t size) {
+        in.read(static_cast<char*>(buf), static_cast<std::streamsize>(size));
+        if (!in) {
+            throw std::runtime_error("Unexpected end of a vector stream");
+        }
+    }
+
+    // The number of bytes left in a regular file or a seekable stream, kUnknownBytes for pipes, sockets and the like
+    inline constexpr uint64_t kUnknownBytes = std::numeric_limits<uint64_t>::max();
+
+    inline uint64_t RemainingBytes(int fd) noexcept {
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            return kUnknownBytes;
+        }
+        const off_t position = lseek(fd, 0, SEEK_CUR);
+        if (position < 0 || position > info.st_size) {
+            return kUnknownBytes;
+        }
+        return static_cast<uint64_t>(info.st_size - position);
+    }
+
+    inline uint64_t RemainingBytes(std::istream& in) {
+        const std::streampos position = in.tellg();
+        if (position == std::streampos(-1)) {
+            return kUnknownBytes;
+        }
+        in.seekg(0, std::ios::end);
+        const std::streampos end = in.tellg();
+        in.clear();
+        in.seekg(position);
+        if (!in || end == std::streampos(-1) || end < position) {
+            in.clear();
+            return kUnknownBytes;
+        }
+        return static_cast<uint64_t>(end - position);
+    }
+
+    // Accounts for bytes about to be read, throwing when the source is known to hold fewer
+    inline void ConsumeBytes(uint64_t& remaining, uint64_t bytes) {
+        if (remaining == kUnknownBytes) return;
+        if (bytes > remaining) {
+            throw std::runtime_error("Unexpected end of a vector stream");
+        }
+        remaining -= bytes;
+    }
+
+    template <typename Source>
+    uint64_t ReadCount(Source& source, bool foreign, uint64_t& remaining) {
+        uint64_t count = 0;
+        ConsumeBytes(remaining, sizeof(count));
+        ReadAll(source, &count, sizeof(count));
+        return foreign ? ByteSwap(count) : count;
+    }
+
+    // Elements are read in pieces of at most this many bytes when the source doesn't tell how much it holds
+    inline constexpr size_t kReadPieceBytes = size_t{ 1 } << 20;
+
+    // Appends count elements to v, reading them straight into its buffer. The count comes from the stream,
+    // so it is checked against what v can hold and what the source has left before anything is allocated.
+    // The buffer grows by the growth policy piece after piece, so a header claiming more than an unsized
+    // source holds fails at its end instead of allocating the claimed size up front
+    template <typename Source, typename T, typename Allocator, typename GrowthPolicy>
+    void ReadElements(Source& source, Vector<T, Allocator, GrowthPolicy>& v, uint64_t count, bool foreign, uint64_t& remaining) {
+        const size_t old_size = v.Size();
+        if (count > (std::numeric_limits<size_t>::max() / sizeof(T) - old_size)) {
+            throw std::runtime_error("The vector stream holds too many elements");
+        }
+        ConsumeBytes(remaining, count * sizeof(T));
+
+        constexpr size_t kPiece = std::max<size_t>(kReadPieceBytes / sizeof(T), 1);
+        for (size_t left = static_cast<size_t>(count); left != 0;) {
+            const size_t piece = std::min(left, kPiece);
+            const size_t size = v.Size();
+            if (size + piece > v.Capacity()) {
+                v.Reserve(GrowthPolicy::NextCapacity(v.Capacity(), size + piece, sizeof(T)));
+            }
+            v.ResizeUninitialized(size + piece);
+            ReadAll(source, v.Data() + size, piece * sizeof(T));
+            left -= piece;
+        }
+
+        if (foreign) {
+            ByteSwapElements(v.Data() + old_size, count);
+        }
+    }
+
+    template <typename Sink, typename T>
+    void WriteVector(Sink& sink, std::span<const T> elements) {
+        static_assert(std::is_trivially_copyable_v<T>, "Only the bytes of trivially copyable elements can be written");
+
+        const StreamHeader header = MakeStreamHeader<T>(0, elements.size());
+        WriteAll(sink, &header, sizeof(header), elements.data(), elements.size_bytes());
+    }
+
+    template <typename Source, typename T, typename Allocator, typename GrowthPolicy>
+    void ReadVector(Source& source, Vector<T, Allocator, GrowthPolicy>& v) {
+        static_assert(std::is_trivially_copyable_v<T>, "Only the bytes of trivially copyable elements can be read");
+
+        StreamHeader header{};
+        ReadAll(source, &header, sizeof(header));
+
+        const bool foreign = header.byte_order == kStreamForeignByteOrder;
+        if (foreign) {
+            header.version = ByteSwap(header.version);
+            header.flags = ByteSwap(header.flags);
+            header.element_size = ByteSwap(header.element_size);
+            header.count = ByteSwap(header.count);
+        }
+
+        if (!std::equal(kStreamMagic, kStreamMagic + 4, header.magic)
+            || (header.byte_order != kStreamByteOrder && !foreign)) {
+            throw std::runtime_error("Not a vector stream");
+        }
+        if (header.version != kStreamVersion) {
+            throw std::runtime_error("Unsupported vector stream version");
+        }
+        if (header.element_size != sizeof(T)) {
+            throw std::runtime_error("The vector stream holds elements of another size");
+        }
+        if (foreign && sizeof(T) != 1 && !std::is_arithmetic_v<T> && !std::is_enum_v<T>) {
+            throw std::runtime_error("Can't convert the byte order of the elements");
+        }
+
+        Vector<T, Allocator, GrowthPolicy> result(v.GetAllocator());
+        uint64_t remaining = RemainingBytes(source);
+
+        if ((header.flags & kStreamChunked) == 0) {
+            // A count the source is known to hold is allocated at once
+            if (remaining != kUnknownBytes && header.count <= remaining / sizeof(T)) {
+                result.Reserve(static_cast<size_t>(header.count));
+            }
+            ReadElements(source, result, header.count, foreign, remaining);
+        }
+        else {
+            for (uint64_t count = ReadCount(source, foreign, remaining); count != 0; count = ReadCount(source, foreign, remaining)) {
+                ReadElements(source, result, count, foreign, remaining);
+            }
+        }
+
+        v.Swap(result);
+    }
+}
+
+
+
+
+
+// Write the elements to a file descriptor or a stream in a single write where possible.
+// Throw std::system_error when a descriptor fails and std::runtime_error when a stream fails
+template <typename T>
+void WriteTo(int fd, std::span<const T> elements) {
+    detail::WriteVector(fd, elements);
+}
+
+template <typename T>
+void WriteTo(std::ostream& out, std::span<const T> elements) {
+    detail::WriteVector(out, elements);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy>
+void WriteTo(int fd, const Vector<T, Allocator, GrowthPolicy>& v) {
+    WriteTo(fd, std::span<const T>(v.Data(), v.Size()));
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy>
+void WriteTo(std::ostream& out, const Vector<T, Allocator, GrowthPolicy>& v) {
+    WriteTo(out, std::span<const T>(v.Data(), v.Size()));
+}
+
+// Replace the elements of v with the ones of a stream written by WriteTo or ChunkedWriter. The elements are read
+// into uninitialized memory without an intermediate buffer. Throw std::runtime_error for a malformed stream,
+// leaving v unchanged
+template <typename T, typename Allocator, typename GrowthPolicy>
+void ReadFrom(int fd, Vector<T, Allocator, GrowthPolicy>& v) {
+    detail::ReadVector(fd, v);
+}
+
+template <typename T, typename Allocator, typename GrowthPolicy>
+void ReadFrom(std::istream& in, Vector<T, Allocator, GrowthPolicy>& v) {
+    detail::ReadVector(in, v);
+}
+
+
+
+// Writes a chunked vector stream, for senders not knowing the number of elements up front.
+// The stream is complete only after Finish(), the destructor doesn't end it
+template <typename T>
+class ChunkedWriter {
+    static_assert(std::is_trivially_copyable_v<T>, "Only the bytes of trivially copyable elements can be written");
+
+public:
+    explicit ChunkedWriter(int fd)
+        : fd_(fd) {
+        WriteHeader();
+    }
+
+    explicit ChunkedWriter(std::ostream& out)
+        : out_(&out) {
+        WriteHeader();
+    }
+
+    ChunkedWriter(const ChunkedWriter&) = delete;
+    ChunkedWriter& operator=(const ChunkedWriter&) = delete;
+
+    void Write(std::span<const T> elements) {
+        if (elements.empty()) return;
+
+        WriteRaw<uint64_t>(elements.size(), elements.data(), elements.size_bytes());
+    }
+
+    void Finish() {
+        WriteRaw<uint64_t>(0, nullptr, 0);
+    }
+
+private:
+    void WriteHeader() {
+        WriteRaw(detail::MakeStreamHeader<T>(detail::kStreamChunked, 0), nullptr, 0);
+    }
+
+    template <typename Head>
+    void WriteRaw(const Head& head, const void* body, size_t body_size) {
+        if (out_ != nullptr) {
+            detail::WriteAll(*out_, &head, sizeof(head), body, body_size);
+        }
+        else {
+            detail::WriteAll(fd_, &head, sizeof(head), body, body_size);
+        }
+    }
+
+    int fd_ = -1;
+    std::ostream* out_ = nullptr;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+
+#include "vector.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+
+
+
+
+// Keeps the buffers of finished vectors for the next ones, so code which builds vectors of similar sizes
+// over and over, like a request handler, stops allocating once it has seen its largest sizes:
+//
+//     auto rows = VectorPool<Row>::Local().Acquire();
+//     rows->PushBack(row);
+//
+// A vector is handed out with at least the recommended capacity: the largest size of the vectors given back
+// over the last two windows of kWindow, so it adapts to a workload which shrinks. Given back, a vector is
+// cleared without freeing its buffer, unless the pool already holds max_idle vectors or the buffer is more
+// than twice the recommendation. With VECTOR_ENABLE_STATS the vectors of the pool are counted under its tag,
+// so the allocations it saves show in VectorStatsRegistry.
+// A pool is not thread-safe and must outlive the vectors it hands out; Local() gives each thread its own
+template <typename T, typename Allocator = std::allocator<T>, typename GrowthPolicy = DoublingGrowth>
+class VectorPool {
+public:
+    using Elements = Vector<T, Allocator, GrowthPolicy>;
+
+    static constexpr size_t kWindow = 64;
+
+    // Owns a vector of the pool and gives it back when destroyed
+    class PooledVector {
+    public:
+        PooledVector(PooledVector&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr))
+            , elements_(std::move(other.elements_)) {
+        }
+
+        PooledVector& operator=(PooledVector&& rhs) noexcept {
+            if (this != &rhs) {
+                GiveBack();
+                pool_ = std::exchange(rhs.pool_, nullptr);
+                elements_ = std::move(rhs.elements_);
+            }
+            return *this;
+        }
+
+        ~PooledVector() {
+            GiveBack();
+        }
+
+        Elements& operator*() noexcept {
+            return elements_;
+        }
+        const Elements& operator*() const noexcept {
+            return elements_;
+        }
+        Elements* operator->() noexcept {
+            return &elements_;
+        }
+        const Elements* operator->() const noexcept {
+            return &elements_;
+        }
+
+        // Takes the vector out of the pool's care
+        Elements Release() noexcept {
+            pool_ = nullptr;
+            return std::move(elements_);
+        }
+
+    private:
+        friend VectorPool;
+
+        PooledVector(VectorPool& pool, Elements&& elements) noexcept
+            : pool_(&pool)
+            , elements_(std::move(elements)) {
+        }
+
+        void GiveBack() noexcept {
+            if (pool_ != nullptr) {
+                std::exchange(pool_, nullptr)->GiveBack(std::move(elements_));
+            }
+        }
+
+        VectorPool* pool_;
+        Elements elements_;
+    };
+
+
+    explicit VectorPool(size_t max_idle = 16, std::string_view tag = {}, const Allocator& alloc = Allocator())
+        : tag_(tag)
+        , alloc_(alloc) {
+        idle_.Reserve(max_idle);
+    }
+
+    VectorPool(const VectorPool&) = delete;
+    VectorPool& operator=(const VectorPool&) = delete;
+
+    // The pool of this thread, destroyed when the thread exits
+    static VectorPool& Local() {
+        thread_local VectorPool pool;
+        return pool;
+    }
+
+
+    // An empty vector with at least RecommendedCapacity(), from the idle ones if there is one
+    PooledVector Acquire() {
+        Elements elements = TakeIdle();
+        elements.Reserve(RecommendedCapacity());
+        return PooledVector(*this, std::move(elements));
+    }
+
+    size_t RecommendedCapacity() const noexcept {
+        return std::max(window_peak_, previous_peak_);
+    }
+
+    size_t IdleCount() const noexcept {
+        return idle_.Size();
+    }
+
+private:
+    Vector<Elements> idle_;
+    std::string tag_;
+    [[no_unique_address]] Allocator alloc_;
+    // The largest size given back in the current window of kWindow vectors and in the one before it
+    size_t window_peak_ = 0;
+    size_t previous_peak_ = 0;
+    size_t given_back_ = 0;
+
+
+    Elements TakeIdle() {
+        if (idle_.Size() != 0) {
+            Elements elements = std::move(idle_.Back());
+            idle_.PopBack();
+            return elements;
+        }
+
+        Elements elements(alloc_);
+        if (!tag_.empty()) {
+            elements.SetStatsTag(tag_);
+        }
+        return elements;
+    }
+
+    void GiveBack(Elements&& elements) noexcept {
+        window_peak_ = std::max(window_peak_, elements.Size());
+        if (++given_back_ == kWindow) {
+            previous_peak_ = std::exchange(window_peak_, 0);
+            given_back_ = 0;
+        }
+
+        if (elements.Capacity() == 0 || idle_.Size() == idle_.Capacity()
+            || elements.Capacity() > 2 * RecommendedCapacity()) {
+            return;
+        }
+        elements.Clear();
+        idle_.PushBack(std::move(elements));
+    }
+};
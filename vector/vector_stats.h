@@ -0,0 +1,179 @@
+#pragma once
+
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <string>
+#include <string_view>
+
+
+
+
+
+// Allocation and relocation counters of the vectors sharing a tag. Updated with relaxed atomics,
+// so concurrent vectors may share a tag
+struct VectorStats {
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> allocated_bytes{ 0 };
+    std::atomic<uint64_t> relocations{ 0 };
+    std::atomic<uint64_t> relocated_elements{ 0 };
+    std::atomic<uint64_t> relocated_bytes{ 0 };
+    std::atomic<uint64_t> peak_capacity_bytes{ 0 };
+
+    void OnAllocate(size_t capacity_bytes) noexcept {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(capacity_bytes, std::memory_order_relaxed);
+
+        uint64_t peak = peak_capacity_bytes.load(std::memory_order_relaxed);
+        while (peak < capacity_bytes
+               && !peak_capacity_bytes.compare_exchange_weak(peak, capacity_bytes, std::memory_order_relaxed)) {
+        }
+    }
+
+    void OnRelocate(size_t elements, size_t bytes) noexcept {
+        relocations.fetch_add(1, std::memory_order_relaxed);
+        relocated_elements.fetch_add(elements, std::memory_order_relaxed);
+        relocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void Reset() noexcept {
+        allocations = 0;
+        allocated_bytes = 0;
+        relocations = 0;
+        relocated_elements = 0;
+        relocated_bytes = 0;
+        peak_capacity_bytes = 0;
+    }
+};
+
+
+
+
+
+// Process-wide VectorStats by tag. Vectors without a tag are counted under "untagged"
+class VectorStatsRegistry {
+public:
+    static VectorStatsRegistry& Instance() {
+        static VectorStatsRegistry registry;
+        return registry;
+    }
+
+    // The returned stats live as long as the registry
+    VectorStats& Get(std::string_view tag) {
+        std::lock_guard guard(mutex_);
+
+        auto it = stats_.find(tag);
+        if (it == stats_.end()) {
+            it = stats_.emplace(std::string(tag), std::make_unique<VectorStats>()).first;
+        }
+        return *it->second;
+    }
+
+    VectorStats& Untagged() noexcept {
+        return untagged_;
+    }
+
+    void Reset() noexcept {
+        std::lock_guard guard(mutex_);
+
+        for (auto& [tag, stats] : stats_) {
+            stats->Reset();
+        }
+    }
+
+    // Writes the counters in the Prometheus text exposition format
+    void Dump(std::ostream& out) const {
+        std::lock_guard guard(mutex_);
+
+        DumpMetric(out, "vector_allocations_total", "counter", &VectorStats::allocations);
+        DumpMetric(out, "vector_allocated_bytes_total", "counter", &VectorStats::allocated_bytes);
+        DumpMetric(out, "vector_relocations_total", "counter", &VectorStats::relocations);
+        DumpMetric(out, "vector_relocated_elements_total", "counter", &VectorStats::relocated_elements);
+        DumpMetric(out, "vector_relocated_bytes_total", "counter", &VectorStats::relocated_bytes);
+        DumpMetric(out, "vector_peak_capacity_bytes", "gauge", &VectorStats::peak_capacity_bytes);
+    }
+
+private:
+    VectorStatsRegistry()
+        : untagged_(Get("untagged")) {
+    }
+
+    void DumpMetric(std::ostream& out, std::string_view name, std::string_view type,
+                    std::atomic<uint64_t> VectorStats::* counter) const {
+        out << "# TYPE " << name << ' ' << type << '\n';
+
+        for (const auto& [tag, stats] : stats_) {
+            out << name << "{tag=\"";
+            for (char c : tag) {
+                if (c == '"' || c == '\\') {
+                    out << '\\';
+                }
+                out << (c == '\n' ? ' ' : c);
+            }
+            out << "\"} " << ((*stats).*counter).load(std::memory_order_relaxed) << '\n';
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<VectorStats>, std::less<>> stats_;
+    VectorStats& untagged_;
+};
+
+// Tag naming the place it is called from, like "main.cpp:42"
+inline std::string CallSiteTag(std::source_location location = std::source_location::current()) {
+    std::string_view file = location.file_name();
+    file.remove_prefix(file.find_last_of("/\\") + 1);
+
+    return std::string(file) + ':' + std::to_string(location.line());
+}
+
+
+
+
+
+// The stats of a single vector. Compiled to an empty object with no-op hooks unless VECTOR_ENABLE_STATS is defined
+#if defined(VECTOR_ENABLE_STATS)
+
+class VectorStatsHandle {
+public:
+    void SetTag(std::string_view tag) {
+        stats_ = &VectorStatsRegistry::Instance().Get(tag);
+    }
+
+    void OnAllocate(size_t capacity_bytes) const noexcept {
+        Get().OnAllocate(capacity_bytes);
+    }
+
+    void OnRelocate(size_t elements, size_t bytes) const noexcept {
+        Get().OnRelocate(elements, bytes);
+    }
+
+private:
+    VectorStats& Get() const noexcept {
+        return stats_ != nullptr ? *stats_ : VectorStatsRegistry::Instance().Untagged();
+    }
+
+    VectorStats* stats_ = nullptr;
+};
+
+#else
+
+class VectorStatsHandle {
+public:
+    void SetTag(std::string_view /*tag*/) noexcept {
+    }
+
+    void OnAllocate(size_t /*capacity_bytes*/) const noexcept {
+    }
+
+    void OnRelocate(size_t /*elements*/, size_t /*bytes*/) const noexcept {
+    }
+};
+
+#endif